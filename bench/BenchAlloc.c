@@ -0,0 +1,46 @@
+#include "BenchAlloc.h"
+#include "FileManager.h"
+
+/* The counters sit on top of the real allocator */
+#undef malloc
+#undef calloc
+#undef realloc
+#undef free
+
+#ifdef OS_IS_WINDOWS
+#include <windows.h>
+#define BENCH_ADD(counter, value) InterlockedExchangeAdd64((volatile LONG64*)&(counter), (LONG64)(value))
+#else
+#define BENCH_ADD(counter, value) __sync_fetch_and_add(&(counter), (unsigned long long)(value))
+#endif
+
+/* Extraction and hashing allocate from the worker pool, hence atomics */
+static unsigned long long allocations = 0;
+static unsigned long long allocatedBytes = 0;
+
+void* bench_malloc(size_t size) {
+    BENCH_ADD(allocations, 1);
+    BENCH_ADD(allocatedBytes, size);
+    return malloc(size);
+}
+
+void* bench_calloc(size_t count, size_t size) {
+    BENCH_ADD(allocations, 1);
+    BENCH_ADD(allocatedBytes, count * size);
+    return calloc(count, size);
+}
+
+void* bench_realloc(void* ptr, size_t size) {
+    BENCH_ADD(allocations, 1);
+    BENCH_ADD(allocatedBytes, size);
+    return realloc(ptr, size);
+}
+
+void bench_free(void* ptr) {
+    free(ptr);
+}
+
+void bench_alloc_stats(benchAllocStats_t* stats) {
+    stats->allocations = BENCH_ADD(allocations, 0);
+    stats->bytes = BENCH_ADD(allocatedBytes, 0);
+}
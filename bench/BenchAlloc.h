@@ -0,0 +1,34 @@
+#ifndef BENCH_ALLOC_H
+#define BENCH_ALLOC_H
+
+/**
+ * Counting allocator for the benchmarks. Force-included into every bench
+ * translation unit (-include bench/BenchAlloc.h) so library allocations are
+ * routed through the counters without touching the library sources.
+ **/
+
+/* Force-included ahead of FileManager.c, which needs the GNU extensions */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct s_benchAllocStats {
+    unsigned long long allocations;              // malloc, calloc and realloc calls
+    unsigned long long bytes;                    // Requested bytes, never decremented
+} benchAllocStats_t, *pBenchAllocStats_t;
+
+void* bench_malloc(size_t size);
+void* bench_calloc(size_t count, size_t size);
+void* bench_realloc(void* ptr, size_t size);
+void bench_free(void* ptr);
+void bench_alloc_stats(benchAllocStats_t* stats);
+
+#define malloc(size)        bench_malloc(size)
+#define calloc(count, size) bench_calloc(count, size)
+#define realloc(ptr, size)  bench_realloc(ptr, size)
+#define free(ptr)           bench_free(ptr)
+
+#endif
@@ -0,0 +1,231 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "FileManager.h"
+#include "DRSFormat.h"
+#include "BenchAlloc.h"
+
+#ifdef OS_IS_WINDOWS
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <time.h>
+#include <sys/resource.h>
+#endif
+
+#define BENCH_LOOKUP_ROUNDS 20
+
+typedef struct s_benchPhase {
+    const char*  name;
+    double       start;
+    benchAllocStats_t allocs;
+} benchPhase_t, *pBenchPhase_t;
+
+static double now_seconds(void) {
+#ifdef OS_IS_WINDOWS
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+#endif
+}
+
+/* Process high-water mark; it only grows, so phases run smallest first */
+static long peak_rss_kb(void) {
+#ifdef OS_IS_WINDOWS
+    PROCESS_MEMORY_COUNTERS counters;
+
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return -1;
+    }
+
+    return (long)(counters.PeakWorkingSetSize / 1024);
+#else
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage)) {
+        return -1;
+    }
+
+    return usage.ru_maxrss;
+#endif
+}
+
+static void phase_begin(pBenchPhase_t phase, const char* name) {
+    phase->name = name;
+    bench_alloc_stats(&phase->allocs);
+    phase->start = now_seconds();
+}
+
+/* One JSON object per phase, comma separated inside the results array */
+static void phase_end(pBenchPhase_t phase, size_t bytes, size_t entries, int* first, int rc) {
+    double seconds = now_seconds() - phase->start;
+    benchAllocStats_t allocs;
+
+    bench_alloc_stats(&allocs);
+    seconds = seconds > 0 ? seconds : 1e-9;
+
+    printf("%s\n    {\"op\": \"%s\", \"rc\": %d, \"seconds\": %.6f, \"mb_per_s\": %.2f, "
+        "\"entries_per_s\": %.0f, \"allocations\": %llu, \"alloc_bytes\": %llu, \"peak_rss_kb\": %ld}",
+        *first ? "" : ",", phase->name, rc, seconds, (double)bytes / (1024.0 * 1024.0) / seconds,
+        (double)entries / seconds, allocs.allocations - phase->allocs.allocations,
+        allocs.bytes - phase->allocs.bytes, peak_rss_kb());
+
+    *first = 0;
+}
+
+static char* bench_path(const char* dir, const char* name) {
+    char *path = malloc(strlen(dir) + strlen(name) + 2);
+
+    if (path) {
+        sprintf(path, "%s%c%s", dir, FS_DIR_CHAR, name);
+    }
+
+    return path;
+}
+
+static int bench_lookup(drs_t* drs, size_t* lookups) {
+    int i;
+    int ii;
+    int round;
+    int missed = 0;
+
+    *lookups = 0;
+
+    /* Every entry, alternating direction so the walk is not purely sequential */
+    for (round = 0; round < BENCH_LOOKUP_ROUNDS; ++round) {
+        for (i = 0; i < drs->header.tableCount; ++i) {
+            for (ii = 0; ii < drs->tables[i].header.fileCount; ++ii) {
+                drsFile_t *file = &drs->tables[i].files[round % 2 ? drs->tables[i].header.fileCount - 1 - ii : ii];
+
+                missed += drs_find(drs, file->id, drs->tables[i].header.extension, NULL) == NULL;
+                ++*lookups;
+            }
+        }
+    }
+
+    return missed ? 1 : 0;
+}
+
+int main(int argc, char* argv[]) {
+    drs_t drs;
+    benchPhase_t phase;
+    drsExtractOptions_t extractOptions;
+    drsCreateOptions_t createOptions;
+    drsCreateStats_t createStats;
+    const char *archive = NULL;
+    const char *workDir = NULL;
+    char *extractDir = NULL;
+    char *copyDir = NULL;
+    char *createPath = NULL;
+    char *buildPath = NULL;
+    size_t entries = 0;
+    size_t bytes = 0;
+    size_t lookups;
+    int jobs = 0;
+    int first = 1;
+    int rc;
+    int idx;
+    int i;
+
+    for (idx = 1; idx < argc; ++idx) {
+        if ((!strcmp("-j", argv[idx]) || !strcmp("--jobs", argv[idx])) && idx + 1 < argc) {
+            jobs = atoi(argv[++idx]);
+        } else if (!archive) {
+            archive = argv[idx];
+        } else {
+            workDir = argv[idx];
+        }
+    }
+
+    if (!archive || !workDir) {
+        fprintf(stderr, "Usage: %s <archive.drs> <work dir> [-j jobs]\n", argv[0]);
+        return 1;
+    }
+
+    if ((!directory_exists(workDir) && create_directory(workDir)) ||
+        !(extractDir = bench_path(workDir, "extract")) || !(copyDir = bench_path(workDir, "copy")) ||
+        !(createPath = bench_path(workDir, "create.drs")) || !(buildPath = bench_path(workDir, "build.drs"))) {
+        fprintf(stderr, "Failed to prepare %s\n", workDir);
+        return 1;
+    }
+
+    /* Headers only first, to size the run and to keep the RSS readings honest */
+    if ((rc = drs_open_index(archive, &drs))) {
+        fprintf(stderr, "Failed to open %s: %d\n", archive, rc);
+        return 1;
+    }
+
+    bytes = drs.fileSize;
+    for (i = 0; i < drs.header.tableCount; ++i) {
+        entries += drs.tables[i].header.fileCount;
+    }
+    drs_free(&drs);
+
+    printf("{\"archive\": \"%s\", \"entries\": %zu, \"bytes\": %zu, \"jobs\": %d, \"results\": [",
+        archive, entries, bytes, jobs);
+
+    memset(&extractOptions, 0, sizeof(extractOptions));
+    extractOptions.jobs = jobs;
+
+    phase_begin(&phase, "open_index");
+    rc = drs_open_index(archive, &drs);
+    phase_end(&phase, 0, entries, &first, rc);
+
+    if (!rc) {
+        phase_begin(&phase, "lookup");
+        rc = bench_lookup(&drs, &lookups);
+        phase_end(&phase, 0, lookups, &first, rc);
+
+        phase_begin(&phase, "extract_kernel_copy");
+        rc = drs_extract_archive_ex(&drs, copyDir, &extractOptions);
+        phase_end(&phase, bytes, entries, &first, rc);
+        drs_free(&drs);
+    }
+
+    phase_begin(&phase, "open_mapped");
+    rc = drs_open_mapped(archive, &drs);
+    phase_end(&phase, 0, entries, &first, rc);
+
+    if (!rc) {
+        drs_free(&drs);
+    }
+
+    phase_begin(&phase, "create_from_directory");
+    createOptions.dedup = 0;
+    createOptions.extended = 0;
+    createOptions.jobs = jobs;
+    rc = drs_create_from_directory(copyDir, buildPath, &createOptions, &createStats);
+    phase_end(&phase, bytes, entries, &first, rc);
+
+    phase_begin(&phase, "load");
+    rc = drs_load(archive, &drs);
+    phase_end(&phase, bytes, entries, &first, rc);
+
+    if (!rc) {
+        phase_begin(&phase, "extract");
+        rc = drs_extract_archive_ex(&drs, extractDir, &extractOptions);
+        phase_end(&phase, bytes, entries, &first, rc);
+
+        phase_begin(&phase, "create");
+        rc = drs_create_archive(&drs, createPath);
+        phase_end(&phase, bytes, entries, &first, rc);
+        drs_free(&drs);
+    }
+
+    printf("\n]}\n");
+
+    free(extractDir);
+    free(copyDir);
+    free(createPath);
+    free(buildPath);
+    return 0;
+}
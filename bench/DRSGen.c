@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "FileManager.h"
+#include "DRSFormat.h"
+
+#define GEN_CHUNK_SIZE (64 * 1024)
+
+static const char* extensions[] = { "slp", "wav", "bin", "shp", "pal", "txt", "map", "cur" };
+
+typedef struct s_genConfig {
+    const char*  output;
+    int          tables;
+    int          entries;                        // Files per table
+    size_t       minSize;
+    size_t       maxSize;
+    int          largeEvery;                     // Every n-th file uses the large range, 0 for never
+    size_t       largeMinSize;
+    size_t       largeMaxSize;
+    unsigned int seed;
+} genConfig_t, *pGenConfig_t;
+
+static unsigned int gen_random(unsigned int* seed) {
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 8;
+}
+
+/* Log-uniform between min and max: as many 100 byte files as 100 KiB ones */
+static size_t gen_size(unsigned int* seed, size_t minSize, size_t maxSize) {
+    int minBits = 0;
+    int maxBits = 0;
+    int bits;
+    size_t low;
+    size_t high;
+
+    while (((size_t)1 << (minBits + 1)) <= minSize) {
+        ++minBits;
+    }
+
+    while (((size_t)1 << (maxBits + 1)) <= maxSize) {
+        ++maxBits;
+    }
+
+    bits = minBits + (int)(gen_random(seed) % (unsigned int)(maxBits - minBits + 1));
+    low = (size_t)1 << bits;
+    high = ((size_t)1 << (bits + 1)) - 1;
+    low = low < minSize ? minSize : low;
+    high = high > maxSize ? maxSize : high;
+
+    return low + gen_random(seed) % (high - low + 1);
+}
+
+static int gen_profile(const char* profile, pGenConfig_t conf) {
+    if (!strcmp("tiny", profile)) {
+        /* Interface-style archive: thousands of small SLPs */
+        conf->tables = 4;
+        conf->entries = 5000;
+        conf->minSize = 64;
+        conf->maxSize = 8 * 1024;
+        conf->largeEvery = 0;
+    } else if (!strcmp("large", profile)) {
+        /* Sound-style archive: a few large WAVs */
+        conf->tables = 1;
+        conf->entries = 48;
+        conf->minSize = 256 * 1024;
+        conf->maxSize = 8 * 1024 * 1024;
+        conf->largeEvery = 0;
+    } else if (!strcmp("mixed", profile)) {
+        conf->tables = 4;
+        conf->entries = 2000;
+        conf->minSize = 64;
+        conf->maxSize = 16 * 1024;
+        conf->largeEvery = 50;
+        conf->largeMinSize = 256 * 1024;
+        conf->largeMaxSize = 4 * 1024 * 1024;
+    } else {
+        return 1;
+    }
+
+    return 0;
+}
+
+static int parseParams(int argc, char* argv[], pGenConfig_t conf) {
+    int idx;
+
+    memset(conf, 0, sizeof(genConfig_t));
+    conf->output = "synthetic.drs";
+    conf->seed = 12345;
+    gen_profile("mixed", conf);
+
+    for (idx = 1; idx < argc; ++idx) {
+        if ((!strcmp("-o", argv[idx]) || !strcmp("--output", argv[idx])) && idx + 1 < argc) {
+            conf->output = argv[++idx];
+        } else if (!strcmp("--profile", argv[idx]) && idx + 1 < argc) {
+            if (gen_profile(argv[++idx], conf)) {
+                fprintf(stderr, "Unknown profile %s, expected tiny, large or mixed\n", argv[idx]);
+                return 1;
+            }
+        } else if (!strcmp("--tables", argv[idx]) && idx + 1 < argc) {
+            conf->tables = atoi(argv[++idx]);
+        } else if (!strcmp("--entries", argv[idx]) && idx + 1 < argc) {
+            conf->entries = atoi(argv[++idx]);
+        } else if (!strcmp("--min-size", argv[idx]) && idx + 1 < argc) {
+            /* Explicit sizes bound every file, the profile's large files included */
+            conf->minSize = (size_t)strtoul(argv[++idx], NULL, 10);
+            conf->largeEvery = 0;
+        } else if (!strcmp("--max-size", argv[idx]) && idx + 1 < argc) {
+            conf->maxSize = (size_t)strtoul(argv[++idx], NULL, 10);
+            conf->largeEvery = 0;
+        } else if (!strcmp("--seed", argv[idx]) && idx + 1 < argc) {
+            conf->seed = (unsigned int)strtoul(argv[++idx], NULL, 10);
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[idx]);
+            return 1;
+        }
+    }
+
+    if (conf->tables < 1 || conf->tables > (int)(sizeof(extensions) / sizeof(extensions[0])) ||
+        conf->entries < 0 || !conf->minSize || conf->minSize > conf->maxSize) {
+        fprintf(stderr, "Expected 1 to %d tables, a file count and 0 < min-size <= max-size\n",
+            (int)(sizeof(extensions) / sizeof(extensions[0])));
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Headers first, then payloads streamed in chunks so any size fits in memory */
+static int gen_write(drs_t* drs, pGenConfig_t conf) {
+    int i;
+    int ii;
+    int fd;
+    int rc = 0;
+    size_t headerSize = drs_header_size(drs);
+    size_t done;
+    size_t chunk;
+    size_t k;
+    unsigned char *buffer = NULL;
+    unsigned int seed = conf->seed;
+
+    if (!(buffer = malloc(headerSize > GEN_CHUNK_SIZE ? headerSize : GEN_CHUNK_SIZE))) {
+        return 4;
+    }
+
+    if ((fd = file_create(conf->output)) == -1) {
+        fprintf(stderr, "Failed to create %s\n", conf->output);
+        free(buffer);
+        return 6;
+    }
+
+    drs_encode_headers(drs, buffer);
+    rc = file_write_all(fd, buffer, headerSize) ? 7 : 0;
+
+    for (i = 0; i < drs->header.tableCount && !rc; ++i) {
+        for (ii = 0; ii < drs->tables[i].header.fileCount && !rc; ++ii) {
+            for (done = 0; done < drs->tables[i].files[ii].size && !rc; done += chunk) {
+                chunk = drs->tables[i].files[ii].size - done;
+                chunk = chunk > GEN_CHUNK_SIZE ? GEN_CHUNK_SIZE : chunk;
+
+                for (k = 0; k < chunk; ++k) {
+                    buffer[k] = (unsigned char)gen_random(&seed);
+                }
+
+                rc = file_write_all(fd, buffer, chunk) ? 7 : 0;
+            }
+        }
+    }
+
+    if (file_close_descriptor(fd) && !rc) {
+        rc = 7;
+    }
+
+    free(buffer);
+    return rc;
+}
+
+int main(int argc, char* argv[]) {
+    drs_t drs;
+    genConfig_t conf;
+    int i;
+    int ii;
+    int rc;
+    unsigned int seed;
+    size_t size;
+
+    if (parseParams(argc, argv, &conf)) {
+        return 1;
+    }
+
+    drs_init_empty(&drs);
+    drs_set_copyright(&drs, DRS_DEFAULT_COPYRIGHT);
+    strcpy(drs.header.version, DRS_DEFAULT_VERSION);
+    strcpy(drs.header.type, DRS_DEFAULT_TYPE);
+    drs.header.tableCount = conf.tables;
+
+    if (!(drs.tables = calloc(conf.tables, sizeof(drsTable_t)))) {
+        return 4;
+    }
+
+    seed = conf.seed;
+
+    for (i = 0; i < conf.tables; ++i) {
+        strcpy(drs.tables[i].header.extension, extensions[i]);
+        drs.tables[i].header.fileType = drs_file_type(extensions[i]);
+        drs.tables[i].header.fileCount = conf.entries;
+
+        if (conf.entries && !(drs.tables[i].files = calloc(conf.entries, sizeof(drsFile_t)))) {
+            drs_free(&drs);
+            return 4;
+        }
+
+        /* Sparse IDs, each table in its own range like the game archives */
+        for (ii = 0; ii < conf.entries; ++ii) {
+            if (conf.largeEvery && !(ii % conf.largeEvery)) {
+                size = gen_size(&seed, conf.largeMinSize, conf.largeMaxSize);
+            } else {
+                size = gen_size(&seed, conf.minSize, conf.maxSize);
+            }
+
+            drs.tables[i].files[ii].id = 50000 * i + 3 * ii + (int)(gen_random(&seed) % 3);
+            drs.tables[i].files[ii].size = size > INT_MAX ? INT_MAX : size;
+        }
+    }
+
+    if (drs_layout(&drs)) {
+        fprintf(stderr, "Synthetic archive does not fit in a DRS file\n");
+        drs_free(&drs);
+        return 5;
+    }
+
+    if (!(rc = gen_write(&drs, &conf))) {
+        printf("%s: %d tables, %d files, %zu bytes\n", conf.output, conf.tables,
+            conf.tables * conf.entries, drs.fileSize);
+    }
+
+    drs_free(&drs);
+    return rc;
+}
@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "FileManager.h"
+#include "DRSFormat.h"
+#include "DRSVfs.h"
+
+#ifdef OS_IS_WINDOWS
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define BENCH_TABLES     4
+#define BENCH_FILES   4000
+#define BENCH_LOOKUPS 200000
+
+static const char* extensions[BENCH_TABLES] = { "bin", "slp", "wav", "shp" };
+
+static double now_seconds(void) {
+#ifdef OS_IS_WINDOWS
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+#endif
+}
+
+/* What every caller had to do before drs_find() */
+static pDrsFile_t linear_find(drs_t* drs, int id, const char* extension) {
+    int i;
+    int ii;
+
+    for (i = 0; i < drs->header.tableCount; ++i) {
+        if (extension && strcmp(drs->tables[i].header.extension, extension)) {
+            continue;
+        }
+
+        for (ii = 0; ii < drs->tables[i].header.fileCount; ++ii) {
+            if (drs->tables[i].files[ii].id == id) {
+                return &drs->tables[i].files[ii];
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static int build_synthetic(drs_t* drs) {
+    int i;
+    int ii;
+
+    drs_init_empty(drs);
+    drs->header.tableCount = BENCH_TABLES;
+
+    if (!(drs->tables = calloc(BENCH_TABLES, sizeof(drsTable_t)))) {
+        return 1;
+    }
+
+    for (i = 0; i < BENCH_TABLES; ++i) {
+        strcpy(drs->tables[i].header.extension, extensions[i]);
+        drs->tables[i].header.fileCount = BENCH_FILES;
+
+        if (!(drs->tables[i].files = calloc(BENCH_FILES, sizeof(drsFile_t)))) {
+            return 1;
+        }
+
+        /* Sparse, shuffled IDs like real archives */
+        for (ii = 0; ii < BENCH_FILES; ++ii) {
+            drs->tables[i].files[ii].id = ((ii * 7919) % BENCH_FILES) * 3 + i * 50000;
+        }
+    }
+
+    return drs_index_build(drs);
+}
+
+/* A mod shadowing every other entry of the slp table */
+static int build_override(drs_t* drs) {
+    int ii;
+
+    drs_init_empty(drs);
+    drs->header.tableCount = 1;
+
+    if (!(drs->tables = calloc(1, sizeof(drsTable_t)))) {
+        return 1;
+    }
+
+    strcpy(drs->tables[0].header.extension, extensions[1]);
+    drs->tables[0].header.fileCount = BENCH_FILES / 2;
+
+    if (!(drs->tables[0].files = calloc(BENCH_FILES / 2, sizeof(drsFile_t)))) {
+        return 1;
+    }
+
+    for (ii = 0; ii < BENCH_FILES / 2; ++ii) {
+        drs->tables[0].files[ii].id = ii * 6 + 50000;
+    }
+
+    return drs_index_build(drs);
+}
+
+int main(void) {
+    drs_t drs;
+    drs_t mod;
+    drsVfs_t vfs;
+    drs_t *owner = NULL;
+    int modHandle;
+    int shadowed;
+    double vfsTime;
+    double remountTime;
+    int i;
+    int id;
+    int found;
+    int totalFiles = BENCH_TABLES * BENCH_FILES;
+    double start;
+    double linearTime;
+    double indexTime;
+    unsigned int seed = 12345;
+    int* ids;
+    const char** exts;
+
+    if (build_synthetic(&drs) || build_override(&mod)) {
+        fprintf(stderr, "Failed to build synthetic archive\n");
+        return 1;
+    }
+
+    ids = malloc(BENCH_LOOKUPS * sizeof(int));
+    exts = malloc(BENCH_LOOKUPS * sizeof(char*));
+    if (!ids || !exts) {
+        return 1;
+    }
+
+    for (i = 0; i < BENCH_LOOKUPS; ++i) {
+        seed = seed * 1103515245 + 12345;
+        id = (seed >> 8) % totalFiles;
+        exts[i] = extensions[id / BENCH_FILES];
+        ids[i] = (id % BENCH_FILES) * 3 + (id / BENCH_FILES) * 50000;
+    }
+
+    found = 0;
+    start = now_seconds();
+    for (i = 0; i < BENCH_LOOKUPS; ++i) {
+        found += linear_find(&drs, ids[i], exts[i]) != NULL;
+    }
+    linearTime = now_seconds() - start;
+
+    if (found != BENCH_LOOKUPS) {
+        fprintf(stderr, "Linear scan missed %d lookups\n", BENCH_LOOKUPS - found);
+    }
+
+    found = 0;
+    start = now_seconds();
+    for (i = 0; i < BENCH_LOOKUPS; ++i) {
+        found += drs_find(&drs, ids[i], exts[i], NULL) != NULL;
+    }
+    indexTime = now_seconds() - start;
+
+    if (found != BENCH_LOOKUPS) {
+        fprintf(stderr, "Index missed %d lookups\n", BENCH_LOOKUPS - found);
+    }
+
+    drs_vfs_init(&vfs);
+
+    if (drs_vfs_mount(&vfs, &drs, 0, NULL) || drs_vfs_mount(&vfs, &mod, 1, &modHandle)) {
+        fprintf(stderr, "Failed to mount synthetic archives\n");
+        return 1;
+    }
+
+    found = 0;
+    shadowed = 0;
+    start = now_seconds();
+    for (i = 0; i < BENCH_LOOKUPS; ++i) {
+        found += drs_vfs_find(&vfs, ids[i], exts[i], &owner, NULL) != NULL;
+        shadowed += owner == &mod;
+    }
+    vfsTime = now_seconds() - start;
+
+    if (found != BENCH_LOOKUPS) {
+        fprintf(stderr, "Overlay missed %d lookups\n", BENCH_LOOKUPS - found);
+    }
+
+    start = now_seconds();
+    if (drs_vfs_unmount(&vfs, modHandle) || drs_vfs_mount(&vfs, &mod, 1, &modHandle)) {
+        fprintf(stderr, "Failed to remount the override archive\n");
+    }
+    remountTime = now_seconds() - start;
+
+    printf("%d entries, %d lookups\n", totalFiles, BENCH_LOOKUPS);
+    printf("%20s  %10.1f ns/lookup\n", "linear scan:", linearTime * 1e9 / BENCH_LOOKUPS);
+    printf("%20s  %10.1f ns/lookup\n", "drs_find:", indexTime * 1e9 / BENCH_LOOKUPS);
+    printf("%20s  %10.1fx\n", "speedup:", linearTime / (indexTime > 0 ? indexTime : 1e-9));
+    printf("%20s  %10.1f ns/lookup (%d shadowed by the override)\n", "drs_vfs_find:",
+        vfsTime * 1e9 / BENCH_LOOKUPS, shadowed);
+    printf("%20s  %10.1f us\n", "unmount+mount:", remountTime * 1e6);
+
+    free(ids);
+    free((void*)exts);
+    drs_vfs_free(&vfs);
+    drs_free(&mod);
+    drs_free(&drs);
+    return 0;
+}
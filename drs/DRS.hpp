@@ -0,0 +1,419 @@
+#ifndef DRS_HPP
+#define DRS_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#if __has_include(<span>)
+#include <span>
+#endif
+
+#include "DRSFormat.h"
+
+/**
+ * Header-only C++17 layer over DRSFormat.h. Archive owns a drs_t and is
+ * move-only, everything else is a view into it: tables, entries and
+ * payload bytes point at the archive's own memory and are invalidated
+ * with it. Nothing here allocates beyond what the C calls do, except
+ * Builder, which keeps its list of entries.
+ *
+ * Failures throw drs::Error carrying the C return code.
+ **/
+
+namespace drs {
+
+#if defined(__cpp_lib_span)
+using Bytes = std::span<const std::byte>;
+#else
+/* Read-only std::span<const std::byte> for C++17 */
+class Bytes {
+public:
+    constexpr Bytes() noexcept = default;
+    constexpr Bytes(const std::byte* data, std::size_t size) noexcept : data_(data), size_(size) {}
+    Bytes(const std::vector<std::byte>& bytes) noexcept : data_(bytes.data()), size_(bytes.size()) {}
+
+    constexpr const std::byte* data() const noexcept { return data_; }
+    constexpr std::size_t size() const noexcept { return size_; }
+    constexpr std::size_t size_bytes() const noexcept { return size_; }
+    constexpr bool empty() const noexcept { return !size_; }
+    constexpr const std::byte* begin() const noexcept { return data_; }
+    constexpr const std::byte* end() const noexcept { return data_ + size_; }
+    constexpr const std::byte& operator[](std::size_t i) const noexcept { return data_[i]; }
+
+    constexpr Bytes subspan(std::size_t offset, std::size_t count = static_cast<std::size_t>(-1)) const noexcept {
+        return Bytes(data_ + offset, count == static_cast<std::size_t>(-1) ? size_ - offset : count);
+    }
+
+private:
+    const std::byte* data_ = nullptr;
+    std::size_t size_ = 0;
+};
+#endif
+
+class Error : public std::runtime_error {
+public:
+    Error(const char* what, int code) : std::runtime_error(what), code_(code) {}
+
+    int code() const noexcept { return code_; }
+
+private:
+    int code_;
+};
+
+enum class Storage {
+    Owned = DRS_STORAGE_OWNED,                   // drs_load: the archive image lives in memory
+    Mapped = DRS_STORAGE_MAPPED,                 // drs_open_mapped: payloads borrowed from the mapping
+    Index = DRS_STORAGE_INDEX                    // drs_open_index: headers only, see Archive::read
+};
+
+/* One file of a table; cheap to copy, it is two pointers */
+class Entry {
+public:
+    Entry(const drsTable_t* table, const drsFile_t* file) noexcept : table_(table), file_(file) {}
+
+    int id() const noexcept { return file_->id; }
+    std::string_view extension() const noexcept { return table_->header.extension; }
+    std::size_t offset() const noexcept { return file_->offset; }
+    std::size_t size() const noexcept { return file_->size; }
+
+    /* False for archives opened with Storage::Index, read the payload with Archive::read */
+    bool loaded() const noexcept { return file_->data || !file_->size; }
+
+    /* The payload in place, empty when not loaded */
+    Bytes bytes() const noexcept {
+        return Bytes(reinterpret_cast<const std::byte*>(file_->data), file_->data ? size() : 0);
+    }
+
+    const drsTable_t* table() const noexcept { return table_; }
+    const drsFile_t* raw() const noexcept { return file_; }
+
+private:
+    const drsTable_t* table_;
+    const drsFile_t* file_;
+};
+
+class EntryIterator {
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Entry;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = Entry;
+
+    EntryIterator() noexcept = default;
+    EntryIterator(const drsTable_t* table, const drsFile_t* file) noexcept : table_(table), file_(file) {}
+
+    Entry operator*() const noexcept { return Entry(table_, file_); }
+    EntryIterator& operator++() noexcept { ++file_; return *this; }
+    EntryIterator operator++(int) noexcept { EntryIterator before = *this; ++file_; return before; }
+    bool operator==(const EntryIterator& other) const noexcept { return file_ == other.file_; }
+    bool operator!=(const EntryIterator& other) const noexcept { return file_ != other.file_; }
+
+private:
+    const drsTable_t* table_ = nullptr;
+    const drsFile_t* file_ = nullptr;
+};
+
+class Table {
+public:
+    explicit Table(const drsTable_t* table) noexcept : table_(table) {}
+
+    std::string_view extension() const noexcept { return table_->header.extension; }
+    char fileType() const noexcept { return table_->header.fileType; }
+    std::size_t size() const noexcept { return static_cast<std::size_t>(table_->header.fileCount); }
+    bool empty() const noexcept { return !table_->header.fileCount; }
+
+    Entry operator[](std::size_t i) const noexcept { return Entry(table_, &table_->files[i]); }
+    EntryIterator begin() const noexcept { return EntryIterator(table_, table_->files); }
+    EntryIterator end() const noexcept { return EntryIterator(table_, table_->files + table_->header.fileCount); }
+
+    const drsTable_t* raw() const noexcept { return table_; }
+
+private:
+    const drsTable_t* table_;
+};
+
+class TableIterator {
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Table;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = Table;
+
+    TableIterator() noexcept = default;
+    explicit TableIterator(const drsTable_t* table) noexcept : table_(table) {}
+
+    Table operator*() const noexcept { return Table(table_); }
+    TableIterator& operator++() noexcept { ++table_; return *this; }
+    TableIterator operator++(int) noexcept { TableIterator before = *this; ++table_; return before; }
+    bool operator==(const TableIterator& other) const noexcept { return table_ == other.table_; }
+    bool operator!=(const TableIterator& other) const noexcept { return table_ != other.table_; }
+
+private:
+    const drsTable_t* table_ = nullptr;
+};
+
+/* Every entry of every table, in header order */
+class ArchiveIterator {
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Entry;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = Entry;
+
+    ArchiveIterator() noexcept = default;
+    ArchiveIterator(const drsTable_t* table, const drsTable_t* last) noexcept : table_(table), last_(last) {
+        skipEmpty();
+    }
+
+    Entry operator*() const noexcept { return Entry(table_, &table_->files[file_]); }
+
+    ArchiveIterator& operator++() noexcept {
+        ++file_;
+        skipEmpty();
+        return *this;
+    }
+
+    ArchiveIterator operator++(int) noexcept { ArchiveIterator before = *this; ++*this; return before; }
+    bool operator==(const ArchiveIterator& other) const noexcept { return table_ == other.table_ && file_ == other.file_; }
+    bool operator!=(const ArchiveIterator& other) const noexcept { return !(*this == other); }
+
+private:
+    void skipEmpty() noexcept {
+        while (table_ != last_ && file_ == table_->header.fileCount) {
+            ++table_;
+            file_ = 0;
+        }
+    }
+
+    const drsTable_t* table_ = nullptr;
+    const drsTable_t* last_ = nullptr;
+    int file_ = 0;
+};
+
+template <typename Iterator>
+class Range {
+public:
+    Range(Iterator first, Iterator last) noexcept : first_(first), last_(last) {}
+
+    Iterator begin() const noexcept { return first_; }
+    Iterator end() const noexcept { return last_; }
+
+private:
+    Iterator first_;
+    Iterator last_;
+};
+
+class Archive {
+public:
+    Archive() noexcept { drs_init_empty(&drs_); }
+
+    static Archive load(const char* path) { return Archive(path, drs_load, "drs_load failed"); }
+    static Archive map(const char* path) { return Archive(path, drs_open_mapped, "drs_open_mapped failed"); }
+    static Archive index(const char* path) { return Archive(path, drs_open_index, "drs_open_index failed"); }
+    static Archive load(const std::string& path) { return load(path.c_str()); }
+    static Archive map(const std::string& path) { return map(path.c_str()); }
+    static Archive index(const std::string& path) { return index(path.c_str()); }
+
+    /* drs_t holds no pointers into itself, so a move is a plain copy that empties the source */
+    Archive(Archive&& other) noexcept : drs_(other.drs_) { drs_init_empty(&other.drs_); }
+
+    Archive& operator=(Archive&& other) noexcept {
+        if (this != &other) {
+            drs_free(&drs_);
+            drs_ = other.drs_;
+            drs_init_empty(&other.drs_);
+        }
+
+        return *this;
+    }
+
+    Archive(const Archive&) = delete;
+    Archive& operator=(const Archive&) = delete;
+
+    ~Archive() { drs_free(&drs_); }
+
+    Storage storage() const noexcept { return static_cast<Storage>(drs_.storage); }
+    std::size_t fileSize() const noexcept { return drs_.fileSize; }
+    std::string_view copyright() const noexcept { return drs_.header.copyright; }
+    std::string_view version() const noexcept { return drs_.header.version; }
+    bool extended() const noexcept { return drs_extended(&drs_) != 0; }
+    std::string_view type() const noexcept { return drs_.header.type; }
+
+    std::size_t tableCount() const noexcept { return static_cast<std::size_t>(drs_.header.tableCount); }
+    Table table(std::size_t i) const noexcept { return Table(&drs_.tables[i]); }
+
+    Range<TableIterator> tables() const noexcept {
+        return Range<TableIterator>(TableIterator(drs_.tables), TableIterator(drs_.tables + drs_.header.tableCount));
+    }
+
+    ArchiveIterator begin() const noexcept { return ArchiveIterator(drs_.tables, drs_.tables + drs_.header.tableCount); }
+    ArchiveIterator end() const noexcept {
+        const drsTable_t* last = drs_.tables + drs_.header.tableCount;
+        return ArchiveIterator(last, last);
+    }
+
+    /* First entry with this ID and extension, through the archive's sorted index */
+    std::optional<Entry> find(int id, const char* extension) const noexcept {
+        drsTable_t* table = nullptr;
+        drsFile_t* file = drs_find(const_cast<drs_t*>(&drs_), id, extension, &table);
+
+        if (!file) {
+            return std::nullopt;
+        }
+
+        return Entry(table, file);
+    }
+
+    /* Payload into buffer, which holds at least entry.size() bytes; works in every storage mode */
+    void read(const Entry& entry, std::byte* buffer) const {
+        int table = static_cast<int>(entry.table() - drs_.tables);
+        int file = static_cast<int>(entry.raw() - entry.table()->files);
+
+        if (int rc = drs_read_entry(const_cast<drs_t*>(&drs_), table, file, reinterpret_cast<unsigned char*>(buffer))) {
+            throw Error("drs_read_entry failed", rc);
+        }
+    }
+
+    void extract(const char* dir, const drsExtractOptions_t* options = nullptr) {
+        if (int rc = drs_extract_archive_ex(&drs_, dir, options)) {
+            throw Error("drs_extract_archive_ex failed", rc);
+        }
+    }
+
+    void list(drsListFormat_t format, int fd) {
+        if (int rc = drs_list_entries(&drs_, format, fd)) {
+            throw Error("drs_list_entries failed", rc);
+        }
+    }
+
+    /* For the C API; the archive keeps ownership */
+    drs_t* raw() noexcept { return &drs_; }
+    const drs_t* raw() const noexcept { return &drs_; }
+
+private:
+    Archive(const char* path, int (*open)(const char*, drs_t*), const char* what) {
+        if (int rc = open(path, &drs_)) {
+            throw Error(what, rc);
+        }
+    }
+
+    drs_t drs_;
+};
+
+/**
+ * Collects entries and writes them as a new archive, laid out the way
+ * drs_create_from_directory() does: tables by extension, entries by ID.
+ * add() with Bytes borrows the payload, which must outlive write(); add()
+ * with an rvalue vector takes the buffer over without copying it.
+ * extended() picks the 64-bit variant for archives beyond 2 GB.
+ **/
+class Builder {
+public:
+    Builder() = default;
+    Builder(Builder&&) noexcept = default;
+    Builder& operator=(Builder&&) noexcept = default;
+    Builder(const Builder&) = delete;
+    Builder& operator=(const Builder&) = delete;
+
+    Builder& add(int id, std::string_view extension, Bytes payload) {
+        Item item;
+
+        if (extension.empty() || extension.size() > DRS_TABLE_HDR_EXT_LENGTH) {
+            throw Error("extension must be 1 to 3 characters", 1);
+        }
+
+        item.id = id;
+        std::memset(item.extension, 0, sizeof(item.extension));
+        std::memcpy(item.extension, extension.data(), extension.size());
+        item.data = reinterpret_cast<const unsigned char*>(payload.data());
+        item.size = payload.size();
+        items_.push_back(item);
+        return *this;
+    }
+
+    Builder& add(int id, std::string_view extension, std::vector<std::byte>&& payload) {
+        /* Moving the vector keeps its buffer, so the borrowed pointer stays valid */
+        owned_.push_back(std::move(payload));
+        return add(id, extension, Bytes(owned_.back().data(), owned_.back().size()));
+    }
+
+    Builder& extended(bool on = true) noexcept {
+        extended_ = on;
+        return *this;
+    }
+
+    std::size_t size() const noexcept { return items_.size(); }
+
+    void write(const char* path) {
+        std::vector<drsTable_t> tables;
+        std::vector<drsFile_t> files(items_.size());
+        drs_t drs;
+
+        std::stable_sort(items_.begin(), items_.end(), [](const Item& a, const Item& b) {
+            int order = std::strcmp(a.extension, b.extension);
+            return order ? order < 0 : a.id < b.id;
+        });
+
+        for (std::size_t i = 0; i < items_.size(); ++i) {
+            if (!i || std::strcmp(items_[i].extension, items_[i - 1].extension)) {
+                drsTable_t table;
+
+                std::memset(&table, 0, sizeof(table));
+                std::strcpy(table.header.extension, items_[i].extension);
+                table.header.fileType = drs_file_type(items_[i].extension);
+                table.files = &files[i];
+                tables.push_back(table);
+            }
+
+            ++tables.back().header.fileCount;
+            files[i].id = items_[i].id;
+            files[i].size = items_[i].size;
+            files[i].data = const_cast<unsigned char*>(items_[i].data);
+        }
+
+        /* Tables and files stay in the vectors, so this drs_t is never passed to drs_free */
+        drs_init_empty(&drs);
+        drs_set_copyright(&drs, DRS_DEFAULT_COPYRIGHT);
+        drs_set_extended(&drs, extended_);
+        std::strcpy(drs.header.type, DRS_DEFAULT_TYPE);
+        drs.header.tableCount = static_cast<int>(tables.size());
+        drs.tables = tables.data();
+
+        if (drs_layout(&drs)) {
+            throw Error("entries do not fit in a DRS file", 5);
+        }
+
+        if (int rc = drs_create_archive(&drs, path)) {
+            throw Error("drs_create_archive failed", rc);
+        }
+    }
+
+    void write(const std::string& path) { write(path.c_str()); }
+
+private:
+    struct Item {
+        int          id;
+        char         extension[DRS_TABLE_HDR_EXT_LENGTH+1];
+        const unsigned char* data;
+        std::size_t  size;
+    };
+
+    std::vector<Item> items_;
+    std::vector<std::vector<std::byte>> owned_;
+    bool extended_ = false;
+};
+
+}
+
+#endif
@@ -0,0 +1,535 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "FileManager.h"
+#include "ThreadPool.h"
+#include "DRSBatch.h"
+
+#ifdef OS_IS_WINDOWS
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define DRS_BATCH_LIST_NAME "list.txt"
+
+typedef struct s_drsBatchContext {
+    pDrsBatch_t  batch;
+    pDrsBatchJob_t* order;                       // Largest archive first
+    int          innerJobs;                      // Threads each archive may use itself
+} drsBatchContext_t, *pDrsBatchContext_t;
+
+typedef struct s_drsBatchGlob {
+    const char*  pattern;
+    char**       names;
+    size_t       count;
+    size_t       capacity;
+} drsBatchGlob_t, *pDrsBatchGlob_t;
+
+static double drs_batch_now(void) {
+#ifdef OS_IS_WINDOWS
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+#endif
+}
+
+/**
+ * Output directory name from the archive path: leading /, ./ and ../ dropped,
+ * separators flattened to '_' and the .drs suffix removed, so localized
+ * copies like en/sounds.drs and de/sounds.drs stay apart.
+ **/
+static char* drs_batch_name(drsBatch_t* batch, const char* path) {
+    char *name = NULL;
+    char *pRealloc = NULL;
+    size_t length;
+    size_t i;
+    int suffix = 1;
+
+    for (;;) {
+        if (path[0] == '/' || path[0] == '\\') {
+            path += 1;
+        } else if (path[0] == '.' && (path[1] == '/' || path[1] == '\\')) {
+            path += 2;
+        } else if (path[0] == '.' && path[1] == '.' && (path[2] == '/' || path[2] == '\\')) {
+            path += 3;
+        } else {
+            break;
+        }
+    }
+
+    length = strlen(path);
+
+    if (length > 4 && path[length - 4] == '.' && tolower((unsigned char)path[length - 3]) == 'd' &&
+        tolower((unsigned char)path[length - 2]) == 'r' && tolower((unsigned char)path[length - 1]) == 's') {
+        length -= 4;
+    }
+
+    /* Room for a "_<n>" suffix should the name be taken */
+    if (!(name = malloc(length + 16))) {
+        return NULL;
+    }
+
+    for (i = 0; i < length; ++i) {
+        name[i] = (path[i] == '/' || path[i] == '\\' || path[i] == ':') ? '_' : path[i];
+    }
+
+    name[length] = '\0';
+
+    for (i = 0; i < batch->count; ++i) {
+        if (!strcmp(batch->archives[i].name, name)) {
+            sprintf(&name[length], "_%d", ++suffix);
+            i = (size_t)-1;
+        }
+    }
+
+    if ((pRealloc = realloc(name, strlen(name) + 1))) {
+        name = pRealloc;
+    }
+
+    return name;
+}
+
+void drs_batch_init(drsBatch_t* batch, drsBatchOp_t op, const char* output, int jobs) {
+    if (!batch) {
+        return;
+    }
+
+    memset(batch, 0, sizeof(drsBatch_t));
+    batch->op = op;
+    batch->output = output;
+    batch->jobs = jobs;
+    batch->storage = DRS_STORAGE_OWNED;
+    batch->listFormat = -1;
+}
+
+int drs_batch_add(drsBatch_t* batch, const char* path) {
+    pDrsBatchJob_t pRealloc = NULL;
+    pDrsBatchJob_t job = NULL;
+    long long modified;
+
+    if (!batch || !path || !path[0]) {
+        return 1;
+    }
+
+    if (batch->count == batch->capacity) {
+        batch->capacity = batch->capacity ? batch->capacity * 2 : 64;
+
+        if (!(pRealloc = realloc(batch->archives, batch->capacity * sizeof(drsBatchJob_t)))) {
+            return 4;
+        }
+
+        batch->archives = pRealloc;
+    }
+
+    job = &batch->archives[batch->count];
+    memset(job, 0, sizeof(drsBatchJob_t));
+
+    if (!(job->path = malloc(strlen(path) + 1)) || !(job->name = drs_batch_name(batch, path))) {
+        free(job->path);
+        return 4;
+    }
+
+    strcpy(job->path, path);
+
+    /* Missing archives are reported in the summary, not fatal for the batch */
+    if (file_info(path, &job->size, &modified)) {
+        job->rc = -1;
+    }
+
+    ++batch->count;
+    return 0;
+}
+
+/* One archive path per line; blank lines and lines starting with # are skipped */
+int drs_batch_add_manifest(drsBatch_t* batch, const char* manifestPath) {
+    FILE *fd = NULL;
+    char *line = NULL;
+    size_t bytes = 0;
+    int rc = 0;
+
+    if ((fd = file_open(manifestPath, "r")) == NULL) {
+        fprintf(stderr, "Failed to open manifest %s\n", manifestPath);
+        return 6;
+    }
+
+    while (!feof(fd) && !rc) {
+        line = NULL;
+        bytes = 0;
+
+        if (fm_getline(&line, &bytes, fd) && bytes) {
+            if (line[bytes - 1] == '\r') {
+                line[bytes - 1] = '\0';
+            }
+
+            if (line[0] && line[0] != '#') {
+                rc = drs_batch_add(batch, line);
+            }
+        }
+
+        if (line) {
+            free(line);
+        }
+    }
+
+    file_close(fd);
+    return rc;
+}
+
+/* '*' matches any run of characters, '?' exactly one */
+static int drs_batch_match(const char* pattern, const char* name) {
+    const char *star = NULL;
+    const char *resume = NULL;
+
+    while (*name) {
+        if (*pattern == '*') {
+            star = pattern++;
+            resume = name;
+        } else if (*pattern == '?' || *pattern == *name) {
+            ++pattern;
+            ++name;
+        } else if (star) {
+            pattern = star + 1;
+            name = ++resume;
+        } else {
+            return 0;
+        }
+    }
+
+    while (*pattern == '*') {
+        ++pattern;
+    }
+
+    return !*pattern;
+}
+
+static int drs_batch_collect(const char* name, size_t size, int isDirectory, void* userData) {
+    pDrsBatchGlob_t glob = userData;
+    char **pRealloc = NULL;
+
+    (void)size;
+
+    if (isDirectory || !drs_batch_match(glob->pattern, name)) {
+        return 0;
+    }
+
+    if (glob->count == glob->capacity) {
+        glob->capacity = glob->capacity ? glob->capacity * 2 : 64;
+
+        if (!(pRealloc = realloc(glob->names, glob->capacity * sizeof(char*)))) {
+            return 4;
+        }
+
+        glob->names = pRealloc;
+    }
+
+    if (!(glob->names[glob->count] = malloc(strlen(name) + 1))) {
+        return 4;
+    }
+
+    strcpy(glob->names[glob->count++], name);
+    return 0;
+}
+
+static int drs_batch_compare_names(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+/* Wildcards in the last path component only, as in data/sounds*.drs */
+int drs_batch_add_glob(drsBatch_t* batch, const char* pattern) {
+    drsBatchGlob_t glob;
+    const char *separator = strrchr(pattern, FS_DIR_CHAR);
+    char *dir = NULL;
+    char *path = NULL;
+    size_t dirLength = separator ? (size_t)(separator - pattern) : 0;
+    size_t i;
+    int rc;
+
+    memset(&glob, 0, sizeof(glob));
+    glob.pattern = separator ? separator + 1 : pattern;
+
+    if (!(dir = malloc(dirLength + 2))) {
+        return 4;
+    }
+
+    if (separator) {
+        memcpy(dir, pattern, dirLength);
+        dir[dirLength] = '\0';
+    } else {
+        strcpy(dir, ".");
+    }
+
+    if (!dir[0]) {
+        dir[0] = FS_DIR_CHAR;
+        dir[1] = '\0';
+    }
+
+    rc = directory_scan(dir, drs_batch_collect, &glob);
+    qsort(glob.names, glob.count, sizeof(char*), drs_batch_compare_names);
+
+    for (i = 0; i < glob.count; ++i) {
+        if (!rc) {
+            if (!(path = malloc(dirLength + strlen(glob.names[i]) + 2))) {
+                rc = 4;
+            } else {
+                if (separator) {
+                    memcpy(path, pattern, dirLength + 1);
+                    strcpy(&path[dirLength + 1], glob.names[i]);
+                } else {
+                    strcpy(path, glob.names[i]);
+                }
+
+                rc = drs_batch_add(batch, path);
+                free(path);
+            }
+        }
+
+        free(glob.names[i]);
+    }
+
+    if (!rc && !glob.count) {
+        fprintf(stderr, "No archives match %s\n", pattern);
+    }
+
+    free(glob.names);
+    free(dir);
+    return rc;
+}
+
+static char* drs_batch_output_dir(pDrsBatch_t batch, pDrsBatchJob_t job) {
+    char *path = malloc(strlen(batch->output) + strlen(job->name) + 2);
+
+    if (path) {
+        sprintf(path, "%s%c%s", batch->output, FS_DIR_CHAR, job->name);
+    }
+
+    return path;
+}
+
+static int drs_batch_list(pDrsBatch_t batch, pDrsBatchJob_t job, drs_t* drs) {
+    static const char* names[] = { "list.tsv", "list.json", "list.bin" };
+    const char *name = batch->listFormat < 0 ? DRS_BATCH_LIST_NAME : names[batch->listFormat];
+    char *dir = drs_batch_output_dir(batch, job);
+    char *path = NULL;
+    FILE *out = NULL;
+    int fd;
+    int rc = 0;
+
+    if (!dir || !(path = malloc(strlen(dir) + strlen(name) + 2))) {
+        free(dir);
+        return 4;
+    }
+
+    sprintf(path, "%s%c%s", dir, FS_DIR_CHAR, name);
+
+    if (!directory_exists(dir) && create_directory(dir)) {
+        rc = 6;
+    } else if (batch->listFormat >= 0) {
+        if ((fd = file_create(path)) == -1) {
+            rc = 6;
+        } else {
+            rc = drs_list_entries(drs, (drsListFormat_t)batch->listFormat, fd);
+
+            if (file_close_descriptor(fd) && !rc) {
+                rc = 7;
+            }
+        }
+    } else if ((out = file_open(path, "w")) == NULL) {
+        rc = 6;
+    } else {
+        drs_print_header(drs, out);
+        rc = file_close(out) ? 7 : 0;
+    }
+
+    free(path);
+    free(dir);
+    return rc;
+}
+
+static void drs_batch_worker(size_t item, void* userData) {
+    pDrsBatchContext_t context = userData;
+    pDrsBatch_t batch = context->batch;
+    pDrsBatchJob_t job = context->order[item];
+    drsExtractOptions_t extractOptions;
+    drsVerifyReport_t report;
+    drs_t drs;
+    char *dir = NULL;
+    double start = drs_batch_now();
+    int i;
+
+    if (job->rc) {
+        return;
+    }
+
+    if (batch->op == DRS_BATCH_VERIFY) {
+        if (!(job->rc = drs_verify(job->path, batch->fullVerify, context->innerJobs, &report))) {
+            job->entries = report.entries;
+            job->failed = report.mismatches;
+        }
+
+        job->seconds = drs_batch_now() - start;
+        return;
+    }
+
+    extractOptions.jobs = context->innerJobs;
+    extractOptions.filter = batch->filter;
+    extractOptions.coalesce = batch->filter && batch->storage == DRS_STORAGE_OWNED;
+
+    /* Listing never needs payloads, filtered extraction reads only the selected ones */
+    if (batch->op == DRS_BATCH_LIST || batch->storage == DRS_STORAGE_INDEX || extractOptions.coalesce) {
+        job->rc = drs_open_index(job->path, &drs);
+    } else if (batch->storage == DRS_STORAGE_MAPPED) {
+        job->rc = drs_open_mapped(job->path, &drs);
+    } else {
+        job->rc = drs_load(job->path, &drs);
+    }
+
+    if (job->rc) {
+        job->seconds = drs_batch_now() - start;
+        return;
+    }
+
+    for (i = 0; i < drs.header.tableCount; ++i) {
+        job->entries += drs.tables[i].header.fileCount;
+    }
+
+    if (batch->op == DRS_BATCH_LIST) {
+        job->rc = drs_batch_list(batch, job, &drs);
+    } else if (!(dir = drs_batch_output_dir(batch, job))) {
+        job->rc = 4;
+    } else {
+        if ((job->failed = drs_extract_archive_ex(&drs, dir, &extractOptions)) < 0) {
+            job->failed = 0;
+            job->rc = 6;
+        }
+
+        free(dir);
+    }
+
+    drs_free(&drs);
+    job->seconds = drs_batch_now() - start;
+}
+
+static int drs_batch_compare_size(const void* a, const void* b) {
+    const drsBatchJob_t *lhs = *(const drsBatchJob_t* const*)a;
+    const drsBatchJob_t *rhs = *(const drsBatchJob_t* const*)b;
+
+    if (lhs->size != rhs->size) {
+        return lhs->size > rhs->size ? -1 : 1;
+    }
+
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+/* Returns the number of archives that failed */
+int drs_batch_run(drsBatch_t* batch) {
+    drsBatchContext_t context;
+    size_t i;
+    int threads;
+    int failed = 0;
+
+    if (!batch || !batch->output) {
+        return -1;
+    }
+
+    if (batch->op != DRS_BATCH_VERIFY && !directory_exists(batch->output) &&
+        create_directory(batch->output)) {
+        fprintf(stderr, "Failed to create directory %s\n", batch->output);
+        return -1;
+    }
+
+    if (!(context.order = malloc((batch->count ? batch->count : 1) * sizeof(pDrsBatchJob_t)))) {
+        return -1;
+    }
+
+    for (i = 0; i < batch->count; ++i) {
+        context.order[i] = &batch->archives[i];
+    }
+
+    /* Longest processing time first; workers claim the next archive as they free up */
+    qsort(context.order, batch->count, sizeof(pDrsBatchJob_t), drs_batch_compare_size);
+
+    /* Spare threads go to the archives themselves once there are fewer archives than threads */
+    threads = batch->jobs > 0 ? batch->jobs : threadpool_cpu_count();
+    context.batch = batch;
+    context.innerJobs = batch->count && (size_t)threads > batch->count ? threads / (int)batch->count : 1;
+
+    threadpool_run(batch->count, threads, drs_batch_worker, &context);
+
+    for (i = 0; i < batch->count; ++i) {
+        failed += batch->archives[i].rc || batch->archives[i].failed;
+    }
+
+    free(context.order);
+    return failed;
+}
+
+static const char* drs_batch_status(pDrsBatch_t batch, pDrsBatchJob_t job) {
+    if (job->rc == -1) {
+        return "missing";
+    }
+
+    if (job->rc) {
+        return "error";
+    }
+
+    if (job->failed) {
+        return batch->op == DRS_BATCH_VERIFY ? "mismatch" : "partial";
+    }
+
+    return "ok";
+}
+
+/* In the order archives were given, whatever order they finished in */
+void drs_batch_print_summary(drsBatch_t* batch, FILE* out) {
+    size_t i;
+    size_t bytes = 0;
+    long long entries = 0;
+    int failed = 0;
+    double seconds = 0;
+    pDrsBatchJob_t job = NULL;
+
+    fprintf(out, "%-40s  %-8s  %4s  %8s  %8s  %12s  %9s\n",
+        "Archive", "Status", "RC", "Entries", "Failed", "Bytes", "Seconds");
+
+    for (i = 0; i < batch->count; ++i) {
+        job = &batch->archives[i];
+        fprintf(out, "%-40s  %-8s  %4d  %8d  %8d  %12zu  %9.3f\n", job->path, drs_batch_status(batch, job),
+            job->rc, job->entries, job->failed, job->size, job->seconds);
+
+        bytes += job->size;
+        entries += job->entries;
+        failed += job->rc || job->failed;
+        seconds += job->seconds;
+    }
+
+    fprintf(out, "\n%zu archives, %d failed, %lld entries, %zu bytes, %.3f archive-seconds\n",
+        batch->count, failed, entries, bytes, seconds);
+}
+
+void drs_batch_free(drsBatch_t* batch) {
+    size_t i;
+
+    if (!batch) {
+        return;
+    }
+
+    for (i = 0; i < batch->count; ++i) {
+        free(batch->archives[i].path);
+        free(batch->archives[i].name);
+    }
+
+    free(batch->archives);
+    batch->archives = NULL;
+    batch->count = 0;
+    batch->capacity = 0;
+}
@@ -0,0 +1,59 @@
+#ifndef DRS_BATCH_H
+#define DRS_BATCH_H
+
+#include <stdio.h>
+
+#include "DRSFormat.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Runs one operation over many archives in a single process. Archives are
+ * handed to the thread pool largest first, so a few big ones start early
+ * and the small ones fill in around them.
+ **/
+
+typedef enum e_drsBatchOp {
+    DRS_BATCH_LIST = 0,
+    DRS_BATCH_EXTRACT,
+    DRS_BATCH_VERIFY
+} drsBatchOp_t;
+
+typedef struct s_drsBatchJob {
+    char*        path;
+    char*        name;                           // Output directory name, unique within the batch
+    size_t       size;
+    int          rc;                             // 0 on success
+    int          entries;
+    int          failed;                         // Entries not extracted, or hash mismatches
+    double       seconds;
+} drsBatchJob_t, *pDrsBatchJob_t;
+
+typedef struct s_drsBatch {
+    drsBatchOp_t op;
+    const char*  output;                         // Root of the per-archive output directories
+    int          jobs;                           // Worker threads, 0 for one per CPU
+    drsStorage_t storage;                        // How extraction opens archives
+    int          fullVerify;
+    int          listFormat;                     // drsListFormat_t, -1 for the text listing
+    const drsFilter_t* filter;                   // Entries to extract, NULL for all
+    pDrsBatchJob_t archives;
+    size_t       count;
+    size_t       capacity;
+} drsBatch_t, *pDrsBatch_t;
+
+void drs_batch_init(drsBatch_t* batch, drsBatchOp_t op, const char* output, int jobs);
+int drs_batch_add(drsBatch_t* batch, const char* path);
+int drs_batch_add_manifest(drsBatch_t* batch, const char* manifestPath);
+int drs_batch_add_glob(drsBatch_t* batch, const char* pattern);
+int drs_batch_run(drsBatch_t* batch);
+void drs_batch_print_summary(drsBatch_t* batch, FILE* out);
+void drs_batch_free(drsBatch_t* batch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
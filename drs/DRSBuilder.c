@@ -0,0 +1,517 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "FileManager.h"
+#include "ThreadPool.h"
+#include "Hash.h"
+#include "Stats.h"
+#include "DRSFormat.h"
+
+typedef struct s_drsBuildEntry {
+    int          id;
+    char         extension[DRS_TABLE_HDR_EXT_LENGTH+1];
+    size_t       size;
+    char*        name;                           // File name within the source directory
+    size_t       leader;                         // Entry whose payload this one shares
+    hash64_t     hash;                           // Content hash, dedup only
+    int          failed;
+} drsBuildEntry_t, *pDrsBuildEntry_t;
+
+typedef struct s_drsBuildList {
+    pDrsBuildEntry_t entries;
+    size_t       count;
+    size_t       capacity;
+    const char*  dir;
+    int          extended;                       // Write the 64-bit variant
+} drsBuildList_t, *pDrsBuildList_t;
+
+static char* drs_build_path(const char* dir, const char* name) {
+    char *path = malloc(strlen(dir) + strlen(name) + 2);
+
+    if (path) {
+        sprintf(path, "%s%c%s", dir, FS_DIR_CHAR, name);
+    }
+
+    return path;
+}
+
+static int drs_build_collect(const char* name, size_t size, int isDirectory, void* userData) {
+    pDrsBuildList_t list = userData;
+    pDrsBuildEntry_t pRealloc = NULL;
+    pDrsBuildEntry_t entry = NULL;
+
+    if (isDirectory) {
+        return 0;
+    }
+
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 256;
+
+        if (!(pRealloc = realloc(list->entries, list->capacity * sizeof(drsBuildEntry_t)))) {
+            return 4;
+        }
+
+        list->entries = pRealloc;
+    }
+
+    entry = &list->entries[list->count];
+
+    if (drs_parse_file_name(name, &entry->id, entry->extension)) {
+        fprintf(stderr, "Skipping %s, expected <id>.<ext>\n", name);
+        return 0;
+    }
+
+    if (!list->extended && size > INT_MAX) {
+        fprintf(stderr, "File %s is too large for a classic DRS archive, try --extended\n", name);
+        return 5;
+    }
+
+    entry->size = size;
+    entry->hash = 0;
+    entry->failed = 0;
+
+    if (!(entry->name = malloc(strlen(name) + 1))) {
+        return 4;
+    }
+
+    strcpy(entry->name, name);
+    ++list->count;
+    return 0;
+}
+
+/* Tables by extension, files by ID; readdir order never leaks into the archive */
+static int drs_build_compare(const void* a, const void* b) {
+    const drsBuildEntry_t *lhs = a;
+    const drsBuildEntry_t *rhs = b;
+    int rc;
+
+    if ((rc = strcmp(lhs->extension, rhs->extension))) {
+        return rc;
+    }
+
+    if (lhs->id != rhs->id) {
+        return lhs->id < rhs->id ? -1 : 1;
+    }
+
+    return strcmp(lhs->name, rhs->name);
+}
+
+static void drs_build_list_free(pDrsBuildList_t list) {
+    size_t i;
+
+    for (i = 0; i < list->count; ++i) {
+        free(list->entries[i].name);
+    }
+
+    free(list->entries);
+    list->entries = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
+
+/* Metadata-only pass: tables, file headers and offsets, no payloads */
+static int drs_build_headers(pDrsBuildList_t list, drs_t* drs) {
+    size_t i;
+    size_t offset;
+    size_t limit;
+    size_t *offsets = NULL;
+    int table = -1;
+    int file = 0;
+
+    drs_init_empty(drs);
+    drs_set_copyright(drs, DRS_DEFAULT_COPYRIGHT);
+    drs_set_extended(drs, list->extended);
+    strcpy(drs->header.type, DRS_DEFAULT_TYPE);
+
+    for (i = 0; i < list->count; ++i) {
+        if (!i || strcmp(list->entries[i].extension, list->entries[i - 1].extension)) {
+            ++drs->header.tableCount;
+        }
+    }
+
+    if (drs->header.tableCount &&
+        !(drs->tables = calloc(drs->header.tableCount, sizeof(drsTable_t)))) {
+        return 4;
+    }
+
+    for (i = 0; i < list->count; ++i) {
+        if (!i || strcmp(list->entries[i].extension, list->entries[i - 1].extension)) {
+            ++table;
+            memcpy(drs->tables[table].header.extension, list->entries[i].extension,
+                DRS_TABLE_HDR_EXT_LENGTH+1);
+            drs->tables[table].header.fileType = drs_file_type(list->entries[i].extension);
+        }
+
+        ++drs->tables[table].header.fileCount;
+    }
+
+    for (table = 0; table < drs->header.tableCount; ++table) {
+        if (!(drs->tables[table].files = calloc(drs->tables[table].header.fileCount, sizeof(drsFile_t)))) {
+            return 4;
+        }
+    }
+
+    table = 0;
+    for (i = 0; i < list->count; ++i, ++file) {
+        if (file == drs->tables[table].header.fileCount) {
+            ++table;
+            file = 0;
+        }
+
+        drs->tables[table].files[file].id = list->entries[i].id;
+        drs->tables[table].files[file].size = list->entries[i].size;
+    }
+
+    if (drs_layout_headers(drs)) {
+        return 5;
+    }
+
+    /* Payloads follow the header region in header order, shared ones once */
+    if (!(offsets = malloc((list->count ? list->count : 1) * sizeof(size_t)))) {
+        return 4;
+    }
+
+    offset = drs->header.offset;
+    limit = drs_offset_limit(drs);
+    table = 0;
+    file = 0;
+
+    for (i = 0; i < list->count; ++i, ++file) {
+        if (file == drs->tables[table].header.fileCount) {
+            ++table;
+            file = 0;
+        }
+
+        if (list->entries[i].leader != i) {
+            offsets[i] = offsets[list->entries[i].leader];
+        } else {
+            if (list->entries[i].size > limit - offset) {
+                free(offsets);
+                return 5;
+            }
+
+            offsets[i] = offset;
+            offset += list->entries[i].size;
+        }
+
+        drs->tables[table].files[file].offset = offsets[i];
+    }
+
+    free(offsets);
+    drs->fileSize = offset;
+    return 0;
+}
+
+/* Streams a source file through the hasher, one bounded chunk at a time */
+static void drs_build_hash_worker(size_t item, void* userData) {
+    pDrsBuildList_t list = userData;
+    pDrsBuildEntry_t entry = &list->entries[item];
+    unsigned char *buffer = NULL;
+    char *path = NULL;
+    hashState_t state;
+    size_t size;
+    size_t done = 0;
+    size_t chunk = entry->size < FM_COPY_BUFFER_SIZE ? entry->size : FM_COPY_BUFFER_SIZE;
+    int fd;
+
+    if (!entry->size) {
+        return;
+    }
+
+    if (!(path = drs_build_path(list->dir, entry->name)) || !(buffer = malloc(chunk))) {
+        free(path);
+        entry->failed = 1;
+        return;
+    }
+
+    if ((fd = file_open_readonly(path, &size)) == -1 || size != entry->size) {
+        entry->failed = 1;
+    } else {
+        hash_init(&state, 0);
+
+        while (done < size && !entry->failed) {
+            if (chunk > size - done) {
+                chunk = size - done;
+            }
+
+            if (file_read_at(fd, buffer, chunk, done)) {
+                entry->failed = 1;
+            } else {
+                hash_update(&state, buffer, chunk);
+                done += chunk;
+            }
+        }
+
+        entry->hash = hash_final(&state);
+    }
+
+    if (fd != -1) {
+        file_close_descriptor(fd);
+    }
+
+    free(buffer);
+    free(path);
+}
+
+/* 0 when both files hold the same bytes, 1 when they differ, -1 on error */
+static int drs_build_compare_files(pDrsBuildList_t list, size_t a, size_t b) {
+    unsigned char *buffers = NULL;
+    char *pathA = drs_build_path(list->dir, list->entries[a].name);
+    char *pathB = drs_build_path(list->dir, list->entries[b].name);
+    size_t size = list->entries[a].size;
+    size_t sizeA;
+    size_t sizeB;
+    size_t done = 0;
+    size_t chunk = size < FM_COPY_BUFFER_SIZE ? size : FM_COPY_BUFFER_SIZE;
+    int fdA = -1;
+    int fdB = -1;
+    int rc = 0;
+
+    if (!pathA || !pathB || !(buffers = malloc(chunk * 2))) {
+        rc = -1;
+    } else if ((fdA = file_open_readonly(pathA, &sizeA)) == -1 ||
+        (fdB = file_open_readonly(pathB, &sizeB)) == -1) {
+        rc = -1;
+    } else if (sizeA != size || sizeB != size) {
+        rc = 1;
+    }
+
+    while (!rc && done < size) {
+        if (chunk > size - done) {
+            chunk = size - done;
+        }
+
+        if (file_read_at(fdA, buffers, chunk, done) || file_read_at(fdB, buffers + chunk, chunk, done)) {
+            rc = -1;
+        } else if (memcmp(buffers, buffers + chunk, chunk)) {
+            rc = 1;
+        }
+
+        done += chunk;
+    }
+
+    if (fdA != -1) {
+        file_close_descriptor(fdA);
+    }
+
+    if (fdB != -1) {
+        file_close_descriptor(fdB);
+    }
+
+    free(buffers);
+    free(pathA);
+    free(pathB);
+    return rc;
+}
+
+/* Candidate duplicates group by size and hash, earliest in the archive first */
+static int drs_build_compare_content(const void* a, const void* b) {
+    const drsBuildEntry_t *lhs = *(const drsBuildEntry_t* const*)a;
+    const drsBuildEntry_t *rhs = *(const drsBuildEntry_t* const*)b;
+
+    if (lhs->size != rhs->size) {
+        return lhs->size < rhs->size ? -1 : 1;
+    }
+
+    if (lhs->hash != rhs->hash) {
+        return lhs->hash < rhs->hash ? -1 : 1;
+    }
+
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+/**
+ * Hashes every source file, then points each one at the earliest file with
+ * identical bytes. Hashes only pick candidates, a full compare decides.
+ **/
+static int drs_build_dedup(pDrsBuildList_t list, int jobs, size_t* saved) {
+    size_t i;
+    size_t ii;
+    size_t start;
+    size_t leader;
+    int rc = 0;
+    pDrsBuildEntry_t *byContent = NULL;
+
+    if (!list->count) {
+        return 0;
+    }
+
+    if (!(byContent = malloc(list->count * sizeof(pDrsBuildEntry_t)))) {
+        return 4;
+    }
+
+    threadpool_run(list->count, jobs, drs_build_hash_worker, list);
+
+    for (i = 0; i < list->count; ++i) {
+        if (list->entries[i].failed) {
+            fprintf(stderr, "Failed to read %s\n", list->entries[i].name);
+            free(byContent);
+            return 8;
+        }
+
+        byContent[i] = &list->entries[i];
+    }
+
+    qsort(byContent, list->count, sizeof(pDrsBuildEntry_t), drs_build_compare_content);
+
+    for (start = 0, i = 1; i < list->count && !rc; ++i) {
+        if (!byContent[i]->size || byContent[i]->size != byContent[start]->size ||
+            byContent[i]->hash != byContent[start]->hash) {
+            start = i;
+            continue;
+        }
+
+        for (ii = start; ii < i; ++ii) {
+            leader = byContent[ii] - list->entries;
+
+            if (byContent[ii]->leader != leader) {
+                continue;
+            }
+
+            if ((rc = drs_build_compare_files(list, leader, byContent[i] - list->entries)) == -1) {
+                fprintf(stderr, "Failed to compare %s\n", byContent[i]->name);
+                rc = 8;
+                break;
+            }
+
+            if (!rc) {
+                byContent[i]->leader = leader;
+                *saved += byContent[i]->size;
+                break;
+            }
+
+            rc = 0;
+        }
+    }
+
+    free(byContent);
+    return rc;
+}
+
+/* Second pass: stream every stored payload into place through the kernel */
+static int drs_build_payloads(pDrsBuildList_t list, int outFd) {
+    size_t i;
+    size_t size;
+    int inFd;
+    int rc = 0;
+    char *path = NULL;
+
+    for (i = 0; i < list->count && !rc; ++i) {
+        if (list->entries[i].leader != i) {
+            continue;
+        }
+
+        if (!(path = drs_build_path(list->dir, list->entries[i].name))) {
+            return 4;
+        }
+
+        if ((inFd = file_open_readonly(path, &size)) == -1) {
+            fprintf(stderr, "Failed to open %s\n", path);
+            rc = 8;
+        } else {
+            if (size != list->entries[i].size) {
+                fprintf(stderr, "File %s changed size during the build\n", path);
+                rc = 8;
+            } else if (file_copy_range(inFd, 0, outFd, size)) {
+                fprintf(stderr, "Failed to copy %s\n", path);
+                rc = 7;
+            }
+
+            file_close_descriptor(inFd);
+        }
+
+        free(path);
+    }
+
+    return rc;
+}
+
+int drs_create_from_directory(const char* dir, const char* output,
+    const drsCreateOptions_t* options, drsCreateStats_t* stats) {
+    drs_t drs;
+    drsBuildList_t list;
+    unsigned char *headers = NULL;
+    size_t headerSize;
+    size_t i;
+    size_t saved = 0;
+    int outFd;
+    int rc;
+
+    if (!dir || !output) {
+        return 1;
+    }
+
+    memset(&list, 0, sizeof(list));
+    list.dir = dir;
+    list.extended = options && options->extended;
+
+    if ((rc = directory_scan(dir, drs_build_collect, &list))) {
+        drs_build_list_free(&list);
+        return rc == 1 ? 2 : rc;
+    }
+
+    if (list.count) {
+        qsort(list.entries, list.count, sizeof(drsBuildEntry_t), drs_build_compare);
+    }
+
+    for (i = 0; i < list.count; ++i) {
+        list.entries[i].leader = i;
+    }
+
+    if (options && options->dedup && (rc = drs_build_dedup(&list, options->jobs, &saved))) {
+        drs_build_list_free(&list);
+        return rc;
+    }
+
+    if ((rc = drs_build_headers(&list, &drs))) {
+        if (rc == 5) {
+            fprintf(stderr, "Files in %s do not fit in a DRS archive\n", dir);
+        }
+
+        drs_free(&drs);
+        drs_build_list_free(&list);
+        return rc;
+    }
+
+    headerSize = drs_header_size(&drs);
+
+    if (stats) {
+        stats->size = drs.fileSize;
+        stats->deduplicated = saved;
+    }
+
+    if (!(headers = malloc(headerSize))) {
+        drs_free(&drs);
+        drs_build_list_free(&list);
+        return 4;
+    }
+
+    drs_encode_headers(&drs, headers);
+    drs_free(&drs);
+
+    if ((outFd = file_create(output)) == -1) {
+        fprintf(stderr, "Failed to create DRS file %s\n", output);
+        free(headers);
+        drs_build_list_free(&list);
+        return 6;
+    }
+
+    STATS_BEGIN(STATS_PHASE_WRITE);
+
+    if (file_write_all(outFd, headers, headerSize)) {
+        rc = 7;
+    } else {
+        rc = drs_build_payloads(&list, outFd);
+    }
+
+    STATS_END(STATS_PHASE_WRITE);
+
+    if (file_close_descriptor(outFd) && !rc) {
+        rc = 7;
+    }
+
+    free(headers);
+    drs_build_list_free(&list);
+    return rc;
+}
@@ -0,0 +1,194 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "DRSFormat.h"
+
+/**
+ * Header codec. Archives store every integer as a little-endian 32-bit
+ * word, so the host byte order is settled at compile time: little-endian
+ * builds decode with plain copies, big-endian builds swap whole runs of
+ * words in one tight loop the compiler can vectorise.
+ *
+ * File records are handled DRS_CODEC_RUN at a time: one block copy into
+ * an aligned word array, the swap where needed, then the scatter into
+ * drsFile_t. The array stays in L1, so a run costs little more than the
+ * copy itself. Extended records are five words, 64-bit fields low word
+ * first.
+ **/
+
+#define DRS_CODEC_RUN 256                        // File records per block copy
+#define DRS_CODEC_WORDS 5                        // Largest record, in 32-bit words
+
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define DRS_CODEC_BIG_ENDIAN
+#endif
+
+#ifdef DRS_CODEC_BIG_ENDIAN
+#if defined(__GNUC__) || defined(__clang__)
+#define DRS_CODEC_BSWAP32(x) __builtin_bswap32(x)
+#else
+#define DRS_CODEC_BSWAP32(x) ((((x) & 0xFFu) << 24) | (((x) & 0xFF00u) << 8) | \
+                              (((x) >> 8) & 0xFF00u) | ((x) >> 24))
+#endif
+
+static void drs_codec_swap(unsigned int* words, size_t count) {
+    size_t i;
+
+    for (i = 0; i < count; ++i) {
+        words[i] = DRS_CODEC_BSWAP32(words[i]);
+    }
+}
+#else
+#define drs_codec_swap(words, count) ((void)0)
+#endif
+
+int drs_codec_get32(const unsigned char* in) {
+    unsigned int word;
+
+    memcpy(&word, in, sizeof(word));
+    drs_codec_swap(&word, 1);
+    return (int)word;
+}
+
+void drs_codec_put32(unsigned char* out, int value) {
+    unsigned int word = (unsigned int)value;
+
+    drs_codec_swap(&word, 1);
+    memcpy(out, &word, sizeof(word));
+}
+
+unsigned long long drs_codec_get64(const unsigned char* in) {
+    return (unsigned int)drs_codec_get32(in) |
+        (unsigned long long)(unsigned int)drs_codec_get32(&in[4]) << 32;
+}
+
+void drs_codec_put64(unsigned char* out, unsigned long long value) {
+    drs_codec_put32(out, (int)(unsigned int)value);
+    drs_codec_put32(&out[4], (int)(unsigned int)(value >> 32));
+}
+
+/* 64-bit fields only fit when size_t is 64-bit */
+static int drs_codec_narrow(unsigned int low, unsigned int high, size_t* value) {
+#if SIZE_MAX > 0xFFFFFFFFu
+    *value = (size_t)low | (size_t)high << 32;
+    return 0;
+#else
+    *value = low;
+    return high != 0;
+#endif
+}
+
+static void drs_codec_widen(size_t value, unsigned int* low, unsigned int* high) {
+    *low = (unsigned int)value;
+#if SIZE_MAX > 0xFFFFFFFFu
+    *high = (unsigned int)(value >> 32);
+#else
+    *high = 0;
+#endif
+}
+
+/* Type, reversed extension, offset and file count. Non-zero if the offset does not fit */
+int drs_codec_decode_table(const unsigned char* in, drsTableHeader_t* header, int extended) {
+    header->fileType = (char)in[0];
+    header->extension[0] = (char)in[3];
+    header->extension[1] = (char)in[2];
+    header->extension[2] = (char)in[1];
+    header->extension[3] = '\0';
+
+    if (!extended) {
+        header->offset = (unsigned int)drs_codec_get32(&in[4]);
+        header->fileCount = drs_codec_get32(&in[8]);
+        return 0;
+    }
+
+    header->fileCount = drs_codec_get32(&in[12]);
+    return drs_codec_narrow((unsigned int)drs_codec_get32(&in[4]),
+                            (unsigned int)drs_codec_get32(&in[8]), &header->offset);
+}
+
+void drs_codec_encode_table(const drsTableHeader_t* header, unsigned char* out, int extended) {
+    unsigned int words[2];
+
+    out[0] = (unsigned char)header->fileType;
+    out[1] = (unsigned char)header->extension[2];
+    out[2] = (unsigned char)header->extension[1];
+    out[3] = (unsigned char)header->extension[0];
+
+    if (!extended) {
+        drs_codec_put32(&out[4], (int)header->offset);
+        drs_codec_put32(&out[8], header->fileCount);
+        return;
+    }
+
+    drs_codec_widen(header->offset, &words[0], &words[1]);
+    drs_codec_put32(&out[4], (int)words[0]);
+    drs_codec_put32(&out[8], (int)words[1]);
+    drs_codec_put32(&out[12], header->fileCount);
+}
+
+/**
+ * count records of id, offset and size; data is cleared. Classic offsets
+ * and sizes are signed on disk, negative ones come back above INT_MAX for
+ * the caller's range checks. Non-zero if an extended field does not fit.
+ **/
+int drs_codec_decode_files(const unsigned char* in, drsFile_t* files, size_t count, int extended) {
+    unsigned int words[DRS_CODEC_RUN * DRS_CODEC_WORDS];
+    size_t recordSize = extended ? DRS_EXT_FILE_HDR_SIZE : DRS_FILE_HDR_SIZE;
+    size_t run;
+    size_t i;
+    int rc = 0;
+
+    for (; count; count -= run, files += run, in += run * recordSize) {
+        run = count < DRS_CODEC_RUN ? count : DRS_CODEC_RUN;
+        memcpy(words, in, run * recordSize);
+        drs_codec_swap(words, run * recordSize / 4);
+
+        if (!extended) {
+            for (i = 0; i < run; ++i) {
+                files[i].id = (int)words[i * 3];
+                files[i].offset = words[i * 3 + 1];
+                files[i].size = words[i * 3 + 2];
+                files[i].data = NULL;
+            }
+
+            continue;
+        }
+
+        for (i = 0; i < run; ++i) {
+            files[i].id = (int)words[i * 5];
+            rc |= drs_codec_narrow(words[i * 5 + 1], words[i * 5 + 2], &files[i].offset);
+            rc |= drs_codec_narrow(words[i * 5 + 3], words[i * 5 + 4], &files[i].size);
+            files[i].data = NULL;
+        }
+    }
+
+    return rc;
+}
+
+void drs_codec_encode_files(const drsFile_t* files, size_t count, unsigned char* out, int extended) {
+    unsigned int words[DRS_CODEC_RUN * DRS_CODEC_WORDS];
+    size_t recordSize = extended ? DRS_EXT_FILE_HDR_SIZE : DRS_FILE_HDR_SIZE;
+    size_t run;
+    size_t i;
+
+    for (; count; count -= run, files += run, out += run * recordSize) {
+        run = count < DRS_CODEC_RUN ? count : DRS_CODEC_RUN;
+
+        if (!extended) {
+            for (i = 0; i < run; ++i) {
+                words[i * 3] = (unsigned int)files[i].id;
+                words[i * 3 + 1] = (unsigned int)files[i].offset;
+                words[i * 3 + 2] = (unsigned int)files[i].size;
+            }
+        } else {
+            for (i = 0; i < run; ++i) {
+                words[i * 5] = (unsigned int)files[i].id;
+                drs_codec_widen(files[i].offset, &words[i * 5 + 1], &words[i * 5 + 2]);
+                drs_codec_widen(files[i].size, &words[i * 5 + 3], &words[i * 5 + 4]);
+            }
+        }
+
+        drs_codec_swap(words, run * recordSize / 4);
+        memcpy(out, words, run * recordSize);
+    }
+}
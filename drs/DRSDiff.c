@@ -0,0 +1,749 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "FileManager.h"
+#include "Hash.h"
+#include "Stats.h"
+#include "DRSFormat.h"
+
+#define DRS_PATCH_MAGIC       "DRSP"
+#define DRS_PATCH_VERSION     2
+#define DRS_PATCH_BUFFER_SIZE (256 * 1024)
+#define DRS_DELTA_BLOCK       16                 // Shortest match worth a copy
+#define DRS_DELTA_MIN_SIZE    64                 // Smaller payloads are always sent whole
+
+#define DRS_PATCH_REMOVE      0
+#define DRS_PATCH_PUT         1
+#define DRS_PATCH_DELTA       2
+#define DRS_PATCH_REPLACE     3
+
+/**
+ * Patch, every integer a little-endian 32-bit word:
+ *
+ * [magic "DRSP"] [version] [recordCount]
+ * [recordCount x: op, extension (3 bytes + NUL), id, body]
+ *
+ * remove:  no body
+ * put:     [size] [hash lo, hi] [payload]
+ * replace: [baseSize] [baseHash lo, hi] [size] [hash lo, hi] [payload]
+ * delta:   [baseSize] [baseHash lo, hi] [size] [hash lo, hi] [deltaSize] [delta]
+ *
+ * Removals name an entry the archive has, puts one it does not have yet.
+ * Replacements and deltas carry the size and hash of the entry they expect
+ * to change.
+ *
+ * A delta is a run of commands, each a varint n followed by n bytes to take
+ * as they are when n is even (n/2 bytes), or a varint offset into the base
+ * payload to copy (n-1)/2 bytes from when n is odd.
+ **/
+
+typedef struct s_drsPatchWriter {
+    int          fd;
+    unsigned char* buffer;
+    size_t       used;
+    size_t       total;
+    int          rc;                             // First write error, sticky
+} drsPatchWriter_t, *pDrsPatchWriter_t;
+
+typedef struct s_drsDelta {
+    unsigned char* data;
+    size_t       size;
+    size_t       capacity;
+    int*         blocks;                         // Base offset + 1 by block hash, 0 for none
+    size_t       blockCapacity;
+} drsDelta_t, *pDrsDelta_t;
+
+static void drs_patch_flush(pDrsPatchWriter_t writer) {
+    if (!writer->rc && writer->used && file_write_all(writer->fd, writer->buffer, writer->used)) {
+        writer->rc = 7;
+    }
+
+    writer->used = 0;
+}
+
+static void drs_patch_put(pDrsPatchWriter_t writer, const unsigned char* data, size_t size) {
+    writer->total += size;
+
+    if (writer->used + size > DRS_PATCH_BUFFER_SIZE) {
+        drs_patch_flush(writer);
+    }
+
+    /* Whole payloads skip the buffer */
+    if (size > DRS_PATCH_BUFFER_SIZE / 2) {
+        if (!writer->rc && file_write_all(writer->fd, data, size)) {
+            writer->rc = 7;
+        }
+
+        return;
+    }
+
+    memcpy(&writer->buffer[writer->used], data, size);
+    writer->used += size;
+}
+
+static void drs_patch_put_word(pDrsPatchWriter_t writer, unsigned int word) {
+    unsigned char out[4];
+
+    out[0] = (unsigned char)(word & 0xFF);
+    out[1] = (unsigned char)((word >> 8) & 0xFF);
+    out[2] = (unsigned char)((word >> 16) & 0xFF);
+    out[3] = (unsigned char)((word >> 24) & 0xFF);
+    drs_patch_put(writer, out, 4);
+}
+
+static void drs_patch_put_hash(pDrsPatchWriter_t writer, hash64_t hash) {
+    drs_patch_put_word(writer, (unsigned int)(hash & 0xFFFFFFFFu));
+    drs_patch_put_word(writer, (unsigned int)(hash >> 32));
+}
+
+static void drs_patch_put_entry(pDrsPatchWriter_t writer, int op, const char* extension, int id) {
+    char name[DRS_TABLE_HDR_EXT_LENGTH+1];
+
+    memset(name, 0, sizeof(name));
+    memcpy(name, extension, DRS_TABLE_HDR_EXT_LENGTH);
+    drs_patch_put_word(writer, (unsigned int)op);
+    drs_patch_put(writer, (const unsigned char*)name, sizeof(name));
+    drs_patch_put_word(writer, (unsigned int)id);
+}
+
+/*********************
+*  Delta encoding   *
+**********************/
+
+/* Room for size more bytes */
+static int drs_delta_reserve(pDrsDelta_t delta, size_t size) {
+    unsigned char *pRealloc = NULL;
+    size_t capacity = delta->capacity ? delta->capacity : 256;
+
+    while (capacity - delta->size < size) {
+        capacity *= 2;
+    }
+
+    if (capacity != delta->capacity) {
+        if (!(pRealloc = realloc(delta->data, capacity))) {
+            return 4;
+        }
+
+        delta->data = pRealloc;
+        delta->capacity = capacity;
+    }
+
+    return 0;
+}
+
+static void drs_delta_put_varint(pDrsDelta_t delta, size_t value) {
+    while (value >= 0x80) {
+        delta->data[delta->size++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+
+    delta->data[delta->size++] = (unsigned char)value;
+}
+
+static int drs_delta_literal(pDrsDelta_t delta, const unsigned char* data, size_t size) {
+    if (!size) {
+        return 0;
+    }
+
+    if (drs_delta_reserve(delta, size + 10)) {
+        return 4;
+    }
+
+    drs_delta_put_varint(delta, size << 1);
+    memcpy(&delta->data[delta->size], data, size);
+    delta->size += size;
+    return 0;
+}
+
+static int drs_delta_copy(pDrsDelta_t delta, size_t offset, size_t size) {
+    if (drs_delta_reserve(delta, 20)) {
+        return 4;
+    }
+
+    drs_delta_put_varint(delta, (size << 1) | 1);
+    drs_delta_put_varint(delta, offset);
+    return 0;
+}
+
+static size_t drs_delta_hash(const unsigned char* data, size_t mask) {
+    unsigned long long a;
+    unsigned long long b;
+
+    memcpy(&a, data, 8);
+    memcpy(&b, data + 8, 8);
+    return (size_t)(((a * 0x9E3779B185EBCA87ULL) ^ (b * 0xC2B2AE3D27D4EB4FULL)) >> 32) & mask;
+}
+
+/**
+ * Greedy block matching: the base is indexed at every DRS_DELTA_BLOCK
+ * boundary, the target is probed at every byte. A hit is grown in both
+ * directions, so shifted data still comes out as one long copy.
+ **/
+static int drs_delta_encode(pDrsDelta_t delta, const unsigned char* base, size_t baseSize,
+    const unsigned char* target, size_t targetSize) {
+    size_t slots = 16;
+    size_t mask;
+    size_t offset;
+    size_t position = 0;
+    size_t literal = 0;
+    size_t match;
+    size_t length;
+    int *pRealloc = NULL;
+
+    delta->size = 0;
+
+    while (slots < 2 * (baseSize / DRS_DELTA_BLOCK)) {
+        slots *= 2;
+    }
+
+    if (slots > delta->blockCapacity) {
+        if (!(pRealloc = realloc(delta->blocks, slots * sizeof(int)))) {
+            return 4;
+        }
+
+        delta->blocks = pRealloc;
+        delta->blockCapacity = slots;
+    }
+
+    mask = slots - 1;
+    memset(delta->blocks, 0, slots * sizeof(int));
+
+    /* Back to front so the earliest block keeps the slot */
+    for (offset = baseSize / DRS_DELTA_BLOCK * DRS_DELTA_BLOCK; offset >= DRS_DELTA_BLOCK; ) {
+        offset -= DRS_DELTA_BLOCK;
+        delta->blocks[drs_delta_hash(&base[offset], mask)] = (int)offset + 1;
+    }
+
+    while (position + DRS_DELTA_BLOCK <= targetSize) {
+        match = (size_t)delta->blocks[drs_delta_hash(&target[position], mask)];
+
+        if (!match-- || memcmp(&base[match], &target[position], DRS_DELTA_BLOCK)) {
+            ++position;
+            continue;
+        }
+
+        /* Backwards into the pending literal, then forwards as far as it goes */
+        while (position > literal && match && base[match-1] == target[position-1]) {
+            --position;
+            --match;
+        }
+
+        length = DRS_DELTA_BLOCK;
+
+        while (position + length < targetSize && match + length < baseSize &&
+            base[match+length] == target[position+length]) {
+            ++length;
+        }
+
+        if (drs_delta_literal(delta, &target[literal], position - literal) ||
+            drs_delta_copy(delta, match, length)) {
+            return 4;
+        }
+
+        position += length;
+        literal = position;
+    }
+
+    return drs_delta_literal(delta, &target[literal], targetSize - literal);
+}
+
+static int drs_delta_get_varint(const unsigned char* data, size_t size, size_t* at, size_t* value) {
+    int shift = 0;
+
+    *value = 0;
+
+    while (*at < size && shift < (int)(sizeof(size_t) * 8)) {
+        *value |= (size_t)(data[*at] & 0x7F) << shift;
+
+        if (!(data[(*at)++] & 0x80)) {
+            return 0;
+        }
+
+        shift += 7;
+    }
+
+    return 1;
+}
+
+/* Rebuild target from base, every command checked against both sizes */
+static int drs_delta_decode(const unsigned char* delta, size_t deltaSize, const unsigned char* base,
+    size_t baseSize, unsigned char* target, size_t targetSize) {
+    size_t at = 0;
+    size_t written = 0;
+    size_t command;
+    size_t length;
+    size_t offset;
+
+    while (at < deltaSize) {
+        if (drs_delta_get_varint(delta, deltaSize, &at, &command)) {
+            return 1;
+        }
+
+        length = command >> 1;
+
+        if (length > targetSize - written) {
+            return 1;
+        }
+
+        if (command & 1) {
+            if (drs_delta_get_varint(delta, deltaSize, &at, &offset) ||
+                offset > baseSize || length > baseSize - offset) {
+                return 1;
+            }
+
+            memcpy(&target[written], &base[offset], length);
+        } else {
+            if (length > deltaSize - at) {
+                return 1;
+            }
+
+            memcpy(&target[written], &delta[at], length);
+            at += length;
+        }
+
+        written += length;
+    }
+
+    return written != targetSize;
+}
+
+/*********************
+*  Diff             *
+**********************/
+
+/* Payloads in memory, and no larger than the patch's 32-bit size fields */
+static int drs_diff_writable(drs_t* drs) {
+    int i;
+    int ii;
+
+    for (i = 0; i < drs->header.tableCount; ++i) {
+        for (ii = 0; ii < drs->tables[i].header.fileCount; ++ii) {
+            if (!drs->tables[i].files[ii].data && drs->tables[i].files[ii].size) {
+                return 0;
+            }
+
+            if (drs->tables[i].files[ii].size > INT_MAX) {
+                fprintf(stderr, "File %d.%s is too large for a patch\n",
+                        drs->tables[i].files[ii].id, drs->tables[i].header.extension);
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+static int drs_diff_entry(pDrsPatchWriter_t writer, pDrsDelta_t delta, const drsFile_t* from,
+    const drsFile_t* to, const char* extension, drsDiffStats_t* stats) {
+    if (from && from->size == to->size && (!to->size || !memcmp(from->data, to->data, to->size))) {
+        ++stats->unchanged;
+        return 0;
+    }
+
+    stats->payloadBytes += to->size;
+
+    if (from && to->size >= DRS_DELTA_MIN_SIZE && from->size >= DRS_DELTA_BLOCK) {
+        if (drs_delta_encode(delta, from->data, from->size, to->data, to->size)) {
+            return 4;
+        }
+
+        /* Only worth it when it beats the payload by more than its own header */
+        if (delta->size + 24 < to->size) {
+            drs_patch_put_entry(writer, DRS_PATCH_DELTA, extension, to->id);
+            drs_patch_put_word(writer, (unsigned int)from->size);
+            drs_patch_put_hash(writer, hash_xxh64(from->data, from->size, 0));
+            drs_patch_put_word(writer, (unsigned int)to->size);
+            drs_patch_put_hash(writer, hash_xxh64(to->data, to->size, 0));
+            drs_patch_put_word(writer, (unsigned int)delta->size);
+            drs_patch_put(writer, delta->data, delta->size);
+            ++stats->changed;
+            return 0;
+        }
+    }
+
+    drs_patch_put_entry(writer, from ? DRS_PATCH_REPLACE : DRS_PATCH_PUT, extension, to->id);
+
+    if (from) {
+        drs_patch_put_word(writer, (unsigned int)from->size);
+        drs_patch_put_hash(writer, hash_xxh64(from->data, from->size, 0));
+    }
+
+    drs_patch_put_word(writer, (unsigned int)to->size);
+    drs_patch_put_hash(writer, hash_xxh64(to->data, to->size, 0));
+    drs_patch_put(writer, to->data, to->size);
+
+    if (from) {
+        ++stats->changed;
+    } else {
+        ++stats->added;
+    }
+
+    return 0;
+}
+
+/**
+ * Patch that turns from into to. Entries pair up by extension and ID, so
+ * both archives need payloads in memory (drs_load or drs_open_mapped) and
+ * no repeated ID+extension pairs.
+ **/
+int drs_diff(drs_t* from, drs_t* to, const char* patchPath, drsDiffStats_t* stats) {
+    drsPatchWriter_t writer;
+    drsDelta_t delta;
+    drsFile_t *file = NULL;
+    drsTable_t *table = NULL;
+    int records = 0;
+    int i;
+    int ii;
+    int pass;
+    int rc = 0;
+
+    if (!from || !to || !patchPath || !stats || !from->index.entries || !to->index.entries) {
+        return 1;
+    }
+
+    if (from->index.duplicates || to->index.duplicates) {
+        fprintf(stderr, "Archives with repeated ID+extension pairs cannot be diffed\n");
+        return 1;
+    }
+
+    if (!drs_diff_writable(from) || !drs_diff_writable(to)) {
+        return 1;
+    }
+
+    memset(stats, 0, sizeof(drsDiffStats_t));
+    memset(&delta, 0, sizeof(delta));
+
+    /* First pass counts the records, the second writes them */
+    for (i = 0; i < from->header.tableCount; ++i) {
+        for (ii = 0; ii < from->tables[i].header.fileCount; ++ii) {
+            file = &from->tables[i].files[ii];
+            records += !drs_find(to, file->id, from->tables[i].header.extension, NULL);
+        }
+    }
+
+    for (i = 0; i < to->header.tableCount; ++i) {
+        for (ii = 0; ii < to->tables[i].header.fileCount; ++ii) {
+            file = drs_find(from, to->tables[i].files[ii].id, to->tables[i].header.extension, NULL);
+            records += !file || file->size != to->tables[i].files[ii].size ||
+                (file->size && memcmp(file->data, to->tables[i].files[ii].data, file->size));
+        }
+    }
+
+    writer.used = 0;
+    writer.total = 0;
+    writer.rc = 0;
+
+    if (!(writer.buffer = malloc(DRS_PATCH_BUFFER_SIZE))) {
+        return 4;
+    }
+
+    if ((writer.fd = file_create(patchPath)) == -1) {
+        fprintf(stderr, "Failed to create %s\n", patchPath);
+        free(writer.buffer);
+        return 6;
+    }
+
+    STATS_BEGIN(STATS_PHASE_WRITE);
+
+    drs_patch_put(&writer, (const unsigned char*)DRS_PATCH_MAGIC, 4);
+    drs_patch_put_word(&writer, DRS_PATCH_VERSION);
+    drs_patch_put_word(&writer, (unsigned int)records);
+
+    /* Removals first, so a put never lands on an entry about to go */
+    for (pass = 0; pass < 2 && !rc && !writer.rc; ++pass) {
+        for (i = 0; i < (pass ? to : from)->header.tableCount && !rc; ++i) {
+            table = &(pass ? to : from)->tables[i];
+
+            for (ii = 0; ii < table->header.fileCount && !rc; ++ii) {
+                file = drs_find(pass ? from : to, table->files[ii].id, table->header.extension, NULL);
+
+                if (pass) {
+                    rc = drs_diff_entry(&writer, &delta, file, &table->files[ii], table->header.extension, stats);
+                } else if (!file) {
+                    drs_patch_put_entry(&writer, DRS_PATCH_REMOVE, table->header.extension, table->files[ii].id);
+                    ++stats->removed;
+                }
+            }
+        }
+    }
+
+    drs_patch_flush(&writer);
+
+    STATS_END(STATS_PHASE_WRITE);
+
+    if (!rc) {
+        rc = writer.rc;
+    }
+
+    if (file_close_descriptor(writer.fd) && !rc) {
+        rc = 7;
+    }
+
+    stats->patchSize = writer.total;
+    free(writer.buffer);
+    free(delta.data);
+    free(delta.blocks);
+    return rc;
+}
+
+/*********************
+*  Patch            *
+**********************/
+
+static int drs_patch_get_word(const unsigned char* data, size_t size, size_t* at, unsigned int* word) {
+    if (size - *at < 4) {
+        return 1;
+    }
+
+    *word = (unsigned int)data[*at] | ((unsigned int)data[*at+1] << 8) |
+        ((unsigned int)data[*at+2] << 16) | ((unsigned int)data[*at+3] << 24);
+    *at += 4;
+    return 0;
+}
+
+static int drs_patch_get_hash(const unsigned char* data, size_t size, size_t* at, hash64_t* hash) {
+    unsigned int low;
+    unsigned int high;
+
+    if (drs_patch_get_word(data, size, at, &low) || drs_patch_get_word(data, size, at, &high)) {
+        return 1;
+    }
+
+    *hash = ((hash64_t)high << 32) | low;
+    return 0;
+}
+
+/* Read the entry a replacement or delta expects and check it is the one the patch was made against */
+static int drs_patch_base(drs_t* drs, const drsChange_t* change, unsigned int baseSize, hash64_t baseHash,
+    unsigned char** base) {
+    drsTable_t *table = NULL;
+    drsFile_t *file = NULL;
+
+    *base = NULL;
+
+    if (!(file = drs_find(drs, change->id, change->extension, &table)) || file->size != baseSize) {
+        fprintf(stderr, "File %d.%s does not match the patch base\n", change->id, change->extension);
+        return 9;
+    }
+
+    if (!(*base = malloc(baseSize ? baseSize : 1))) {
+        return 4;
+    }
+
+    if (drs_read_entry(drs, (int)(table - drs->tables), (int)(file - table->files), *base)) {
+        return 6;
+    }
+
+    if (hash_xxh64(*base, baseSize, 0) != baseHash) {
+        fprintf(stderr, "File %d.%s does not match the patch base\n", change->id, change->extension);
+        return 9;
+    }
+
+    return 0;
+}
+
+/* Rebuild a changed payload against the entry currently in the archive */
+static int drs_patch_delta(drs_t* drs, const unsigned char* patch, size_t patchSize, size_t* at,
+    drsChange_t* change, unsigned char** target) {
+    unsigned int baseSize;
+    unsigned int size;
+    unsigned int deltaSize;
+    hash64_t baseHash;
+    hash64_t hash;
+    unsigned char *base = NULL;
+    int rc = 0;
+
+    if (drs_patch_get_word(patch, patchSize, at, &baseSize) ||
+        drs_patch_get_hash(patch, patchSize, at, &baseHash) ||
+        drs_patch_get_word(patch, patchSize, at, &size) ||
+        drs_patch_get_hash(patch, patchSize, at, &hash) ||
+        drs_patch_get_word(patch, patchSize, at, &deltaSize) ||
+        deltaSize > patchSize - *at || size > INT_MAX) {
+        return 3;
+    }
+
+    if ((rc = drs_patch_base(drs, change, baseSize, baseHash, &base))) {
+        free(base);
+        return rc;
+    }
+
+    if (!(*target = malloc(size ? size : 1))) {
+        rc = 4;
+    } else if (drs_delta_decode(&patch[*at], deltaSize, base, baseSize, *target, size) ||
+        hash_xxh64(*target, size, 0) != hash) {
+        fprintf(stderr, "Delta for %d.%s is corrupt\n", change->id, change->extension);
+        rc = 3;
+    }
+
+    free(base);
+    *at += deltaSize;
+    change->data = *target;
+    change->size = size;
+    return rc;
+}
+
+/* Whole new payload for an entry, checked against the base when it replaces one */
+static int drs_patch_payload(drs_t* drs, const unsigned char* patch, size_t patchSize, size_t* at,
+    drsChange_t* change, int replace) {
+    unsigned int baseSize;
+    unsigned int size;
+    hash64_t baseHash;
+    hash64_t hash;
+    unsigned char *base = NULL;
+    int rc;
+
+    if ((replace && (drs_patch_get_word(patch, patchSize, at, &baseSize) ||
+            drs_patch_get_hash(patch, patchSize, at, &baseHash))) ||
+        drs_patch_get_word(patch, patchSize, at, &size) ||
+        drs_patch_get_hash(patch, patchSize, at, &hash) || size > patchSize - *at ||
+        hash_xxh64(&patch[*at], size, 0) != hash) {
+        return 3;
+    }
+
+    if (replace) {
+        rc = drs_patch_base(drs, change, baseSize, baseHash, &base);
+        free(base);
+
+        if (rc) {
+            return rc;
+        }
+    } else if (drs_find(drs, change->id, change->extension, NULL)) {
+        fprintf(stderr, "File %d.%s is already in the archive\n", change->id, change->extension);
+        return 9;
+    }
+
+    change->data = &patch[*at];
+    change->size = size;
+    *at += size;
+    return 0;
+}
+
+static int drs_patch_read(drs_t* drs, const unsigned char* patch, size_t patchSize,
+    drsChange_t* changes, unsigned char** targets, unsigned int count, drsDiffStats_t* stats) {
+    unsigned int i;
+    unsigned int op;
+    unsigned int word;
+    size_t at = 12;
+    int rc;
+
+    for (i = 0; i < count; ++i) {
+        if (drs_patch_get_word(patch, patchSize, &at, &op) || patchSize - at < DRS_TABLE_HDR_EXT_LENGTH + 1) {
+            return 3;
+        }
+
+        memcpy(changes[i].extension, &patch[at], DRS_TABLE_HDR_EXT_LENGTH);
+        changes[i].extension[DRS_TABLE_HDR_EXT_LENGTH] = '\0';
+        at += DRS_TABLE_HDR_EXT_LENGTH + 1;
+
+        if (drs_patch_get_word(patch, patchSize, &at, &word)) {
+            return 3;
+        }
+
+        changes[i].id = (int)word;
+        changes[i].type = op == DRS_PATCH_REMOVE ? DRS_CHANGE_REMOVE : DRS_CHANGE_PUT;
+
+        if (op == DRS_PATCH_REMOVE) {
+            if (!drs_find(drs, changes[i].id, changes[i].extension, NULL)) {
+                fprintf(stderr, "File %d.%s is not in the archive, cannot remove it\n",
+                    changes[i].id, changes[i].extension);
+                return 9;
+            }
+
+            ++stats->removed;
+        } else if (op == DRS_PATCH_PUT || op == DRS_PATCH_REPLACE) {
+            if ((rc = drs_patch_payload(drs, patch, patchSize, &at, &changes[i], op == DRS_PATCH_REPLACE))) {
+                return rc;
+            }
+
+            stats->payloadBytes += changes[i].size;
+
+            if (op == DRS_PATCH_REPLACE) {
+                ++stats->changed;
+            } else {
+                ++stats->added;
+            }
+        } else if (op == DRS_PATCH_DELTA) {
+            if ((rc = drs_patch_delta(drs, patch, patchSize, &at, &changes[i], &targets[i]))) {
+                return rc;
+            }
+
+            stats->payloadBytes += changes[i].size;
+            ++stats->changed;
+        } else {
+            return 3;
+        }
+    }
+
+    return at == patchSize ? 0 : 3;
+}
+
+/**
+ * Apply a patch from drs_diff() in place. Every record is decoded and
+ * checked against the archive before anything is written, then the lot
+ * goes through drs_update_archive(): only changed payloads and the header
+ * region are rewritten.
+ **/
+int drs_patch(const char* archive, const char* patchPath, drsDiffStats_t* stats) {
+    drs_t drs;
+    unsigned char *patch = NULL;
+    size_t patchSize;
+    unsigned char **targets = NULL;
+    drsChange_t *changes = NULL;
+    unsigned int count = 0;
+    unsigned int version = 0;
+    unsigned int i;
+    size_t at = 4;
+    int rc;
+
+    if (!archive || !patchPath || !stats) {
+        return 1;
+    }
+
+    memset(stats, 0, sizeof(drsDiffStats_t));
+
+    if (file_map(patchPath, &patch, &patchSize)) {
+        fprintf(stderr, "Failed to open %s\n", patchPath);
+        return 6;
+    }
+
+    if (patchSize < 12 || memcmp(patch, DRS_PATCH_MAGIC, 4) ||
+        drs_patch_get_word(patch, patchSize, &at, &version) || version != DRS_PATCH_VERSION ||
+        drs_patch_get_word(patch, patchSize, &at, &count) || count > (patchSize - at) / 12) {
+        fprintf(stderr, "%s is not a DRS patch\n", patchPath);
+        file_unmap(patch, patchSize);
+        return 3;
+    }
+
+    if ((rc = drs_open_index(archive, &drs))) {
+        file_unmap(patch, patchSize);
+        return rc == 1 ? 2 : rc;
+    }
+
+    if (!(changes = calloc(count ? count : 1, sizeof(drsChange_t))) ||
+        !(targets = calloc(count ? count : 1, sizeof(unsigned char*)))) {
+        rc = 4;
+    } else if ((rc = drs_patch_read(&drs, patch, patchSize, changes, targets, count, stats)) == 3) {
+        fprintf(stderr, "%s is truncated or corrupt\n", patchPath);
+    }
+
+    /* The update reopens the archive for writing */
+    drs_free(&drs);
+
+    if (!rc) {
+        rc = drs_update_archive(archive, changes, count);
+    }
+
+    stats->patchSize = patchSize;
+
+    if (targets) {
+        for (i = 0; i < count; ++i) {
+            free(targets[i]);
+        }
+    }
+
+    free(targets);
+    free(changes);
+    file_unmap(patch, patchSize);
+    return rc;
+}
@@ -0,0 +1,530 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "FileManager.h"
+#include "ThreadPool.h"
+#include "Hash.h"
+#include "Stats.h"
+#include "DRSFormat.h"
+
+/* Longest "<id>_NNN.<ext>" plus terminator */
+#define DRS_EXTRACT_NAME_LENGTH 24
+#define DRS_EXTRACT_MAX_ATTEMPTS 1000
+/* Coalesced reads: bridge gaps up to a page, cap a run at 8 MiB unless one entry is larger */
+#define DRS_EXTRACT_COALESCE_GAP 4096
+#define DRS_EXTRACT_RUN_SIZE     (8 * 1024 * 1024)
+
+typedef struct s_drsExtractJob {
+    int          table;
+    int          file;
+    char*        fileName;                       // Relative to the output directory, NULL if skipped
+    int          selected;                       // Matches the filter
+    int          attempts;                       // Next alternate name suffix
+    struct s_drsExtractJob* leader;              // Owner of the suffix counter for this ID and extension
+    int          rc;                             // 0 on success
+} drsExtractJob_t, *pDrsExtractJob_t;
+
+/* Names handed out during this extraction, so collisions are settled without asking the disk */
+typedef struct s_drsExtractNames {
+    const char** slots;                          // Open addressing, power of two capacity
+    size_t       capacity;
+    size_t       count;
+    char**       extra;                          // Alternates picked while writing
+    size_t       extraCount;
+    size_t       extraCapacity;
+    tpMutex_t    lock;                           // Taken by workers only
+} drsExtractNames_t, *pDrsExtractNames_t;
+
+typedef struct s_drsExtractRead {
+    size_t       offset;                         // Payload offset in the archive
+    pDrsExtractJob_t job;
+} drsExtractRead_t, *pDrsExtractRead_t;
+
+typedef struct s_drsExtractRun {
+    size_t       offset;
+    size_t       size;
+    int          first;                          // Position in the offset-sorted job order
+    int          count;
+} drsExtractRun_t, *pDrsExtractRun_t;
+
+typedef struct s_drsExtractContext {
+    drs_t*            drs;
+    const char*       dirName;
+    int               dirFd;                     // -1 where files are created by path
+    drsExtractNames_t names;
+    pDrsExtractJob_t  jobs;
+    pDrsExtractRead_t reads;                     // Selected entries by offset, coalesced reads only
+    pDrsExtractRun_t  runs;
+} drsExtractContext_t, *pDrsExtractContext_t;
+
+static const char** drs_extract_names_slot(pDrsExtractNames_t names, const char* name) {
+    size_t mask = names->capacity - 1;
+    size_t i = (size_t)hash_xxh64(name, strlen(name), 0) & mask;
+
+    while (names->slots[i] && strcmp(names->slots[i], name)) {
+        i = (i + 1) & mask;
+    }
+
+    return &names->slots[i];
+}
+
+/* 0 if the name was free and is now taken, 1 if it was taken already */
+static int drs_extract_names_add(pDrsExtractNames_t names, const char* name) {
+    const char **slot = drs_extract_names_slot(names, name);
+    const char **old = names->slots;
+    size_t oldCapacity = names->capacity;
+    size_t i;
+
+    if (*slot) {
+        return 1;
+    }
+
+    *slot = name;
+
+    /* Alternates picked while writing can push it past half full */
+    if (++names->count * 2 > names->capacity) {
+        if (!(names->slots = calloc(oldCapacity * 2, sizeof(const char*)))) {
+            names->slots = old;
+            return 0;
+        }
+
+        names->capacity = oldCapacity * 2;
+
+        for (i = 0; i < oldCapacity; ++i) {
+            if (old[i]) {
+                *drs_extract_names_slot(names, old[i]) = old[i];
+            }
+        }
+
+        free(old);
+    }
+
+    return 0;
+}
+
+/**
+ * Next <id>_NNN.<ext> nobody has taken, written to name. Entries sharing
+ * ID and extension continue the leader's sequence.
+ **/
+static int drs_extract_alternate(pDrsExtractNames_t names, pDrsExtractJob_t job, drs_t* drs, char* name) {
+    pDrsExtractJob_t leader = job->leader ? job->leader : job;
+    int id = drs->tables[job->table].files[job->file].id;
+    const char *extension = drs->tables[job->table].header.extension;
+
+    while (leader->attempts < DRS_EXTRACT_MAX_ATTEMPTS) {
+        sprintf(name, "%d_%03d.%s", id, leader->attempts++, extension);
+
+        if (!drs_extract_names_add(names, name)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * Pick the output name of every entry up front, in header order, so the
+ * result does not depend on which worker finishes first. Only names from
+ * this archive are known here; files already on disk are found when the
+ * exclusive create fails.
+ **/
+static int drs_extract_plan(drs_t* drs, pDrsExtractJob_t jobs, const int* tableStart,
+        pDrsExtractNames_t names, const char* dirName, char* fileNames, const drsFilter_t* filter) {
+    int k;
+    int j;
+    int runStart = 0;
+    drsIndexEntry_t *entry = NULL;
+    pDrsExtractJob_t job = NULL;
+    pDrsExtractJob_t other = NULL;
+    const char *extension = NULL;
+    int selected = 0;
+
+    for (k = 0; k < drs->index.count; ++k) {
+        entry = &drs->index.entries[k];
+        job = &jobs[tableStart[entry->table] + entry->file];
+        extension = drs->tables[entry->table].header.extension;
+
+        if (!k || drs->index.entries[k - 1].id != entry->id) {
+            runStart = k;
+        }
+
+        job->table = entry->table;
+        job->file = entry->file;
+        job->attempts = 0;
+        job->leader = NULL;
+        job->rc = 0;
+
+        if (!(job->selected = drs_filter_match(filter, drs, entry->table, entry->file))) {
+            job->fileName = NULL;
+            continue;
+        }
+
+        job->fileName = &fileNames[(tableStart[entry->table] + entry->file) * DRS_EXTRACT_NAME_LENGTH];
+        ++selected;
+
+        /* First earlier selected entry with the same extension owns the suffix counter */
+        for (j = runStart; j < k && !job->leader; ++j) {
+            other = &jobs[tableStart[drs->index.entries[j].table] + drs->index.entries[j].file];
+
+            if (other->selected && !strcmp(drs->tables[other->table].header.extension, extension)) {
+                job->leader = other;
+            }
+        }
+
+        sprintf(job->fileName, "%d.%s", entry->id, extension);
+
+        if (!drs_extract_names_add(names, job->fileName)) {
+            continue;
+        }
+
+        fprintf(stderr, "File %s%c%s is in use. ", dirName, FS_DIR_CHAR, job->fileName);
+
+        if (drs_extract_alternate(names, job, drs, job->fileName)) {
+            fprintf(stderr, "Failed to find an alternate name for file. Skipping.\n");
+            job->fileName = NULL;
+            job->rc = 1;
+        } else {
+            fprintf(stderr, "Will use %s%c%s instead.\n", dirName, FS_DIR_CHAR, job->fileName);
+        }
+    }
+
+    return selected;
+}
+
+/* One exclusive create per entry; a name taken on disk moves on to the next alternate */
+static int drs_extract_open(pDrsExtractContext_t context, pDrsExtractJob_t job) {
+    pDrsExtractNames_t names = &context->names;
+    char *pRealloc = NULL;
+    char *name = NULL;
+    int fd;
+    int rc;
+
+    while ((fd = file_create_exclusive(context->dirFd, context->dirName, job->fileName)) == -2) {
+        threadpool_mutex_lock(&names->lock);
+
+        if (names->extraCount == names->extraCapacity) {
+            names->extraCapacity = names->extraCapacity ? names->extraCapacity * 2 : 16;
+
+            if ((pRealloc = realloc(names->extra, names->extraCapacity * sizeof(char*)))) {
+                names->extra = (char**)pRealloc;
+            } else {
+                names->extraCapacity = names->extraCount;
+            }
+        }
+
+        rc = names->extraCount == names->extraCapacity || !(name = malloc(DRS_EXTRACT_NAME_LENGTH)) ||
+            drs_extract_alternate(names, job, context->drs, name);
+
+        if (name) {
+            names->extra[names->extraCount++] = name;
+        }
+
+        threadpool_mutex_unlock(&names->lock);
+
+        /* One call per message so lines from several workers do not interleave */
+        if (rc) {
+            fprintf(stderr, "File %s%c%s is in use. Failed to find an alternate name for file. Skipping.\n",
+                context->dirName, FS_DIR_CHAR, job->fileName);
+            job->fileName = NULL;
+            return -1;
+        }
+
+        fprintf(stderr, "File %s%c%s is in use. Will use %s%c%s instead.\n", context->dirName, FS_DIR_CHAR,
+            job->fileName, context->dirName, FS_DIR_CHAR, name);
+        job->fileName = name;
+        name = NULL;
+    }
+
+    return fd;
+}
+
+/* Payload from memory, or straight from the archive descriptor when data is NULL */
+static int drs_extract_write(pDrsExtractContext_t context, pDrsExtractJob_t job, const unsigned char* data) {
+    drsFile_t *file = &context->drs->tables[job->table].files[job->file];
+    int fd;
+    int rc = 0;
+
+    if ((fd = drs_extract_open(context, job)) < 0) {
+        return 2;
+    }
+
+    if (data) {
+        rc = file_write_all(fd, data, file->size) ? 3 : 0;
+    } else {
+        rc = file_copy_range(context->drs->fd, file->offset, fd, file->size) ? 3 : 0;
+    }
+
+    if (file_close_descriptor(fd)) {
+        rc = 4;
+    }
+
+    return rc;
+}
+
+static void drs_extract_worker(size_t item, void* userData) {
+    pDrsExtractContext_t context = userData;
+    pDrsExtractJob_t job = &context->jobs[item];
+    drsFile_t *file = NULL;
+
+    if (!job->fileName) {
+        return;
+    }
+
+    file = &context->drs->tables[job->table].files[job->file];
+
+    /* Index-only archives never bring payloads into the process */
+    if (!file->data && context->drs->storage == DRS_STORAGE_INDEX) {
+        job->rc = drs_extract_write(context, job, NULL);
+        return;
+    }
+
+    if (!file->data && file->size) {
+        job->rc = 2;
+        return;
+    }
+
+    job->rc = drs_extract_write(context, job, file->data ? file->data : (const unsigned char*)"");
+}
+
+/* One read for the whole run, then each entry written from its slice */
+static void drs_extract_run_worker(size_t item, void* userData) {
+    pDrsExtractContext_t context = userData;
+    pDrsExtractRun_t run = &context->runs[item];
+    pDrsExtractJob_t job = NULL;
+    drsFile_t *file = NULL;
+    unsigned char *buffer = NULL;
+    int k;
+    int rc = 0;
+
+    if (!(buffer = malloc(run->size ? run->size : 1))) {
+        rc = 4;
+    } else if (file_read_at(context->drs->fd, buffer, run->size, run->offset)) {
+        rc = 3;
+    }
+
+    for (k = 0; k < run->count; ++k) {
+        job = context->reads[run->first + k].job;
+        file = &context->drs->tables[job->table].files[job->file];
+
+        if (rc) {
+            job->rc = rc;
+        } else {
+            job->rc = drs_extract_write(context, job, &buffer[file->offset - run->offset]);
+        }
+    }
+
+    free(buffer);
+}
+
+static int drs_extract_compare_offset(const void* a, const void* b) {
+    const drsExtractRead_t *lhs = a;
+    const drsExtractRead_t *rhs = b;
+
+    if (lhs->offset != rhs->offset) {
+        return lhs->offset < rhs->offset ? -1 : 1;
+    }
+
+    return (lhs->job > rhs->job) - (lhs->job < rhs->job);
+}
+
+/**
+ * Selected entries sorted by offset and grouped into runs, each run read
+ * with a single call. Neighbours less than a page apart share a run.
+ **/
+static int drs_extract_coalesce(pDrsExtractContext_t context, int fileCount, int selected) {
+    drs_t *drs = context->drs;
+    drsFile_t *file = NULL;
+    pDrsExtractRun_t run = NULL;
+    size_t end;
+    int runCount = 0;
+    int i;
+    int k = 0;
+
+    context->reads = malloc((selected ? selected : 1) * sizeof(drsExtractRead_t));
+    context->runs = malloc((selected ? selected : 1) * sizeof(drsExtractRun_t));
+
+    if (!context->reads || !context->runs) {
+        return -1;
+    }
+
+    STATS_ALLOC((selected ? selected : 1) * (sizeof(drsExtractRead_t) + sizeof(drsExtractRun_t)));
+
+    for (i = 0; i < fileCount; ++i) {
+        if (context->jobs[i].fileName) {
+            context->reads[k].job = &context->jobs[i];
+            context->reads[k++].offset = drs->tables[context->jobs[i].table].files[context->jobs[i].file].offset;
+        }
+    }
+
+    qsort(context->reads, k, sizeof(drsExtractRead_t), drs_extract_compare_offset);
+
+    for (i = 0; i < k; ++i) {
+        file = &drs->tables[context->reads[i].job->table].files[context->reads[i].job->file];
+        end = context->reads[i].offset + file->size;
+
+        if (run && context->reads[i].offset <= run->offset + run->size + DRS_EXTRACT_COALESCE_GAP &&
+            (end > run->offset + run->size ? end : run->offset + run->size) - run->offset <= DRS_EXTRACT_RUN_SIZE) {
+            run->size = end > run->offset + run->size ? end - run->offset : run->size;
+            ++run->count;
+            continue;
+        }
+
+        run = &context->runs[runCount++];
+        run->offset = context->reads[i].offset;
+        run->size = file->size;
+        run->first = i;
+        run->count = 1;
+    }
+
+    return runCount;
+}
+
+int drs_extract_archive(drs_t* drs, const char* dir) {
+    return drs_extract_archive_ex(drs, dir, NULL);
+}
+
+int drs_extract_archive_ex(drs_t* drs, const char* dir, const drsExtractOptions_t* options) {
+    int i;
+    int fileCount = 0;
+    int selected;
+    int runCount = -1;
+    int failed = 0;
+    size_t dirNameLen;
+    size_t k;
+    char *dirName = NULL;
+    char *names = NULL;
+    int *tableStart = NULL;
+    drsExtractContext_t context;
+
+    if (!drs || !dir || !drs->tables) {
+        return -1;
+    }
+
+    dirNameLen = strlen(dir);
+
+    if (!dirNameLen) {
+        return -1;
+    }
+
+    dirName = malloc(sizeof(char)*dirNameLen+1);
+    if (!dirName) {
+        return -1;
+    }
+
+    if (dir[dirNameLen - 1] == FS_DIR_CHAR) {
+        dirNameLen -= 1;
+
+        if (!dirNameLen) {
+            free(dirName);
+            return -1;
+        }
+    }
+
+    memcpy(dirName, dir, sizeof(char)*dirNameLen);
+    dirName[dirNameLen] = '\0';
+
+    if (!directory_exists(dir)) {
+        if (create_directory(dir)) {
+            free(dirName);
+            return -1;
+        }
+    }
+
+    if (!drs->index.entries && drs_index_build(drs)) {
+        free(dirName);
+        return -1;
+    }
+
+    if (!(tableStart = malloc((drs->header.tableCount + 1) * sizeof(int)))) {
+        free(dirName);
+        return -1;
+    }
+
+    for (i = 0; i < drs->header.tableCount; ++i) {
+        tableStart[i] = fileCount;
+        fileCount += drs->tables[i].header.fileCount;
+    }
+
+    context.drs = drs;
+    context.dirName = dirName;
+    context.reads = NULL;
+    context.runs = NULL;
+    context.jobs = calloc(fileCount ? fileCount : 1, sizeof(drsExtractJob_t));
+    names = malloc((fileCount ? fileCount : 1) * DRS_EXTRACT_NAME_LENGTH);
+
+    /* Room for every name at under half load */
+    memset(&context.names, 0, sizeof(drsExtractNames_t));
+    context.names.capacity = 16;
+    while (context.names.capacity < (size_t)fileCount * 2) {
+        context.names.capacity *= 2;
+    }
+
+    context.names.slots = calloc(context.names.capacity, sizeof(const char*));
+
+    if (!context.jobs || !names || !context.names.slots) {
+        free(context.names.slots);
+        free(context.jobs);
+        free(names);
+        free(tableStart);
+        free(dirName);
+        return -1;
+    }
+
+    STATS_ALLOC((fileCount ? fileCount : 1) * (sizeof(drsExtractJob_t) + DRS_EXTRACT_NAME_LENGTH));
+    STATS_ALLOC(context.names.capacity * sizeof(const char*));
+    STATS_BEGIN(STATS_PHASE_EXTRACT);
+
+    threadpool_mutex_init(&context.names.lock);
+    context.dirFd = directory_open(dirName);
+
+    selected = drs_extract_plan(drs, context.jobs, tableStart, &context.names, dirName, names,
+        options ? options->filter : NULL);
+
+    /* Index-only archives can read runs of neighbouring entries at once instead of copying each */
+    if (options && options->coalesce && drs->storage == DRS_STORAGE_INDEX) {
+        runCount = drs_extract_coalesce(&context, fileCount, selected);
+    }
+
+    if (runCount >= 0) {
+        threadpool_run(runCount, options->jobs, drs_extract_run_worker, &context);
+    } else {
+        threadpool_run(fileCount, options ? options->jobs : 1, drs_extract_worker, &context);
+    }
+
+    STATS_END(STATS_PHASE_EXTRACT);
+
+    /* Report failures once, in header order */
+    for (i = 0; i < fileCount; ++i) {
+        if (!context.jobs[i].rc) {
+            continue;
+        }
+
+        ++failed;
+
+        if (context.jobs[i].fileName) {
+            fprintf(stderr, "Failed to create file %s%c%s\n", dirName, FS_DIR_CHAR, context.jobs[i].fileName);
+        }
+    }
+
+    if (failed) {
+        fprintf(stderr, "%d of %d files could not be extracted\n", failed, selected);
+    }
+
+    directory_close(context.dirFd);
+    threadpool_mutex_destroy(&context.names.lock);
+
+    for (k = 0; k < context.names.extraCount; ++k) {
+        free(context.names.extra[k]);
+    }
+
+    free(context.names.extra);
+    free(context.names.slots);
+    free(context.reads);
+    free(context.runs);
+    free(context.jobs);
+    free(names);
+    free(tableStart);
+    free(dirName);
+
+    return failed;
+}
@@ -0,0 +1,185 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "DRSFormat.h"
+
+/**
+ * Entry selection for extraction: --ext slp,wav --id 3000-3999,4005 --table 0.
+ * Lists are comma separated and the same option may be given several times.
+ **/
+
+static int drs_filter_grow(void** array, int count, size_t size) {
+    void *pRealloc = NULL;
+
+    /* Capacities are powers of two, grow when count reaches one */
+    if (count && (count & (count - 1))) {
+        return 0;
+    }
+
+    if (!(pRealloc = realloc(*array, (count ? count * 2 : 4) * size))) {
+        return 1;
+    }
+
+    *array = pRealloc;
+    return 0;
+}
+
+void drs_filter_init(drsFilter_t* filter) {
+    if (filter) {
+        memset(filter, 0, sizeof(drsFilter_t));
+    }
+}
+
+int drs_filter_add_extensions(drsFilter_t* filter, const char* list) {
+    const char *end = NULL;
+    size_t length;
+
+    if (!filter || !list) {
+        return 1;
+    }
+
+    for (; *list; list = *end ? end + 1 : end) {
+        end = strchr(list, ',');
+        end = end ? end : list + strlen(list);
+        length = (size_t)(end - list);
+
+        if (!length || length > DRS_TABLE_HDR_EXT_LENGTH) {
+            return 1;
+        }
+
+        if (drs_filter_grow((void**)&filter->extensions, filter->extensionCount, sizeof(*filter->extensions))) {
+            return 4;
+        }
+
+        memcpy(filter->extensions[filter->extensionCount], list, length);
+        filter->extensions[filter->extensionCount++][length] = '\0';
+    }
+
+    return 0;
+}
+
+/* <id>, <first>-<last> or <first>- for everything from first on */
+int drs_filter_add_ids(drsFilter_t* filter, const char* list) {
+    char *end = NULL;
+    long first;
+    long last;
+
+    if (!filter || !list || !*list) {
+        return 1;
+    }
+
+    while (*list) {
+        first = strtol(list, &end, 10);
+
+        if (end == list || first < INT_MIN || first > INT_MAX) {
+            return 1;
+        }
+
+        last = first;
+
+        if (*end == '-') {
+            list = end + 1;
+
+            if (!*list || *list == ',') {
+                last = INT_MAX;
+                end = (char*)list;
+            } else if ((last = strtol(list, &end, 10)) < first || last > INT_MAX || end == list) {
+                return 1;
+            }
+        }
+
+        if (*end && *end != ',') {
+            return 1;
+        }
+
+        if (drs_filter_grow((void**)&filter->ranges, filter->rangeCount, sizeof(drsIdRange_t))) {
+            return 4;
+        }
+
+        filter->ranges[filter->rangeCount].first = (int)first;
+        filter->ranges[filter->rangeCount++].last = (int)last;
+        list = *end ? end + 1 : end;
+    }
+
+    return 0;
+}
+
+/* Table positions in header order, counting from 0 */
+int drs_filter_add_tables(drsFilter_t* filter, const char* list) {
+    char *end = NULL;
+    long table;
+
+    if (!filter || !list || !*list) {
+        return 1;
+    }
+
+    while (*list) {
+        table = strtol(list, &end, 10);
+
+        if (end == list || table < 0 || table > INT_MAX || (*end && *end != ',')) {
+            return 1;
+        }
+
+        if (drs_filter_grow((void**)&filter->tables, filter->tableCount, sizeof(int))) {
+            return 4;
+        }
+
+        filter->tables[filter->tableCount++] = (int)table;
+        list = *end ? end + 1 : end;
+    }
+
+    return 0;
+}
+
+int drs_filter_empty(const drsFilter_t* filter) {
+    return !filter || (!filter->extensionCount && !filter->rangeCount && !filter->tableCount);
+}
+
+int drs_filter_match(const drsFilter_t* filter, drs_t* drs, int table, int file) {
+    int i;
+    int id;
+
+    if (drs_filter_empty(filter)) {
+        return 1;
+    }
+
+    for (i = 0; i < filter->tableCount; ++i) {
+        if (filter->tables[i] == table) {
+            break;
+        }
+    }
+
+    if (filter->tableCount && i == filter->tableCount) {
+        return 0;
+    }
+
+    for (i = 0; i < filter->extensionCount; ++i) {
+        if (!strcmp(filter->extensions[i], drs->tables[table].header.extension)) {
+            break;
+        }
+    }
+
+    if (filter->extensionCount && i == filter->extensionCount) {
+        return 0;
+    }
+
+    id = drs->tables[table].files[file].id;
+
+    for (i = 0; i < filter->rangeCount; ++i) {
+        if (id >= filter->ranges[i].first && id <= filter->ranges[i].last) {
+            return 1;
+        }
+    }
+
+    return !filter->rangeCount;
+}
+
+void drs_filter_free(drsFilter_t* filter) {
+    if (filter) {
+        free(filter->extensions);
+        free(filter->ranges);
+        free(filter->tables);
+        memset(filter, 0, sizeof(drsFilter_t));
+    }
+}
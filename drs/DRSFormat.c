@@ -1,424 +1,1058 @@
-#include <stdlib.h>
-#include <string.h>
-
-#include "FileManager.h"
-#include "DRSFormat.h"
-
-int is_readable_ascii_char(char c) {
-    return ('~' >= c) && (c >= ' ');
-}
-
-void drs_init_empty(pDrs_t drs) {
-    if (!drs) {
-        return;
-    }
-
-    memset(drs, 0, sizeof(drs_t));
-    
-    drs->fileSize = DRS_HDR_COPYRIGHT_LENGTH + DRS_HDR_VERSION_LENGTH
-        + DRS_HDR_TYPE_LENGTH + (2 * sizeof(int));
-}
-
-int drs_load(const char* filePath, drs_t* drs) {
-    int idx;
-    int iidx;
-    size_t fileOffset = 0;
-    size_t ffOffset = 0;
-    unsigned char* fileBuffer = NULL;
-    drsTable_t *drsTable = NULL;
-    int rc = 0;
-
-    if (!drs) {
-        return 1;
-    }
-
-    /* Retrieve file contents */
-    if ((rc = file_get_contents(filePath, &fileBuffer, &drs->fileSize))) {
-        return rc + 1;
-    }
-
-    if (!fileBuffer || drs->fileSize <= sizeof(drsHeader_t)) {
-        if (fileBuffer) {
-            free(fileBuffer);
-            fileBuffer = NULL;
-        }
-        return 7;
-    }
-
-    /***********************
-     * Retrieve DRS header *
-     ***********************/
-
-    drs->tables = NULL;
-
-    /**
-     * Copy valid data from copyright string. First 40 bytes in file is reserved
-     * for copyright data. It is not null terminated in file.
-     **/
-    while (is_readable_ascii_char(fileBuffer[fileOffset]) && fileOffset < DRS_HDR_COPYRIGHT_LENGTH) {
-        drs->header.copyright[fileOffset] = fileBuffer[fileOffset];
-        ++fileOffset;
-    }
-
-    /* zero terminate copyright string */
-    drs->header.copyright[fileOffset] = '\0';
-    fileOffset = DRS_HDR_COPYRIGHT_LENGTH;
-
-    /* Retrieve DRS version, 4 bytes, not null terminated. int hack to save copy ops. */
-    drs->header.version[0] = fileBuffer[fileOffset++];
-    drs->header.version[1] = fileBuffer[fileOffset++];
-    drs->header.version[2] = fileBuffer[fileOffset++];
-    drs->header.version[3] = fileBuffer[fileOffset++];
-    drs->header.version[4] = '\0';
-
-    /* Retrieve DRS archive type, 12 bytes, not null terminated */
-    idx = 0;
-    while (is_readable_ascii_char(fileBuffer[idx+fileOffset]) && idx < DRS_HDR_TYPE_LENGTH) {
-        drs->header.type[idx] = fileBuffer[idx+fileOffset];
-        ++idx;
-    }
-    
-    drs->header.type[idx] = '\0';
-    fileOffset += DRS_HDR_TYPE_LENGTH;
-
-    /* Retrieve table count and offset */
-    drs->header.tableCount = *(int*)&fileBuffer[fileOffset];
-    fileOffset += sizeof(int);
-    drs->header.offset = *(int*)&fileBuffer[fileOffset];
-    fileOffset += sizeof(int);
-
-    /***********************
-    *  Retrieve DRS tables *
-    ************************/
-  
-    if (!(drs->tables = malloc(sizeof(drsTable_t) * drs->header.tableCount))) {
-        free(fileBuffer);
-        fileBuffer = NULL;
-        return 8;
-    }
-
-    for (idx = 0; idx < drs->header.tableCount; ++idx) {
-        drsTable = &drs->tables[idx];
-        drsTable->files = NULL;
-
-        /* Retrieve file type */
-        drsTable->header.fileType = fileBuffer[fileOffset++];
-
-        /* Retrieve file extension (reversed in file) */
-        drsTable->header.extension[0] = fileBuffer[fileOffset + 2];
-        drsTable->header.extension[1] = fileBuffer[fileOffset + 1];
-        drsTable->header.extension[2] = fileBuffer[fileOffset + 0];
-        drsTable->header.extension[3] = '\0';
-        fileOffset += DRS_TABLE_HDR_EXT_LENGTH;
-
-        /* Retrieve offset and file count*/
-        drsTable->header.offset = *(int*)&fileBuffer[fileOffset];
-        fileOffset += sizeof(int);
-        drsTable->header.fileCount = *(int*)&fileBuffer[fileOffset];
-        fileOffset += sizeof(int);
-
-        /* Allocate file headers */
-        drsTable->files = malloc(drsTable->header.fileCount * sizeof(drsFile_t));
-
-        if (!drsTable->files) {
-            for (iidx = 0; iidx < idx; ++iidx) {
-                if (drs->tables[iidx].files) {
-                    free(drs->tables[iidx].files);
-                    drs->tables[iidx].files = NULL;
-                }
-            }
-
-            free(drs->tables);
-            drs->tables = NULL;
-            free(fileBuffer);
-            return 9;
-        }
-
-        /* Retrieve file header data */
-        ffOffset = drsTable->header.offset;
-
-        for (iidx = 0; iidx < drsTable->header.fileCount; ++iidx) {
-            drsTable->files[iidx].id = *(int*)&fileBuffer[ffOffset];
-            ffOffset += sizeof(int);
-            drsTable->files[iidx].offset = *(int*)&fileBuffer[ffOffset];
-            ffOffset += sizeof(int);
-            drsTable->files[iidx].size = *(int*)&fileBuffer[ffOffset];
-            ffOffset += sizeof(int);
-
-            if ((drsTable->files[iidx].data = malloc(drsTable->files[iidx].size)) != NULL) {
-                memcpy(drsTable->files[iidx].data, &fileBuffer[drsTable->files[iidx].offset], drsTable->files[iidx].size);
-            } else {
-                drsTable->files[iidx].size = 0;
-            }
-        }
-    }
-
-    free(fileBuffer);
-    return rc;
-}
-
-void drs_free(drs_t* drs) {
-    int i;
-    int ii;
-
-    if (drs) {
-        if (drs->tables) {
-            for (i = 0; i < drs->header.tableCount; ++i) {
-                if (drs->tables->files) {
-                    for (ii = 0; ii < drs->tables->header.fileCount; ++ii) {
-                        if (drs->tables->files[ii].data) {
-                            free(drs->tables->files[ii].data);
-                            drs->tables->files[ii].data = NULL;
-                            drs->tables->files[ii].size = 0;
-                        }
-                    }
-
-                    free(drs->tables->files);
-                    drs->tables->files = NULL;
-                }
-            }
-
-            free(drs->tables);
-            drs->tables = NULL;
-        }
-    }
-}
-
-int drs_create_archive(drs_t* drs, const char* output) {
-    unsigned char* buffer;
-    size_t bufferOffset;
-    int totalSize;
-    int fSz = 0;
-    int i;
-    int ii;
-
-    if (!drs || !output || !drs->tables) {
-        return 1;
-    }
-
-    /* Calculate size of header */
-    totalSize = DRS_HDR_COPYRIGHT_LENGTH + DRS_HDR_VERSION_LENGTH +
-        DRS_HDR_TYPE_LENGTH + 2*sizeof(int);
-
-    /* Calculate size of table headers */
-    totalSize += drs->header.tableCount *
-        ((sizeof(char) * (DRS_TABLE_HDR_EXT_LENGTH+1)) + (2 * sizeof(int)));
-
-    /* Calcluate size of file headers and files */
-    for (i = 0; i < drs->header.tableCount; ++i) {
-        for (ii = 0; ii < drs->tables[i].header.fileCount; ++ii) {
-            totalSize += (3*sizeof(int));
-            
-            if (drs->tables[i].files) {
-                totalSize += drs->tables[i].files[ii].size;
-                fSz += drs->tables[i].files[ii].size;
-            }
-        }
-    }
-
-    if (totalSize != drs->fileSize) {
-        fprintf(stderr, "DRS file size mismatched. Expected %d (0x%X), got %zu (0x%zX) - %d.\n",
-                totalSize, totalSize, drs->fileSize, drs->fileSize, fSz);
-        return 2;
-    }
-
-    if ((buffer = malloc(totalSize)) == NULL) {
-        return 3;
-    }
-
-    /* Copy header */
-    memcpy(buffer, &drs->header.copyright, DRS_HDR_COPYRIGHT_LENGTH);
-    bufferOffset = DRS_HDR_COPYRIGHT_LENGTH;
-    memcpy(&buffer[bufferOffset], &drs->header.version, DRS_HDR_VERSION_LENGTH);
-    bufferOffset += DRS_HDR_VERSION_LENGTH;
-    memcpy(&buffer[bufferOffset], &drs->header.type, DRS_HDR_TYPE_LENGTH);
-    bufferOffset += DRS_HDR_TYPE_LENGTH;
-    memcpy(&buffer[bufferOffset], &drs->header.tableCount, sizeof(int));
-    bufferOffset += sizeof(int);
-    memcpy(&buffer[bufferOffset], &drs->header.offset, sizeof(int));
-    bufferOffset += sizeof(int);
-
-    /* Copy out table headers */
-    for (i = 0; i < drs->header.tableCount; ++i) {
-        /* Type */
-        buffer[bufferOffset++] = drs->tables[i].header.fileType;
-
-        /* Extension (reversed)  */
-        buffer[bufferOffset++] = drs->tables[i].header.extension[2]; 
-        buffer[bufferOffset++] = drs->tables[i].header.extension[1];
-        buffer[bufferOffset++] = drs->tables[i].header.extension[0];
-
-        /* Offset and file count */
-        memcpy(&buffer[bufferOffset], &drs->tables[i].header.offset, sizeof(int));
-        bufferOffset += sizeof(int);
-        memcpy(&buffer[bufferOffset], &drs->tables[i].header.fileCount, sizeof(int));
-        bufferOffset += sizeof(int);
-    }
-
-    if (bufferOffset != drs->tables[0].header.offset) {
-        fprintf(stderr, "DRS table offset mismatched. Expected 0x%08X, got 0x%08X\n.",
-                (unsigned int)bufferOffset, drs->tables[0].header.offset); 
-        free(buffer);
-        buffer = NULL;
-        return 4;
-    }
-
-    /* Copy out file headers */
-    for (i = 0; i < drs->header.tableCount; ++i) {
-        for (ii = 0; ii < drs->tables[i].header.fileCount; ++ii) {
-            memcpy(&buffer[bufferOffset], &drs->tables[i].files[ii].id, sizeof(int));
-            bufferOffset += sizeof(int);
-            memcpy(&buffer[bufferOffset], &drs->tables[i].files[ii].offset, sizeof(int));
-            bufferOffset += sizeof(int);
-            memcpy(&buffer[bufferOffset], &drs->tables[i].files[ii].size, sizeof(int));
-            bufferOffset += sizeof(int);
-        }
-    }
-
-    /* Copy out raw file data */
-    for (i = 0; i < drs->header.tableCount; ++i) {
-        for (ii = 0; ii < drs->tables[i].header.fileCount; ++ii) {
-            memcpy(&buffer[bufferOffset], drs->tables[i].files[ii].data,
-                    drs->tables[i].files[ii].size);
-            bufferOffset += drs->tables[i].files[ii].size;
-        }
-    }
-
-    if (file_put_contents(output, buffer, bufferOffset)) {
-        fprintf(stderr, "Failed to create DRS file %s\n", output);
-        free(buffer);
-        buffer = NULL;
-        return 5;
-    }
-
-    free(buffer);
-    buffer = NULL;
-
-    return 0;
-}
-
-int drs_extract_archive(drs_t* drs, const char* dir) {
-    int i;
-    int ii;
-    int attempts;
-    size_t dirNameLen;
-    char *fileName = NULL;
-    char *dirName = NULL;
-
-    if (!drs || !dir || !drs->tables || !drs->tables->files) {
-        return -1;
-    }
-
-    dirNameLen = strlen(dir);
-
-    if (!dirNameLen) {
-        return -1;
-    }
-
-    dirName = malloc(sizeof(char)*dirNameLen+1);
-    if (!dirName) {
-        return -1;
-    }
-
-    if (dir[dirNameLen - 1] == FS_DIR_CHAR) {
-        dirNameLen -= 1;
-
-        if (!dirNameLen) {
-            free(dirName);
-            return -1;
-        }
-    }
-
-    memcpy(dirName, dir, sizeof(char)*dirNameLen);
-    dirName[dirNameLen] = '\0';
-
-    if (!directory_exists(dir)) {
-        if (create_directory(dir)) {
-            free(dirName);
-            return -1;
-        }
-    }
-
-    if (!(fileName = malloc(dirNameLen + 22))) {
-        free(dirName);
-        return -1;
-    }
-
-    for (i = 0; i < drs->header.tableCount; ++i) {
-        for (ii = 0; ii < drs->tables[i].header.fileCount; ++ii) {
-            sprintf(fileName, "%s%c%d.%s%c", dirName, FS_DIR_CHAR, drs->tables[i].files[ii].id,
-                drs->tables[i].header.extension, '\0');
-            if (file_exists(fileName)) {
-                attempts = 0;
-                fprintf(stderr, "File %s is in use. ", fileName);
-                do {
-                    sprintf(fileName, "%s%c%d_%03d.%s%c", dirName, FS_DIR_CHAR, drs->tables[i].files[ii].id,
-                        attempts, drs->tables[i].header.extension, '\0');
-                } while (attempts++ < 1000 && file_exists(fileName));
-
-                if (attempts == 1000) {
-                    fprintf(stderr, "Failed to find an alternate name for file. Skipping.\n");
-                    continue;
-                } else {
-                    fprintf(stderr, "Will use %s instead.\n", fileName);
-                }
-            }
-
-            if (file_put_contents(fileName, drs->tables[i].files[ii].data, drs->tables[i].files[ii].size)) {
-                fprintf(stderr, "Failed to create file %s\n", fileName);
-            }
-        }
-    }
-
-    free(fileName);
-    fileName = NULL;
-
-    free(dirName);
-    dirName = NULL;
-
-    return 0;
-}
-
-void drs_print_header(drs_t* drs, FILE* out) {
-    int i;
-
-    if (!drs || !out) {
-        return;
-    }
-
-    fprintf(out, "%20s  %s\n%20s  %s\n%20s  %s\n%20s  %d\n%20s  0x%X\n%20s  %zu\n\n", "Copyright info:", drs->header.copyright,
-        "File version:", drs->header.version, "Archive type:", drs->header.type, "Num. tables in file:", drs->header.tableCount,
-        "1st file offset:", drs->header.offset, "File size:", drs->fileSize);
-    
-    for (i = 0; i < drs->header.tableCount; ++i) {
-        printf("TABLE %d:\n\n", i);
-        drs_print_table(&drs->tables[i], out);
-    }
-}
-
-void drs_print_table(drsTable_t* table, FILE* out) {
-#if 0
-    int i;
-#endif
-
-    if (!table || !out) {
-        return;
-    }
-
-    fprintf(out, "\t%20s  0x%02X (%c)\n\t%20s  %s\n\t%20s  0x%X\n\t%20s  %d\n\n\t%20s\n\n", "File type ID:", table->header.fileType, table->header.fileType,
-        "Extension:", table->header.extension, "Table offset:", table->header.offset, "File count:", table->header.fileCount, "Files:");
-
-#if 0
-    for (i = 0; i < table->header.fileCount; ++i) {
-        drs_print_file_headers(&table->files[i], out);
-    }
-#endif
-}
-
-void drs_print_file_headers(drsFile_t* file, FILE* out) {
-    if (!file || !out) {
-        return;
-    }
-
-    fprintf(out, "\t\t%20s  %04d\n\t\t%20s  0x%X\n\t\t%20s  %11d\n\n", "File ID:", file->id, "File Offset:", file->offset, "File Size:", file->size);
-}
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "FileManager.h"
+#include "Stats.h"
+#include "DRSFormat.h"
+
+int is_readable_ascii_char(char c) {
+    return ('~' >= c) && (c >= ' ');
+}
+
+void drs_init_empty(pDrs_t drs) {
+    if (!drs) {
+        return;
+    }
+
+    memset(drs, 0, sizeof(drs_t));
+    drs->fd = -1;
+
+    drs->fileSize = DRS_HDR_COPYRIGHT_LENGTH + DRS_HDR_VERSION_LENGTH
+        + DRS_HDR_TYPE_LENGTH + (2 * sizeof(int));
+}
+
+static int drs_parse_abort(drs_t* drs, int rc) {
+    free(drs->arena);
+    drs->arena = NULL;
+    drs->tables = NULL;
+    return rc;
+}
+
+static int drs_index_compare(const void* a, const void* b) {
+    const drsIndexEntry_t *lhs = a;
+    const drsIndexEntry_t *rhs = b;
+
+    if (lhs->id != rhs->id) {
+        return lhs->id < rhs->id ? -1 : 1;
+    }
+
+    /* Keep header order within an ID so the first occurrence wins */
+    if (lhs->table != rhs->table) {
+        return lhs->table < rhs->table ? -1 : 1;
+    }
+
+    return (lhs->file > rhs->file) - (lhs->file < rhs->file);
+}
+
+int drs_index_build(drs_t* drs) {
+    int i;
+    int ii;
+    int run;
+    int count = 0;
+    drsIndexEntry_t *entries = NULL;
+
+    if (!drs) {
+        return 1;
+    }
+
+    drs_index_free(drs);
+
+    for (i = 0; i < drs->header.tableCount; ++i) {
+        count += drs->tables[i].header.fileCount;
+    }
+
+    if (!count) {
+        return 0;
+    }
+
+    if (!(entries = malloc(count * sizeof(drsIndexEntry_t)))) {
+        return 2;
+    }
+
+    STATS_ALLOC(count * sizeof(drsIndexEntry_t));
+
+    count = 0;
+    for (i = 0; i < drs->header.tableCount; ++i) {
+        for (ii = 0; ii < drs->tables[i].header.fileCount; ++ii) {
+            entries[count].id = drs->tables[i].files[ii].id;
+            entries[count].table = i;
+            entries[count].file = ii;
+            ++count;
+        }
+    }
+
+    qsort(entries, count, sizeof(drsIndexEntry_t), drs_index_compare);
+
+    /* Same ID and extension more than once: only the first one is reachable */
+    for (i = 1; i < count; ++i) {
+        for (run = i - 1; run >= 0 && entries[run].id == entries[i].id; --run) {
+            if (!strcmp(drs->tables[entries[run].table].header.extension,
+                    drs->tables[entries[i].table].header.extension)) {
+                ++drs->index.duplicates;
+                break;
+            }
+        }
+    }
+
+    drs->index.entries = entries;
+    drs->index.count = count;
+    return 0;
+}
+
+void drs_index_free(drs_t* drs) {
+    if (drs && drs->index.entries) {
+        free(drs->index.entries);
+    }
+
+    if (drs) {
+        drs->index.entries = NULL;
+        drs->index.count = 0;
+        drs->index.duplicates = 0;
+    }
+}
+
+pDrsFile_t drs_find(drs_t* drs, int id, const char* extension, pDrsTable_t* table) {
+    int low = 0;
+    int high;
+    int mid;
+    drsIndexEntry_t *entry = NULL;
+
+    if (!drs || !drs->index.entries) {
+        return NULL;
+    }
+
+    /* Lower bound of id */
+    high = drs->index.count;
+    while (low < high) {
+        mid = low + (high - low) / 2;
+
+        if (drs->index.entries[mid].id < id) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    for (; low < drs->index.count && drs->index.entries[low].id == id; ++low) {
+        entry = &drs->index.entries[low];
+
+        if (!extension || !strcmp(drs->tables[entry->table].header.extension, extension)) {
+            if (table) {
+                *table = &drs->tables[entry->table];
+            }
+
+            return &drs->tables[entry->table].files[entry->file];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Parse the DRS header, table headers and file headers from an in-memory
+ * image of the archive. bufferSize covers at least the header region, file
+ * offsets and sizes are checked against drs->fileSize. Payloads are left
+ * untouched; every drsFile_t.data is NULL on return and it is up to the
+ * caller to attach them.
+ *
+ * Tables and file headers are carved from a single arena sized from the
+ * table headers, so drs_free() releases all metadata with one free().
+ **/
+static int drs_parse(drs_t* drs, const unsigned char* fileBuffer, size_t bufferSize) {
+    int idx;
+    int iidx;
+    int extended;
+    size_t fileOffset = 0;
+    size_t fileCount = 0;
+    size_t arenaSize;
+    size_t limit;
+    size_t tableSize;
+    size_t recordSize;
+    drsTableHeader_t tableHeader;
+    drsTable_t *drsTable = NULL;
+    drsFile_t *files = NULL;
+
+    /***********************
+     * Retrieve DRS header *
+     ***********************/
+
+    STATS_BEGIN(STATS_PHASE_PARSE);
+    drs->tables = NULL;
+    drs->arena = NULL;
+    drs->index.entries = NULL;
+    drs->index.count = 0;
+    drs->index.duplicates = 0;
+
+    /**
+     * Copy valid data from copyright string. First 40 bytes in file is reserved
+     * for copyright data. It is not null terminated in file.
+     **/
+    while (is_readable_ascii_char(fileBuffer[fileOffset]) && fileOffset < DRS_HDR_COPYRIGHT_LENGTH) {
+        drs->header.copyright[fileOffset] = fileBuffer[fileOffset];
+        ++fileOffset;
+    }
+
+    /* zero terminate copyright string */
+    drs->header.copyright[fileOffset] = '\0';
+
+    /* Trailing control bytes such as the 0x1A end of text marker survive rewrites */
+    memcpy(drs->header.copyrightRaw, fileBuffer, DRS_HDR_COPYRIGHT_LENGTH);
+    fileOffset = DRS_HDR_COPYRIGHT_LENGTH;
+
+    /* Retrieve DRS version, 4 bytes, not null terminated. int hack to save copy ops. */
+    drs->header.version[0] = fileBuffer[fileOffset++];
+    drs->header.version[1] = fileBuffer[fileOffset++];
+    drs->header.version[2] = fileBuffer[fileOffset++];
+    drs->header.version[3] = fileBuffer[fileOffset++];
+    drs->header.version[4] = '\0';
+
+    /* Retrieve DRS archive type, 12 bytes, not null terminated */
+    idx = 0;
+    while (is_readable_ascii_char(fileBuffer[idx+fileOffset]) && idx < DRS_HDR_TYPE_LENGTH) {
+        drs->header.type[idx] = fileBuffer[idx+fileOffset];
+        ++idx;
+    }
+    
+    drs->header.type[idx] = '\0';
+    fileOffset += DRS_HDR_TYPE_LENGTH;
+
+    /* The version string tells the classic layout from the extended one */
+    extended = drs_extended(drs);
+    limit = drs_offset_limit(drs);
+    tableSize = extended ? DRS_EXT_TABLE_HDR_SIZE : DRS_TABLE_HDR_SIZE;
+    recordSize = extended ? DRS_EXT_FILE_HDR_SIZE : DRS_FILE_HDR_SIZE;
+
+    if (bufferSize < (extended ? DRS_EXT_HDR_SIZE : DRS_HDR_SIZE)) {
+        return 10;
+    }
+
+    /* Retrieve table count and offset */
+    drs->header.tableCount = drs_codec_get32(&fileBuffer[fileOffset]);
+    fileOffset += sizeof(int);
+
+    if (extended) {
+        drs->header.offset = (size_t)drs_codec_get64(&fileBuffer[fileOffset + sizeof(int)]);
+        fileOffset = DRS_EXT_HDR_SIZE;
+    } else {
+        drs->header.offset = (unsigned int)drs_codec_get32(&fileBuffer[fileOffset]);
+        fileOffset = DRS_HDR_SIZE;
+    }
+
+    if (drs->header.tableCount < 0 ||
+        (size_t)drs->header.tableCount > (bufferSize - fileOffset) / tableSize) {
+        return 10;
+    }
+
+    /***********************
+    *  Retrieve DRS tables *
+    ************************/
+
+    /* Size the arena: every table header is validated before anything is allocated */
+    for (idx = 0; idx < drs->header.tableCount; ++idx) {
+        if (drs_codec_decode_table(&fileBuffer[fileOffset + idx * tableSize], &tableHeader, extended) ||
+            tableHeader.offset > limit || tableHeader.fileCount < 0 || tableHeader.offset > bufferSize ||
+            (size_t)tableHeader.fileCount > (bufferSize - tableHeader.offset) / recordSize) {
+            return 10;
+        }
+
+        fileCount += tableHeader.fileCount;
+    }
+
+    /* drsTable_t holds a pointer, so the file headers behind the tables stay aligned */
+    arenaSize = sizeof(drsTable_t) * drs->header.tableCount + sizeof(drsFile_t) * fileCount;
+
+    if (!(drs->arena = malloc(arenaSize ? arenaSize : 1))) {
+        return 8;
+    }
+
+    STATS_ALLOC(arenaSize);
+    drs->tables = (pDrsTable_t)drs->arena;
+    files = (drsFile_t*)(drs->tables + drs->header.tableCount);
+
+    for (idx = 0; idx < drs->header.tableCount; ++idx) {
+        drsTable = &drs->tables[idx];
+
+        /* Retrieve file type, extension (reversed in file), offset and file count */
+        drs_codec_decode_table(&fileBuffer[fileOffset], &drsTable->header, extended);
+        fileOffset += tableSize;
+
+        /* File headers come from the arena, in table order */
+        drsTable->files = files;
+        files += drsTable->header.fileCount;
+
+        /* Retrieve file header data in one run, then validate it */
+        if (drs_codec_decode_files(&fileBuffer[drsTable->header.offset], drsTable->files,
+                                   drsTable->header.fileCount, extended)) {
+            return drs_parse_abort(drs, 10);
+        }
+
+        for (iidx = 0; iidx < drsTable->header.fileCount; ++iidx) {
+            if (drsTable->files[iidx].offset > limit || drsTable->files[iidx].size > limit ||
+                drsTable->files[iidx].offset > drs->fileSize ||
+                drsTable->files[iidx].size > drs->fileSize - drsTable->files[iidx].offset) {
+                return drs_parse_abort(drs, 10);
+            }
+        }
+    }
+
+    STATS_END(STATS_PHASE_PARSE);
+    STATS_BEGIN(STATS_PHASE_INDEX);
+
+    if (drs_index_build(drs)) {
+        return drs_parse_abort(drs, 12);
+    }
+
+    STATS_END(STATS_PHASE_INDEX);
+    return 0;
+}
+
+int drs_load(const char* filePath, drs_t* drs) {
+    int idx;
+    int iidx;
+    unsigned char* fileBuffer = NULL;
+    drsTable_t *drsTable = NULL;
+    int rc = 0;
+
+    if (!drs) {
+        return 1;
+    }
+
+    drs->storage = DRS_STORAGE_OWNED;
+    drs->mapping = NULL;
+    drs->payloads = NULL;
+    drs->fd = -1;
+
+    /* Retrieve file contents */
+    STATS_BEGIN(STATS_PHASE_READ);
+
+    if ((rc = file_get_contents(filePath, &fileBuffer, &drs->fileSize))) {
+        return rc + 1;
+    }
+
+    STATS_END(STATS_PHASE_READ);
+
+    if (!fileBuffer || drs->fileSize < DRS_HDR_SIZE) {
+        if (fileBuffer) {
+            free(fileBuffer);
+            fileBuffer = NULL;
+        }
+        return 7;
+    }
+
+    if ((rc = drs_parse(drs, fileBuffer, drs->fileSize))) {
+        free(fileBuffer);
+        return rc;
+    }
+
+    /**
+     * The archive image is the payload block: entries point into it instead
+     * of getting a malloc and memcpy each, and drs_free() releases it whole.
+     **/
+    STATS_BEGIN(STATS_PHASE_PAYLOAD);
+
+    for (idx = 0; idx < drs->header.tableCount; ++idx) {
+        drsTable = &drs->tables[idx];
+
+        for (iidx = 0; iidx < drsTable->header.fileCount; ++iidx) {
+            drsTable->files[iidx].data = &fileBuffer[drsTable->files[iidx].offset];
+        }
+    }
+
+    STATS_END(STATS_PHASE_PAYLOAD);
+
+    drs->payloads = fileBuffer;
+    return rc;
+}
+
+int drs_open_mapped(const char* filePath, drs_t* drs) {
+    int idx;
+    int iidx;
+    unsigned char* mapping = NULL;
+    drsTable_t *drsTable = NULL;
+    int rc = 0;
+
+    if (!drs) {
+        return 1;
+    }
+
+    drs->storage = DRS_STORAGE_MAPPED;
+    drs->mapping = NULL;
+    drs->payloads = NULL;
+    drs->fd = -1;
+    drs->tables = NULL;
+
+    /* Map the archive read-only, one syscall instead of a full read */
+    STATS_BEGIN(STATS_PHASE_READ);
+
+    if ((rc = file_map(filePath, &mapping, &drs->fileSize))) {
+        return rc + 1;
+    }
+
+    STATS_END(STATS_PHASE_READ);
+
+    if (drs->fileSize < DRS_HDR_SIZE) {
+        file_unmap(mapping, drs->fileSize);
+        return 7;
+    }
+
+    if ((rc = drs_parse(drs, mapping, drs->fileSize))) {
+        file_unmap(mapping, drs->fileSize);
+        return rc;
+    }
+
+    /* Entries borrow their payload straight from the mapping */
+    for (idx = 0; idx < drs->header.tableCount; ++idx) {
+        drsTable = &drs->tables[idx];
+
+        for (iidx = 0; iidx < drsTable->header.fileCount; ++iidx) {
+            drsTable->files[iidx].data = &mapping[drsTable->files[iidx].offset];
+        }
+    }
+
+    drs->mapping = mapping;
+    drs->mappingSize = drs->fileSize;
+    return 0;
+}
+
+/**
+ * Read more of the archive into the header buffer so that it holds at least
+ * the first `wanted` bytes.
+ **/
+static int drs_index_fill(drs_t* drs, unsigned char** buffer, size_t* have, size_t wanted) {
+    unsigned char* pRealloc = NULL;
+
+    if (wanted <= *have) {
+        return 0;
+    }
+
+    if (wanted > drs->fileSize) {
+        return 10;
+    }
+
+    if (!(pRealloc = realloc(*buffer, wanted))) {
+        return 8;
+    }
+
+    STATS_ALLOC(wanted - *have);
+
+    *buffer = pRealloc;
+
+    if (file_read_at(drs->fd, &(*buffer)[*have], wanted - *have, *have)) {
+        return 11;
+    }
+
+    *have = wanted;
+    return 0;
+}
+
+static int drs_index_abort(drs_t* drs, unsigned char* buffer, int rc) {
+    if (buffer) {
+        free(buffer);
+    }
+
+    file_close_descriptor(drs->fd);
+    drs->fd = -1;
+    return rc;
+}
+
+int drs_open_index(const char* filePath, drs_t* drs) {
+    int idx;
+    int tableCount;
+    int extended;
+    size_t headerSize;
+    size_t tableSize;
+    size_t recordSize;
+    size_t have = 0;
+    size_t headerEnd;
+    drsTableHeader_t tableHeader;
+    unsigned char* buffer = NULL;
+    int rc = 0;
+
+    if (!drs || !filePath) {
+        return 1;
+    }
+
+    drs->storage = DRS_STORAGE_INDEX;
+    drs->mapping = NULL;
+    drs->payloads = NULL;
+    drs->tables = NULL;
+
+    if ((drs->fd = file_open_readonly(filePath, &drs->fileSize)) == -1) {
+        return 2;
+    }
+
+    if (drs->fileSize < DRS_HDR_SIZE) {
+        return drs_index_abort(drs, buffer, 7);
+    }
+
+    STATS_BEGIN(STATS_PHASE_READ);
+
+    /* Most archives have their whole header region within the first page */
+    if ((rc = drs_index_fill(drs, &buffer, &have,
+            drs->fileSize < DRS_INDEX_READ_SIZE ? drs->fileSize : DRS_INDEX_READ_SIZE))) {
+        return drs_index_abort(drs, buffer, rc);
+    }
+
+    /* Table count follows the version, which picks the layout */
+    memcpy(drs->header.version, &buffer[DRS_HDR_COPYRIGHT_LENGTH], DRS_HDR_VERSION_LENGTH);
+    drs->header.version[DRS_HDR_VERSION_LENGTH] = '\0';
+    extended = drs_extended(drs);
+    headerSize = extended ? DRS_EXT_HDR_SIZE : DRS_HDR_SIZE;
+    tableSize = extended ? DRS_EXT_TABLE_HDR_SIZE : DRS_TABLE_HDR_SIZE;
+    recordSize = extended ? DRS_EXT_FILE_HDR_SIZE : DRS_FILE_HDR_SIZE;
+
+    if (drs->fileSize < headerSize) {
+        return drs_index_abort(drs, buffer, 10);
+    }
+
+    tableCount = drs_codec_get32(&buffer[DRS_HDR_COPYRIGHT_LENGTH + DRS_HDR_VERSION_LENGTH + DRS_HDR_TYPE_LENGTH]);
+    if (tableCount < 0 || (size_t)tableCount > (drs->fileSize - headerSize) / tableSize) {
+        return drs_index_abort(drs, buffer, 10);
+    }
+
+    headerEnd = headerSize + (size_t)tableCount * tableSize;
+    if ((rc = drs_index_fill(drs, &buffer, &have, headerEnd))) {
+        return drs_index_abort(drs, buffer, rc);
+    }
+
+    /* File headers of the last table mark the end of the header region */
+    for (idx = 0; idx < tableCount; ++idx) {
+        if (drs_codec_decode_table(&buffer[headerSize + idx * tableSize], &tableHeader, extended) ||
+            tableHeader.fileCount < 0 || tableHeader.offset > drs->fileSize ||
+            (size_t)tableHeader.fileCount > (drs->fileSize - tableHeader.offset) / recordSize) {
+            return drs_index_abort(drs, buffer, 10);
+        }
+
+        if (tableHeader.offset + (size_t)tableHeader.fileCount * recordSize > headerEnd) {
+            headerEnd = tableHeader.offset + (size_t)tableHeader.fileCount * recordSize;
+        }
+    }
+
+    if ((rc = drs_index_fill(drs, &buffer, &have, headerEnd))) {
+        return drs_index_abort(drs, buffer, rc);
+    }
+
+    STATS_END(STATS_PHASE_READ);
+
+    if ((rc = drs_parse(drs, buffer, have))) {
+        return drs_index_abort(drs, buffer, rc);
+    }
+
+    free(buffer);
+    return 0;
+}
+
+int drs_read_entry(drs_t* drs, int table, int idx, unsigned char* buffer) {
+    drsFile_t *file = NULL;
+
+    if (!drs || !drs->tables || !buffer || table < 0 || table >= drs->header.tableCount ||
+        idx < 0 || idx >= drs->tables[table].header.fileCount) {
+        return 1;
+    }
+
+    file = &drs->tables[table].files[idx];
+
+    if (file->data) {
+        memcpy(buffer, file->data, file->size);
+        return 0;
+    }
+
+    if (drs->storage != DRS_STORAGE_INDEX) {
+        return 2;
+    }
+
+    return file_read_at(drs->fd, buffer, file->size, file->offset) ? 3 : 0;
+}
+
+void drs_free(drs_t* drs) {
+    int i;
+    int ii;
+    drsTable_t *drsTable = NULL;
+
+    if (drs) {
+        if (drs->arena) {
+            /* Loaded archives: all metadata in one block, payloads in another */
+            free(drs->arena);
+            drs->arena = NULL;
+            drs->tables = NULL;
+        } else if (drs->tables) {
+            /* Archives assembled by hand own one block per table and entry */
+            for (i = 0; i < drs->header.tableCount; ++i) {
+                drsTable = &drs->tables[i];
+
+                if (drsTable->files) {
+                    for (ii = 0; ii < drsTable->header.fileCount; ++ii) {
+                        /* Mapped payloads are borrowed, never free them */
+                        if (drs->storage == DRS_STORAGE_OWNED && !drs->payloads && drsTable->files[ii].data) {
+                            free(drsTable->files[ii].data);
+                        }
+
+                        drsTable->files[ii].data = NULL;
+                        drsTable->files[ii].size = 0;
+                    }
+
+                    free(drsTable->files);
+                    drsTable->files = NULL;
+                }
+            }
+
+            free(drs->tables);
+            drs->tables = NULL;
+        }
+
+        if (drs->payloads) {
+            free(drs->payloads);
+            drs->payloads = NULL;
+        }
+
+        drs_index_free(drs);
+
+        if (drs->mapping) {
+            file_unmap(drs->mapping, drs->mappingSize);
+            drs->mapping = NULL;
+            drs->mappingSize = 0;
+        }
+
+        if (drs->storage == DRS_STORAGE_INDEX && drs->fd != -1) {
+            file_close_descriptor(drs->fd);
+            drs->fd = -1;
+        }
+    }
+}
+
+int drs_extended(const drs_t* drs) {
+    return drs && !memcmp(drs->header.version, DRS_EXTENDED_VERSION, DRS_HDR_VERSION_LENGTH);
+}
+
+/* Pick the on-disk layout drs_layout() and drs_create_archive() write */
+void drs_set_extended(drs_t* drs, int extended) {
+    if (drs) {
+        strcpy(drs->header.version, extended ? DRS_EXTENDED_VERSION : DRS_DEFAULT_VERSION);
+    }
+}
+
+/* Copyright for a new archive, printable prefix for display, the rest as stored */
+void drs_set_copyright(drs_t* drs, const char* copyright) {
+    size_t length;
+
+    if (!drs || !copyright) {
+        return;
+    }
+
+    length = strlen(copyright);
+    if (length > DRS_HDR_COPYRIGHT_LENGTH) {
+        length = DRS_HDR_COPYRIGHT_LENGTH;
+    }
+
+    memset(drs->header.copyrightRaw, 0, DRS_HDR_COPYRIGHT_LENGTH);
+    memcpy(drs->header.copyrightRaw, copyright, length);
+
+    length = 0;
+    while (length < DRS_HDR_COPYRIGHT_LENGTH && is_readable_ascii_char(drs->header.copyrightRaw[length])) {
+        drs->header.copyright[length] = drs->header.copyrightRaw[length];
+        ++length;
+    }
+
+    drs->header.copyright[length] = '\0';
+}
+
+/* Largest offset or size the archive's layout can hold, classic ones are signed */
+size_t drs_offset_limit(const drs_t* drs) {
+    return drs_extended(drs) ? (size_t)-1 : INT_MAX;
+}
+
+size_t drs_header_size(drs_t* drs) {
+    int i;
+    size_t size;
+    size_t recordSize;
+
+    if (!drs) {
+        return 0;
+    }
+
+    if (drs_extended(drs)) {
+        size = DRS_EXT_HDR_SIZE + (size_t)drs->header.tableCount * DRS_EXT_TABLE_HDR_SIZE;
+        recordSize = DRS_EXT_FILE_HDR_SIZE;
+    } else {
+        size = DRS_HDR_SIZE + (size_t)drs->header.tableCount * DRS_TABLE_HDR_SIZE;
+        recordSize = DRS_FILE_HDR_SIZE;
+    }
+
+    for (i = 0; i < drs->header.tableCount; ++i) {
+        size += (size_t)drs->tables[i].header.fileCount * recordSize;
+    }
+
+    return size;
+}
+
+size_t drs_encode_headers(drs_t* drs, unsigned char* buffer) {
+    size_t bufferOffset;
+    int extended = drs_extended(drs);
+    int i;
+
+    /* Copy header */
+    memcpy(buffer, drs->header.copyrightRaw, DRS_HDR_COPYRIGHT_LENGTH);
+    bufferOffset = DRS_HDR_COPYRIGHT_LENGTH;
+    memcpy(&buffer[bufferOffset], &drs->header.version, DRS_HDR_VERSION_LENGTH);
+    bufferOffset += DRS_HDR_VERSION_LENGTH;
+    memcpy(&buffer[bufferOffset], &drs->header.type, DRS_HDR_TYPE_LENGTH);
+    bufferOffset += DRS_HDR_TYPE_LENGTH;
+    drs_codec_put32(&buffer[bufferOffset], drs->header.tableCount);
+    bufferOffset += sizeof(int);
+
+    if (extended) {
+        drs_codec_put32(&buffer[bufferOffset], 0);
+        drs_codec_put64(&buffer[bufferOffset + sizeof(int)], drs->header.offset);
+        bufferOffset = DRS_EXT_HDR_SIZE;
+    } else {
+        drs_codec_put32(&buffer[bufferOffset], (int)drs->header.offset);
+        bufferOffset = DRS_HDR_SIZE;
+    }
+
+    /* Copy out table headers */
+    for (i = 0; i < drs->header.tableCount; ++i) {
+        drs_codec_encode_table(&drs->tables[i].header, &buffer[bufferOffset], extended);
+        bufferOffset += extended ? DRS_EXT_TABLE_HDR_SIZE : DRS_TABLE_HDR_SIZE;
+    }
+
+    /* Copy out file headers, one run per table */
+    for (i = 0; i < drs->header.tableCount; ++i) {
+        drs_codec_encode_files(drs->tables[i].files, drs->tables[i].header.fileCount,
+                               &buffer[bufferOffset], extended);
+        bufferOffset += (size_t)drs->tables[i].header.fileCount *
+            (extended ? DRS_EXT_FILE_HDR_SIZE : DRS_FILE_HDR_SIZE);
+    }
+
+    return bufferOffset;
+}
+
+int drs_layout_headers(drs_t* drs) {
+    int i;
+    size_t headerSize;
+    size_t tableOffset;
+    size_t recordSize;
+
+    if (!drs || (drs->header.tableCount && !drs->tables)) {
+        return 1;
+    }
+
+    headerSize = drs_header_size(drs);
+
+    if (drs_extended(drs)) {
+        tableOffset = DRS_EXT_HDR_SIZE + (size_t)drs->header.tableCount * DRS_EXT_TABLE_HDR_SIZE;
+        recordSize = DRS_EXT_FILE_HDR_SIZE;
+    } else {
+        tableOffset = DRS_HDR_SIZE + (size_t)drs->header.tableCount * DRS_TABLE_HDR_SIZE;
+        recordSize = DRS_FILE_HDR_SIZE;
+    }
+
+    if (headerSize > drs_offset_limit(drs)) {
+        return 2;
+    }
+
+    drs->header.offset = headerSize;
+
+    /* File headers follow the table headers */
+    for (i = 0; i < drs->header.tableCount; ++i) {
+        drs->tables[i].header.offset = tableOffset;
+        tableOffset += (size_t)drs->tables[i].header.fileCount * recordSize;
+    }
+
+    return 0;
+}
+
+int drs_layout(drs_t* drs) {
+    int i;
+    int ii;
+    size_t offset;
+    size_t limit;
+    int rc;
+
+    if ((rc = drs_layout_headers(drs))) {
+        return rc;
+    }
+
+    /* Payloads follow the header region in header order */
+    offset = drs->header.offset;
+    limit = drs_offset_limit(drs);
+
+    for (i = 0; i < drs->header.tableCount; ++i) {
+        for (ii = 0; ii < drs->tables[i].header.fileCount; ++ii) {
+            if (drs->tables[i].files[ii].size > limit - offset) {
+                return 2;
+            }
+
+            drs->tables[i].files[ii].offset = offset;
+            offset += drs->tables[i].files[ii].size;
+        }
+    }
+
+    drs->fileSize = offset;
+    return 0;
+}
+
+int drs_parse_file_name(const char* name, int* id, char* extension) {
+    char *end = NULL;
+    const char *dot = NULL;
+    long value;
+
+    if (!name || !id || !extension) {
+        return 1;
+    }
+
+    value = strtol(name, &end, 10);
+
+    if (end == name || value < INT_MIN || value > INT_MAX) {
+        return 1;
+    }
+
+    /* Collision names from extraction: <id>_NNN.<ext> */
+    if (*end == '_') {
+        ++end;
+        while (*end >= '0' && *end <= '9') {
+            ++end;
+        }
+    }
+
+    dot = end;
+    if (*dot != '.' || strchr(dot + 1, '.') || strlen(dot + 1) < 1 ||
+        strlen(dot + 1) > DRS_TABLE_HDR_EXT_LENGTH) {
+        return 1;
+    }
+
+    *id = (int)value;
+    memset(extension, 0, DRS_TABLE_HDR_EXT_LENGTH+1);
+    strcpy(extension, dot + 1);
+    return 0;
+}
+
+char drs_file_type(const char* extension) {
+    /* Binary tables are tagged 'a', everything else is a space */
+    return strcmp(extension, "bin") ? ' ' : 'a';
+}
+
+static int drs_create_compare(const void* a, const void* b) {
+    const drsFile_t *lhs = *(const drsFile_t* const*)a;
+    const drsFile_t *rhs = *(const drsFile_t* const*)b;
+
+    if (lhs->offset != rhs->offset) {
+        return lhs->offset < rhs->offset ? -1 : 1;
+    }
+
+    /* Largest first, so entries sharing a payload are written once */
+    return (lhs->size < rhs->size) - (lhs->size > rhs->size);
+}
+
+/* Fill the gap up to the next payload, e.g. alignment padding */
+static int drs_create_pad(int fd, size_t count) {
+    static const unsigned char zeros[4096] = { 0 };
+    size_t chunk;
+
+    while (count) {
+        chunk = count < sizeof(zeros) ? count : sizeof(zeros);
+
+        if (file_write_all(fd, zeros, chunk)) {
+            return 1;
+        }
+
+        count -= chunk;
+    }
+
+    return 0;
+}
+
+/**
+ * Write the archive described by drs. Every payload is written at its
+ * drsFile_t.offset, so the layout is whatever drs_layout() or a repack
+ * decided. Entries may share a payload but must not partially overlap.
+ **/
+int drs_create_archive(drs_t* drs, const char* output) {
+    unsigned char* buffer;
+    size_t bufferOffset;
+    size_t headerSize;
+    size_t tableOffset;
+    size_t limit;
+    size_t lastOffset = 0;
+    size_t lastEnd = 0;
+    int fileCount = 0;
+    int fd;
+    int rc = 0;
+    int i;
+    int ii;
+    drsFile_t **order = NULL;
+
+    if (!drs || !output || !drs->tables) {
+        return 1;
+    }
+
+    headerSize = drs_header_size(drs);
+    limit = drs_offset_limit(drs);
+    tableOffset = drs_extended(drs) ?
+        DRS_EXT_HDR_SIZE + (size_t)drs->header.tableCount * DRS_EXT_TABLE_HDR_SIZE :
+        DRS_HDR_SIZE + (size_t)drs->header.tableCount * DRS_TABLE_HDR_SIZE;
+
+    if (drs->header.tableCount && drs->tables[0].header.offset != tableOffset) {
+        fprintf(stderr, "DRS table offset mismatched. Expected 0x%08zX, got 0x%08zX\n.",
+                tableOffset, drs->tables[0].header.offset);
+        return 4;
+    }
+
+    for (i = 0; i < drs->header.tableCount; ++i) {
+        fileCount += drs->tables[i].header.fileCount;
+    }
+
+    if ((buffer = malloc(headerSize)) == NULL) {
+        return 3;
+    }
+
+    if ((order = malloc((fileCount ? fileCount : 1) * sizeof(drsFile_t*))) == NULL) {
+        free(buffer);
+        return 3;
+    }
+
+    STATS_ALLOC(headerSize);
+    STATS_ALLOC((fileCount ? fileCount : 1) * sizeof(drsFile_t*));
+    STATS_BEGIN(STATS_PHASE_WRITE);
+
+    fileCount = 0;
+    for (i = 0; i < drs->header.tableCount; ++i) {
+        for (ii = 0; ii < drs->tables[i].header.fileCount; ++ii) {
+            if (drs->tables[i].files[ii].size && !drs->tables[i].files[ii].data) {
+                /* Index-only archives have nothing to write from */
+                free(order);
+                free(buffer);
+                return 1;
+            }
+
+            if (drs->tables[i].files[ii].size) {
+                order[fileCount++] = &drs->tables[i].files[ii];
+            }
+        }
+    }
+
+    qsort(order, fileCount, sizeof(drsFile_t*), drs_create_compare);
+
+    /* Payloads must sit behind the header region and may only overlap exactly */
+    lastEnd = headerSize;
+    for (i = 0; i < fileCount; ++i) {
+        if (order[i]->offset > limit || order[i]->size > limit - order[i]->offset) {
+            fprintf(stderr, "DRS file %d at 0x%zX does not fit a %s archive.\n",
+                    order[i]->id, order[i]->offset, drs_extended(drs) ? "extended" : "classic");
+            free(order);
+            free(buffer);
+            return 2;
+        }
+
+        if (order[i]->offset < lastEnd && (order[i]->offset != lastOffset ||
+                i == 0 || order[i]->offset + order[i]->size > lastEnd)) {
+            fprintf(stderr, "DRS file %d at 0x%zX overlaps the previous entry.\n",
+                    order[i]->id, order[i]->offset);
+            free(order);
+            free(buffer);
+            return 2;
+        }
+
+        if (order[i]->offset >= lastEnd) {
+            lastOffset = order[i]->offset;
+            lastEnd = lastOffset + order[i]->size;
+        }
+    }
+
+    /* Copy out header, table headers and file headers */
+    bufferOffset = drs_encode_headers(drs, buffer);
+
+    if ((fd = file_create(output)) == -1) {
+        fprintf(stderr, "Failed to create DRS file %s\n", output);
+        free(order);
+        free(buffer);
+        return 5;
+    }
+
+    if (file_write_all(fd, buffer, bufferOffset)) {
+        rc = 5;
+    }
+
+    /* Stream out raw file data in file order */
+    for (i = 0; i < fileCount && !rc; ++i) {
+        if (order[i]->offset < bufferOffset) {
+            continue;
+        }
+
+        if (drs_create_pad(fd, order[i]->offset - bufferOffset) ||
+            file_write_all(fd, order[i]->data, order[i]->size)) {
+            rc = 5;
+        }
+
+        bufferOffset = order[i]->offset + order[i]->size;
+    }
+
+    if (file_close_descriptor(fd) && !rc) {
+        rc = 5;
+    }
+
+    STATS_END(STATS_PHASE_WRITE);
+
+    if (rc) {
+        fprintf(stderr, "Failed to create DRS file %s\n", output);
+    } else {
+        drs->fileSize = bufferOffset;
+    }
+
+    free(order);
+    free(buffer);
+    buffer = NULL;
+
+    return rc;
+}
+
+void drs_print_header(drs_t* drs, FILE* out) {
+    int i;
+
+    if (!drs || !out) {
+        return;
+    }
+
+    fprintf(out, "%20s  %s\n%20s  %s\n%20s  %s\n%20s  %d\n%20s  0x%zX\n%20s  %zu\n", "Copyright info:", drs->header.copyright,
+        "File version:", drs->header.version, "Archive type:", drs->header.type, "Num. tables in file:", drs->header.tableCount,
+        "1st file offset:", drs->header.offset, "File size:", drs->fileSize);
+
+    /* Lookups resolve to the first entry in header order */
+    if (drs->index.duplicates) {
+        fprintf(out, "%20s  %d (first occurrence wins)\n", "Duplicate file IDs:", drs->index.duplicates);
+    }
+
+    fprintf(out, "\n");
+    
+    for (i = 0; i < drs->header.tableCount; ++i) {
+        fprintf(out, "TABLE %d:\n\n", i);
+        drs_print_table(&drs->tables[i], out);
+    }
+}
+
+void drs_print_table(drsTable_t* table, FILE* out) {
+#if 0
+    int i;
+#endif
+
+    if (!table || !out) {
+        return;
+    }
+
+    fprintf(out, "\t%20s  0x%02X (%c)\n\t%20s  %s\n\t%20s  0x%zX\n\t%20s  %d\n\n\t%20s\n\n", "File type ID:", table->header.fileType, table->header.fileType,
+        "Extension:", table->header.extension, "Table offset:", table->header.offset, "File count:", table->header.fileCount, "Files:");
+
+#if 0
+    for (i = 0; i < table->header.fileCount; ++i) {
+        drs_print_file_headers(&table->files[i], out);
+    }
+#endif
+}
+
+void drs_print_file_headers(drsFile_t* file, FILE* out) {
+    if (!file || !out) {
+        return;
+    }
+
+    fprintf(out, "\t\t%20s  %04d\n\t\t%20s  0x%zX\n\t\t%20s  %11zu\n\n", "File ID:", file->id, "File Offset:", file->offset, "File Size:", file->size);
+}
@@ -1,65 +1,262 @@
-#ifndef DRS_FORMAT_H
-#define DRS_FORMAT_H
-
-#include <stdio.h>
-
-/*
-https://gist.github.com/Phrohdoh/4186ec07191c2e3d3221
-
-[HEADER]
-[tableCount tableHdrs]
-[fileCount  fileHdrs]
-[file 1]
-[file n]
-*/
-
-#define DRS_HDR_COPYRIGHT_LENGTH 40
-#define DRS_HDR_VERSION_LENGTH    4
-#define DRS_HDR_TYPE_LENGTH      12
-#define DRS_TABLE_HDR_EXT_LENGTH  3
-
-typedef struct s_drsHeader {
-    char copyright[DRS_HDR_COPYRIGHT_LENGTH+1];  // Copyright information
-    char version[DRS_HDR_VERSION_LENGTH+1];      // File Version
-    char type[DRS_HDR_TYPE_LENGTH+1];            // Archive Type
-    int  tableCount;                             // Num tables in file
-    int  offset;                                 // Offset of 1st file
-} drsHeader_t, *pDrsHeader_t;
-
-typedef struct s_drsTableHeader {
-    char fileType;                               // Related to file type
-    char extension[DRS_TABLE_HDR_EXT_LENGTH+1];  // File Extension (reversed in file)
-    int  offset;                                 // Table Offset
-    int  fileCount;                              // Num files in table
-} drsTableHeader_t, *pDrsTableHeader_t;
-
-typedef struct s_drsFile {
-    int            id;                           // Unique file ID
-    int            offset;                       // File Offset
-    int            size;                         // File Size
-    unsigned char* data;                         // Raw file data
-} drsFile_t, *pDrsFile_t;
-
-typedef struct s_drsTable {
-    drsTableHeader_t   header;
-    pDrsFile_t   files;
-} drsTable_t, *pDrsTable_t;
-
-typedef struct s_drs {
-    drsHeader_t  header;
-    pDrsTable_t  tables;
-    size_t       fileSize;
-} drs_t, *pDrs_t;
-
-void drs_init_empty(pDrs_t drs);
-int drs_load(const char* filePath, drs_t* drs);
-void drs_free(drs_t* drs);
-
-int drs_create_archive(drs_t* drs, const char* output);
-int drs_extract_archive(drs_t* drs, const char* dir);
-
-void drs_print_header(drs_t* drs, FILE* out);
-void drs_print_table(drsTable_t* table, FILE* out);
-void drs_print_file_headers(drsFile_t* file, FILE* out);
-
-#endif
+#ifndef DRS_FORMAT_H
+#define DRS_FORMAT_H
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+https://gist.github.com/Phrohdoh/4186ec07191c2e3d3221
+
+[HEADER]
+[tableCount tableHdrs]
+[fileCount  fileHdrs]
+[file 1]
+[file n]
+
+Extended variant, version DRS_EXTENDED_VERSION: the same layout with 64-bit
+offsets and sizes, so archives can grow beyond 2 GB. All little-endian.
+
+header  copyright, version, type, tableCount(4), reserved(4), offset(8)
+table   type(1), extension(3), offset(8), fileCount(4)
+file    id(4), offset(8), size(8)
+*/
+
+#define DRS_HDR_COPYRIGHT_LENGTH 40
+#define DRS_HDR_VERSION_LENGTH    4
+#define DRS_HDR_TYPE_LENGTH      12
+#define DRS_TABLE_HDR_EXT_LENGTH  3
+#define DRS_HDR_SIZE             64
+#define DRS_TABLE_HDR_SIZE       12
+#define DRS_FILE_HDR_SIZE        12
+#define DRS_EXT_HDR_SIZE         72
+#define DRS_EXT_TABLE_HDR_SIZE   16
+#define DRS_EXT_FILE_HDR_SIZE    20
+#define DRS_INDEX_READ_SIZE    4096
+
+#define DRS_DEFAULT_COPYRIGHT "Copyright (c) 1997 Ensemble Studios.\x1a"
+#define DRS_DEFAULT_VERSION   "1.00"
+#define DRS_EXTENDED_VERSION  "2.00"
+#define DRS_DEFAULT_TYPE      "tribe"
+
+typedef enum e_drsStorage {
+    DRS_STORAGE_OWNED = 0,                       // Payloads owned by the drs_t
+    DRS_STORAGE_MAPPED,                          // Payloads borrowed from a read-only mapping
+    DRS_STORAGE_INDEX                            // Headers only, payloads read on demand
+} drsStorage_t;
+
+typedef struct s_drsHeader {
+    char copyright[DRS_HDR_COPYRIGHT_LENGTH+1];  // Copyright information
+    char copyrightRaw[DRS_HDR_COPYRIGHT_LENGTH]; // Copyright bytes as stored, written back verbatim
+    char version[DRS_HDR_VERSION_LENGTH+1];      // File Version
+    char type[DRS_HDR_TYPE_LENGTH+1];            // Archive Type
+    int  tableCount;                             // Num tables in file
+    size_t offset;                               // Offset of 1st file
+} drsHeader_t, *pDrsHeader_t;
+
+typedef struct s_drsTableHeader {
+    char fileType;                               // Related to file type
+    char extension[DRS_TABLE_HDR_EXT_LENGTH+1];  // File Extension (reversed in file)
+    size_t offset;                               // Table Offset
+    int  fileCount;                              // Num files in table
+} drsTableHeader_t, *pDrsTableHeader_t;
+
+typedef struct s_drsFile {
+    int            id;                           // Unique file ID
+    size_t         offset;                       // File Offset
+    size_t         size;                         // File Size
+    unsigned char* data;                         // Raw file data
+} drsFile_t, *pDrsFile_t;
+
+typedef struct s_drsTable {
+    drsTableHeader_t   header;
+    pDrsFile_t   files;
+} drsTable_t, *pDrsTable_t;
+
+typedef struct s_drsIndexEntry {
+    int          id;                             // File ID
+    int          table;                          // Table the file lives in
+    int          file;                           // Position in table
+} drsIndexEntry_t, *pDrsIndexEntry_t;
+
+typedef struct s_drsIndex {
+    pDrsIndexEntry_t entries;                    // Sorted by ID, then header order
+    int          count;
+    int          duplicates;                     // Repeated ID+extension pairs
+} drsIndex_t, *pDrsIndex_t;
+
+typedef struct s_drs {
+    drsHeader_t  header;
+    pDrsTable_t  tables;
+    drsIndex_t   index;
+    size_t       fileSize;
+    drsStorage_t storage;
+    unsigned char* arena;                        // Tables and file headers, NULL if built by hand
+    unsigned char* payloads;                     // Archive image owning every payload, drs_load only
+    unsigned char* mapping;                      // Archive mapping, NULL unless mapped
+    size_t       mappingSize;
+    int          fd;                             // Archive descriptor, index mode only
+} drs_t, *pDrs_t;
+
+typedef struct s_drsIdRange {
+    int          first;
+    int          last;                           // Inclusive
+} drsIdRange_t, *pDrsIdRange_t;
+
+/* Each non-empty list must match; values within a list are alternatives */
+typedef struct s_drsFilter {
+    char         (*extensions)[DRS_TABLE_HDR_EXT_LENGTH+1];
+    int          extensionCount;
+    pDrsIdRange_t ranges;
+    int          rangeCount;
+    int*         tables;
+    int          tableCount;
+} drsFilter_t, *pDrsFilter_t;
+
+typedef struct s_drsExtractOptions {
+    int          jobs;                           // Worker threads, 0 for one per CPU
+    const drsFilter_t* filter;                   // Entries to extract, NULL for all
+    int          coalesce;                       // Index mode: one read per run of adjacent entries
+} drsExtractOptions_t, *pDrsExtractOptions_t;
+
+typedef enum e_drsChangeType {
+    DRS_CHANGE_PUT = 0,                          // Add, or replace the first matching entry
+    DRS_CHANGE_REMOVE
+} drsChangeType_t;
+
+typedef struct s_drsChange {
+    drsChangeType_t type;
+    int          id;
+    char         extension[DRS_TABLE_HDR_EXT_LENGTH+1];
+    const char*  filePath;                       // Payload source for puts, or
+    const unsigned char* data;                   // in-memory payload when filePath is NULL
+    size_t       size;
+} drsChange_t, *pDrsChange_t;
+
+typedef struct s_drsCreateOptions {
+    int          dedup;                          // Store identical payloads once
+    int          extended;                       // Write the 64-bit variant
+    int          jobs;                           // Hashing threads, 0 for one per CPU
+} drsCreateOptions_t, *pDrsCreateOptions_t;
+
+typedef struct s_drsCreateStats {
+    size_t       size;                           // Archive size
+    size_t       deduplicated;                   // Bytes saved by sharing identical payloads
+} drsCreateStats_t, *pDrsCreateStats_t;
+
+typedef struct s_drsWatchOptions {
+    int          jobs;                           // Threads for the initial build and sidecar
+    int          sidecar;                        // Rewrite the hash index after every update
+} drsWatchOptions_t, *pDrsWatchOptions_t;
+
+typedef enum e_drsRepackOrder {
+    DRS_REPACK_ORDER_HEADER = 0,                 // Payloads follow the file headers
+    DRS_REPACK_ORDER_ID,                         // By table, then file ID
+    DRS_REPACK_ORDER_TRACE                       // Trace first, the rest by table and ID
+} drsRepackOrder_t;
+
+typedef struct s_drsRepackOptions {
+    drsRepackOrder_t order;
+    const char*  traceFile;                      // One <id>.<ext> per line, in access order
+    size_t       alignment;                      // Payload alignment, 0 for none
+    int          dedup;                          // Store identical payloads once
+} drsRepackOptions_t, *pDrsRepackOptions_t;
+
+typedef struct s_drsRepackStats {
+    size_t       oldSize;
+    size_t       newSize;
+    size_t       padding;                        // Bytes spent on alignment
+    size_t       deduplicated;                   // Bytes saved by sharing identical payloads
+    int          seeksBefore;                    // Non-sequential reads in access order
+    int          seeksAfter;
+} drsRepackStats_t, *pDrsRepackStats_t;
+
+typedef enum e_drsListFormat {
+    DRS_LIST_TSV = 0,                            // Header line, then one entry per line
+    DRS_LIST_JSON,                               // One array of entry objects
+    DRS_LIST_BINARY                              // Little-endian records, see DRSList.c
+} drsListFormat_t;
+
+typedef struct s_drsDiffStats {
+    int          added;
+    int          removed;
+    int          changed;
+    int          unchanged;
+    size_t       payloadBytes;                   // New and changed payloads, as stored in the archive
+    size_t       patchSize;
+} drsDiffStats_t, *pDrsDiffStats_t;
+
+typedef struct s_drsVerifyReport {
+    int          quick;                          // Confirmed from header, size and mtime alone
+    int          entries;
+    int          mismatches;
+} drsVerifyReport_t, *pDrsVerifyReport_t;
+
+void drs_init_empty(pDrs_t drs);
+int drs_load(const char* filePath, drs_t* drs);
+int drs_open_mapped(const char* filePath, drs_t* drs);
+int drs_open_index(const char* filePath, drs_t* drs);
+int drs_read_entry(drs_t* drs, int table, int idx, unsigned char* buffer);
+
+int drs_index_build(drs_t* drs);
+void drs_index_free(drs_t* drs);
+pDrsFile_t drs_find(drs_t* drs, int id, const char* extension, pDrsTable_t* table);
+void drs_free(drs_t* drs);
+
+int drs_extended(const drs_t* drs);
+void drs_set_extended(drs_t* drs, int extended);
+void drs_set_copyright(drs_t* drs, const char* copyright);
+size_t drs_offset_limit(const drs_t* drs);
+size_t drs_header_size(drs_t* drs);
+size_t drs_encode_headers(drs_t* drs, unsigned char* buffer);
+int drs_layout_headers(drs_t* drs);
+int drs_layout(drs_t* drs);
+
+/* Header codec (DRSCodec.c): little-endian words regardless of host order */
+int drs_codec_get32(const unsigned char* in);
+void drs_codec_put32(unsigned char* out, int value);
+unsigned long long drs_codec_get64(const unsigned char* in);
+void drs_codec_put64(unsigned char* out, unsigned long long value);
+int drs_codec_decode_table(const unsigned char* in, drsTableHeader_t* header, int extended);
+void drs_codec_encode_table(const drsTableHeader_t* header, unsigned char* out, int extended);
+int drs_codec_decode_files(const unsigned char* in, drsFile_t* files, size_t count, int extended);
+void drs_codec_encode_files(const drsFile_t* files, size_t count, unsigned char* out, int extended);
+
+int drs_parse_file_name(const char* name, int* id, char* extension);
+char drs_file_type(const char* extension);
+
+int drs_create_archive(drs_t* drs, const char* output);
+int drs_create_from_directory(const char* dir, const char* output,
+    const drsCreateOptions_t* options, drsCreateStats_t* stats);
+int drs_create_from_tar(int fd, const char* output, drsCreateStats_t* stats);
+int drs_export_tar(drs_t* drs, int fd, const drsFilter_t* filter);
+int drs_update_archive(const char* archive, const drsChange_t* changes, size_t count);
+int drs_watch(const char* dir, const char* output, const drsWatchOptions_t* options);
+int drs_repack(drs_t* drs, const drsRepackOptions_t* options, drsRepackStats_t* stats);
+int drs_diff(drs_t* from, drs_t* to, const char* patchPath, drsDiffStats_t* stats);
+int drs_patch(const char* archive, const char* patchPath, drsDiffStats_t* stats);
+
+int drs_sidecar_write(drs_t* drs, const char* archivePath, int jobs);
+int drs_verify(const char* archivePath, int full, int jobs, drsVerifyReport_t* report);
+void drs_filter_init(drsFilter_t* filter);
+int drs_filter_add_extensions(drsFilter_t* filter, const char* list);
+int drs_filter_add_ids(drsFilter_t* filter, const char* list);
+int drs_filter_add_tables(drsFilter_t* filter, const char* list);
+int drs_filter_empty(const drsFilter_t* filter);
+int drs_filter_match(const drsFilter_t* filter, drs_t* drs, int table, int file);
+void drs_filter_free(drsFilter_t* filter);
+int drs_extract_archive(drs_t* drs, const char* dir);
+int drs_extract_archive_ex(drs_t* drs, const char* dir, const drsExtractOptions_t* options);
+
+int drs_list_entries(drs_t* drs, drsListFormat_t format, int fd);
+void drs_print_header(drs_t* drs, FILE* out);
+void drs_print_table(drsTable_t* table, FILE* out);
+void drs_print_file_headers(drsFile_t* file, FILE* out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
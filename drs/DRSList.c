@@ -0,0 +1,247 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "FileManager.h"
+#include "Stats.h"
+#include "DRSFormat.h"
+
+#define DRS_LIST_BUFFER_SIZE (256 * 1024)
+#define DRS_LIST_PREFIX_SIZE 80                  // Longest per-table prefix, escapes included
+#define DRS_LIST_MAGIC       "DRSL"
+#define DRS_LIST_VERSION     1
+#define DRS_LIST_VERSION_EXT 2
+
+/**
+ * Binary listing, every integer a little-endian 32-bit word:
+ *
+ * [magic "DRSL"] [version] [tableCount] [entryCount]
+ * [tableCount x: extension (3 bytes + NUL), fileType, fileCount]
+ * [entryCount x: table, id, offset, size]
+ *
+ * Entries are in header order, table after table. Extended archives are
+ * listed as version 2, where offset and size are 64-bit, low word first.
+ **/
+
+typedef struct s_drsListWriter {
+    int          fd;
+    unsigned char* buffer;
+    size_t       used;
+    int          rc;                             // First write error, sticky
+} drsListWriter_t, *pDrsListWriter_t;
+
+static void drs_list_flush(pDrsListWriter_t writer) {
+    if (!writer->rc && writer->used && file_write_all(writer->fd, writer->buffer, writer->used)) {
+        writer->rc = 7;
+    }
+
+    writer->used = 0;
+}
+
+/* Room for at least size more bytes; size never exceeds the buffer */
+static unsigned char* drs_list_reserve(pDrsListWriter_t writer, size_t size) {
+    if (writer->used + size > DRS_LIST_BUFFER_SIZE) {
+        drs_list_flush(writer);
+    }
+
+    return &writer->buffer[writer->used];
+}
+
+static void drs_list_put(pDrsListWriter_t writer, const char* data, size_t size) {
+    memcpy(drs_list_reserve(writer, size), data, size);
+    writer->used += size;
+}
+
+/* Decimal without going through stdio */
+static void drs_list_put_decimal(pDrsListWriter_t writer, unsigned long long magnitude, int negative) {
+    char digits[21];
+    unsigned char *out = drs_list_reserve(writer, sizeof(digits));
+    int count = 0;
+
+    do {
+        digits[count++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+
+    if (negative) {
+        *out++ = '-';
+        ++writer->used;
+    }
+
+    writer->used += count;
+
+    while (count) {
+        *out++ = (unsigned char)digits[--count];
+    }
+}
+
+static void drs_list_put_int(pDrsListWriter_t writer, int value) {
+    drs_list_put_decimal(writer, value < 0 ? 0u - (unsigned int)value : (unsigned int)value, value < 0);
+}
+
+static void drs_list_put_word(pDrsListWriter_t writer, int value) {
+    unsigned int word = (unsigned int)value;
+    unsigned char *out = drs_list_reserve(writer, 4);
+
+    out[0] = (unsigned char)(word & 0xFF);
+    out[1] = (unsigned char)((word >> 8) & 0xFF);
+    out[2] = (unsigned char)((word >> 16) & 0xFF);
+    out[3] = (unsigned char)((word >> 24) & 0xFF);
+    writer->used += 4;
+}
+
+/* Extensions are raw header bytes: JSON escapes them, TSV swaps out control characters */
+static size_t drs_list_extension(const char* extension, int json, char* out) {
+    static const char hex[] = "0123456789abcdef";
+    size_t length = 0;
+    unsigned char c;
+    int i;
+
+    for (i = 0; i < DRS_TABLE_HDR_EXT_LENGTH && extension[i]; ++i) {
+        c = (unsigned char)extension[i];
+
+        if (json && (c == '"' || c == '\\')) {
+            out[length++] = '\\';
+            out[length++] = (char)c;
+        } else if (json && (c < 0x20 || c >= 0x7F)) {
+            out[length++] = '\\';
+            out[length++] = 'u';
+            out[length++] = '0';
+            out[length++] = '0';
+            out[length++] = hex[c >> 4];
+            out[length++] = hex[c & 0xF];
+        } else {
+            out[length++] = (c < 0x20 || c == 0x7F) ? '?' : (char)c;
+        }
+    }
+
+    return length;
+}
+
+static void drs_list_text(drs_t* drs, pDrsListWriter_t writer, int json) {
+    char prefix[DRS_LIST_PREFIX_SIZE];
+    size_t prefixLength;
+    drsFile_t *file = NULL;
+    int i;
+    int ii;
+    int first = 1;
+
+    if (json) {
+        drs_list_put(writer, "[\n", 2);
+    } else {
+        drs_list_put(writer, "table\textension\tid\toffset\tsize\n", 31);
+    }
+
+    for (i = 0; i < drs->header.tableCount; ++i) {
+        /* Everything up to the ID is the same for the whole table */
+        prefixLength = (size_t)sprintf(prefix, json ? "{\"table\":%d,\"extension\":\"" : "%d\t", i);
+        prefixLength += drs_list_extension(drs->tables[i].header.extension, json, &prefix[prefixLength]);
+        strcpy(&prefix[prefixLength], json ? "\",\"id\":" : "\t");
+        prefixLength += strlen(&prefix[prefixLength]);
+
+        for (ii = 0; ii < drs->tables[i].header.fileCount; ++ii) {
+            file = &drs->tables[i].files[ii];
+
+            if (json && !first) {
+                drs_list_put(writer, ",\n", 2);
+            }
+
+            drs_list_put(writer, prefix, prefixLength);
+            drs_list_put_int(writer, file->id);
+            drs_list_put(writer, json ? ",\"offset\":" : "\t", json ? 10 : 1);
+            drs_list_put_decimal(writer, file->offset, 0);
+            drs_list_put(writer, json ? ",\"size\":" : "\t", json ? 8 : 1);
+            drs_list_put_decimal(writer, file->size, 0);
+            drs_list_put(writer, json ? "}" : "\n", 1);
+            first = 0;
+        }
+    }
+
+    if (json) {
+        drs_list_put(writer, first ? "]\n" : "\n]\n", first ? 2 : 3);
+    }
+}
+
+static void drs_list_binary(drs_t* drs, pDrsListWriter_t writer) {
+    char extension[DRS_TABLE_HDR_EXT_LENGTH+1];
+    drsFile_t *file = NULL;
+    unsigned char *out = NULL;
+    int extended = drs_extended(drs);
+    int entries = 0;
+    int i;
+    int ii;
+
+    for (i = 0; i < drs->header.tableCount; ++i) {
+        entries += drs->tables[i].header.fileCount;
+    }
+
+    drs_list_put(writer, DRS_LIST_MAGIC, 4);
+    drs_list_put_word(writer, extended ? DRS_LIST_VERSION_EXT : DRS_LIST_VERSION);
+    drs_list_put_word(writer, drs->header.tableCount);
+    drs_list_put_word(writer, entries);
+
+    for (i = 0; i < drs->header.tableCount; ++i) {
+        memset(extension, 0, sizeof(extension));
+        memcpy(extension, drs->tables[i].header.extension, DRS_TABLE_HDR_EXT_LENGTH);
+        drs_list_put(writer, extension, sizeof(extension));
+        drs_list_put_word(writer, (unsigned char)drs->tables[i].header.fileType);
+        drs_list_put_word(writer, drs->tables[i].header.fileCount);
+    }
+
+    for (i = 0; i < drs->header.tableCount; ++i) {
+        for (ii = 0; ii < drs->tables[i].header.fileCount; ++ii) {
+            file = &drs->tables[i].files[ii];
+            drs_list_put_word(writer, i);
+            drs_list_put_word(writer, file->id);
+
+            if (extended) {
+                out = drs_list_reserve(writer, 16);
+                drs_codec_put64(out, file->offset);
+                drs_codec_put64(&out[8], file->size);
+                writer->used += 16;
+            } else {
+                drs_list_put_word(writer, (int)file->offset);
+                drs_list_put_word(writer, (int)file->size);
+            }
+        }
+    }
+}
+
+/**
+ * Every entry of the archive to fd. Only headers are read, so an archive
+ * opened with drs_open_index() is enough. Output goes through one buffer
+ * flushed with large writes.
+ **/
+int drs_list_entries(drs_t* drs, drsListFormat_t format, int fd) {
+    drsListWriter_t writer;
+
+    if (!drs || (drs->header.tableCount && !drs->tables) || fd < 0) {
+        return 1;
+    }
+
+    if (format != DRS_LIST_TSV && format != DRS_LIST_JSON && format != DRS_LIST_BINARY) {
+        return 1;
+    }
+
+    writer.fd = fd;
+    writer.used = 0;
+    writer.rc = 0;
+
+    if (!(writer.buffer = malloc(DRS_LIST_BUFFER_SIZE))) {
+        return 4;
+    }
+
+    STATS_BEGIN(STATS_PHASE_WRITE);
+
+    if (format == DRS_LIST_BINARY) {
+        drs_list_binary(drs, &writer);
+    } else {
+        drs_list_text(drs, &writer, format == DRS_LIST_JSON);
+    }
+
+    drs_list_flush(&writer);
+
+    STATS_END(STATS_PHASE_WRITE);
+
+    free(writer.buffer);
+    return writer.rc;
+}
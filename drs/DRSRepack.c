@@ -0,0 +1,338 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "FileManager.h"
+#include "Hash.h"
+#include "DRSFormat.h"
+
+typedef struct s_drsRepackRef {
+    int          table;
+    int          file;
+    int          id;
+    int          rank;                           // Position in the access trace
+    int          sortRank;                       // Sort keys for the current pass
+    int          sortId;
+    size_t       oldOffset;
+    size_t       size;
+    int          leader;                         // Ref that owns a shared payload
+    hash64_t     hash;                           // Payload hash, dedup only
+} drsRepackRef_t, *pDrsRepackRef_t;
+
+static int drs_repack_compare(const void* a, const void* b) {
+    const drsRepackRef_t *lhs = a;
+    const drsRepackRef_t *rhs = b;
+
+    if (lhs->sortRank != rhs->sortRank) {
+        return lhs->sortRank < rhs->sortRank ? -1 : 1;
+    }
+
+    if (lhs->table != rhs->table) {
+        return lhs->table < rhs->table ? -1 : 1;
+    }
+
+    if (lhs->sortId != rhs->sortId) {
+        return lhs->sortId < rhs->sortId ? -1 : 1;
+    }
+
+    return (lhs->file > rhs->file) - (lhs->file < rhs->file);
+}
+
+static void drs_repack_sort(pDrsRepackRef_t refs, int count, int byTrace, int byId) {
+    int i;
+
+    for (i = 0; i < count; ++i) {
+        refs[i].sortRank = byTrace ? refs[i].rank : 0;
+        refs[i].sortId = byId ? refs[i].id : 0;
+    }
+
+    qsort(refs, count, sizeof(drsRepackRef_t), drs_repack_compare);
+}
+
+/* Shared payloads group by old range, the earliest placed ref leads */
+static int drs_repack_compare_range(const void* a, const void* b) {
+    const drsRepackRef_t *lhs = *(const drsRepackRef_t* const*)a;
+    const drsRepackRef_t *rhs = *(const drsRepackRef_t* const*)b;
+
+    if (lhs->oldOffset != rhs->oldOffset) {
+        return lhs->oldOffset < rhs->oldOffset ? -1 : 1;
+    }
+
+    if (lhs->size != rhs->size) {
+        return lhs->size < rhs->size ? -1 : 1;
+    }
+
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+/* Candidate duplicates group by size and hash, earliest placed first */
+static int drs_repack_compare_content(const void* a, const void* b) {
+    const drsRepackRef_t *lhs = *(const drsRepackRef_t* const*)a;
+    const drsRepackRef_t *rhs = *(const drsRepackRef_t* const*)b;
+
+    if (lhs->size != rhs->size) {
+        return lhs->size < rhs->size ? -1 : 1;
+    }
+
+    if (lhs->hash != rhs->hash) {
+        return lhs->hash < rhs->hash ? -1 : 1;
+    }
+
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+/**
+ * Points every payload leader at the earliest placed leader with identical
+ * bytes. Hashes only pick candidates, a full compare decides.
+ **/
+static size_t drs_repack_dedup(drs_t* drs, pDrsRepackRef_t refs, pDrsRepackRef_t* byContent, int count) {
+    int i;
+    int ii;
+    int start;
+    int leaders = 0;
+    size_t saved = 0;
+    pDrsRepackRef_t ref = NULL;
+    pDrsRepackRef_t other = NULL;
+
+    for (i = 0; i < count; ++i) {
+        /* Index-only archives carry no payloads to compare */
+        if (refs[i].leader != i || !refs[i].size || !drs->tables[refs[i].table].files[refs[i].file].data) {
+            continue;
+        }
+
+        refs[i].hash = hash_xxh64(drs->tables[refs[i].table].files[refs[i].file].data, refs[i].size, 0);
+        byContent[leaders++] = &refs[i];
+    }
+
+    qsort(byContent, leaders, sizeof(pDrsRepackRef_t), drs_repack_compare_content);
+
+    for (start = 0, i = 1; i < leaders; ++i) {
+        ref = byContent[i];
+
+        if (ref->size != byContent[start]->size || ref->hash != byContent[start]->hash) {
+            start = i;
+            continue;
+        }
+
+        for (ii = start; ii < i; ++ii) {
+            other = byContent[ii];
+
+            if (other->leader == other - refs &&
+                !memcmp(drs->tables[other->table].files[other->file].data,
+                    drs->tables[ref->table].files[ref->file].data, ref->size)) {
+                ref->leader = (int)(other - refs);
+                saved += ref->size;
+                break;
+            }
+        }
+    }
+
+    return saved;
+}
+
+/**
+ * Jumps between consecutive reads when fetching payloads in access order.
+ * Gaps shorter than the alignment are padding a sequential reader runs over.
+ **/
+static int drs_repack_count_seeks(drs_t* drs, pDrsRepackRef_t refs, int count, int useOld, size_t alignment) {
+    int i;
+    int seeks = 0;
+    int started = 0;
+    size_t offset;
+    size_t end = 0;
+
+    for (i = 0; i < count; ++i) {
+        if (!refs[i].size) {
+            continue;
+        }
+
+        offset = useOld ? refs[i].oldOffset : drs->tables[refs[i].table].files[refs[i].file].offset;
+
+        if (started && (offset < end || offset - end >= alignment)) {
+            ++seeks;
+        }
+
+        started = 1;
+        end = offset + refs[i].size;
+    }
+
+    return seeks;
+}
+
+static int drs_repack_read_trace(drs_t* drs, const char* traceFile, pDrsRepackRef_t refs, const int* tableStart) {
+    FILE *fd = NULL;
+    char *line = NULL;
+    size_t bytes = 0;
+    int rank = 0;
+    int id;
+    char extension[DRS_TABLE_HDR_EXT_LENGTH+1];
+    drsTable_t *table = NULL;
+    drsFile_t *file = NULL;
+    pDrsRepackRef_t ref = NULL;
+
+    if ((fd = file_open(traceFile, "r")) == NULL) {
+        fprintf(stderr, "Failed to open trace file %s\n", traceFile);
+        return 6;
+    }
+
+    while (!feof(fd)) {
+        line = NULL;
+        bytes = 0;
+
+        if (fm_getline(&line, &bytes, fd) && bytes) {
+            if (line[bytes - 1] == '\r') {
+                line[bytes - 1] = '\0';
+            }
+
+            if (!drs_parse_file_name(line, &id, extension) &&
+                (file = drs_find(drs, id, extension, &table)) != NULL) {
+                ref = &refs[tableStart[table - drs->tables] + (file - table->files)];
+
+                if (ref->rank == INT_MAX) {
+                    ref->rank = rank++;
+                }
+            }
+        }
+
+        if (line) {
+            free(line);
+        }
+    }
+
+    file_close(fd);
+    return 0;
+}
+
+int drs_repack(drs_t* drs, const drsRepackOptions_t* options, drsRepackStats_t* stats) {
+    int i;
+    int ii;
+    int count = 0;
+    int rc = 0;
+    int* tableStart = NULL;
+    size_t alignment;
+    size_t cursor;
+    size_t limit;
+    pDrsRepackRef_t refs = NULL;
+    pDrsRepackRef_t ref = NULL;
+    pDrsRepackRef_t *byRange = NULL;
+    drsFile_t *file = NULL;
+
+    if (!drs || !drs->tables || !options || !stats) {
+        return 1;
+    }
+
+    memset(stats, 0, sizeof(drsRepackStats_t));
+    stats->oldSize = drs->fileSize;
+    alignment = options->alignment > 1 ? options->alignment : 1;
+
+    if (!(tableStart = malloc((drs->header.tableCount + 1) * sizeof(int)))) {
+        return 4;
+    }
+
+    for (i = 0; i < drs->header.tableCount; ++i) {
+        tableStart[i] = count;
+        count += drs->tables[i].header.fileCount;
+    }
+
+    refs = malloc((count ? count : 1) * sizeof(drsRepackRef_t));
+    byRange = malloc((count ? count : 1) * sizeof(pDrsRepackRef_t));
+
+    if (!refs || !byRange) {
+        free(refs);
+        free(byRange);
+        free(tableStart);
+        return 4;
+    }
+
+    for (i = 0; i < drs->header.tableCount; ++i) {
+        for (ii = 0; ii < drs->tables[i].header.fileCount; ++ii) {
+            ref = &refs[tableStart[i] + ii];
+            file = &drs->tables[i].files[ii];
+
+            ref->table = i;
+            ref->file = ii;
+            ref->id = file->id;
+            ref->rank = INT_MAX;
+            ref->oldOffset = file->offset;
+            ref->size = file->size;
+        }
+    }
+
+    if (options->traceFile && (rc = drs_repack_read_trace(drs, options->traceFile, refs, tableStart))) {
+        free(refs);
+        free(byRange);
+        free(tableStart);
+        return rc;
+    }
+
+    /* Reads happen in trace order when we have one, header order otherwise */
+    drs_repack_sort(refs, count, options->traceFile != NULL, 0);
+    stats->seeksBefore = drs_repack_count_seeks(drs, refs, count, 1, alignment);
+
+    drs_repack_sort(refs, count, options->order == DRS_REPACK_ORDER_TRACE,
+        options->order != DRS_REPACK_ORDER_HEADER);
+
+    for (i = 0; i < count; ++i) {
+        byRange[i] = &refs[i];
+        refs[i].leader = i;
+    }
+
+    qsort(byRange, count, sizeof(pDrsRepackRef_t), drs_repack_compare_range);
+
+    for (i = 1; i < count; ++i) {
+        if (byRange[i]->size && byRange[i]->oldOffset == byRange[i - 1]->oldOffset &&
+            byRange[i]->size == byRange[i - 1]->size) {
+            byRange[i]->leader = byRange[i - 1]->leader;
+        }
+    }
+
+    if (options->dedup) {
+        stats->deduplicated = drs_repack_dedup(drs, refs, byRange, count);
+    }
+
+    /* Header region in the layout the version picks, payloads back to back after it */
+    if (drs_layout_headers(drs)) {
+        free(refs);
+        free(byRange);
+        free(tableStart);
+        return 5;
+    }
+
+    cursor = drs->header.offset;
+    limit = drs_offset_limit(drs);
+
+    for (i = 0; i < count && !rc; ++i) {
+        file = &drs->tables[refs[i].table].files[refs[i].file];
+
+        if (refs[i].leader != i) {
+            file->offset = drs->tables[refs[refs[i].leader].table].files[refs[refs[i].leader].file].offset;
+            continue;
+        }
+
+        if (file->size && cursor % alignment) {
+            stats->padding += alignment - cursor % alignment;
+            cursor += alignment - cursor % alignment;
+        }
+
+        if (cursor > limit || file->size > limit - cursor) {
+            rc = 5;
+            break;
+        }
+
+        file->offset = cursor;
+        cursor += file->size;
+    }
+
+    if (!rc) {
+        drs->fileSize = cursor;
+        stats->newSize = cursor;
+
+        drs_repack_sort(refs, count, options->traceFile != NULL, 0);
+        stats->seeksAfter = drs_repack_count_seeks(drs, refs, count, 0, alignment);
+    }
+
+    free(refs);
+    free(byRange);
+    free(tableStart);
+    return rc;
+}
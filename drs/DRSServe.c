@@ -0,0 +1,896 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "FileManager.h"
+#include "DRSServe.h"
+
+#ifdef OS_IS_LINUX
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#else
+/* SIGPIPE is ignored while serving, the flag only spares the signal */
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#define DRS_SERVE_STREAM_BUFFER (64 * 1024)      // Bounce buffer for payloads streamed without sendfile()
+#endif
+#endif
+
+#define DRS_SERVE_LINE_LENGTH 256                // Longest request, newline included
+#define DRS_SERVE_BACKLOG      64
+
+typedef struct s_drsServeEntry {
+    struct s_drsServeEntry* prev;                // Towards the most recently used
+    struct s_drsServeEntry* next;
+    struct s_drsServeEntry** slot;               // Where the archive points at this entry
+    size_t       size;
+    unsigned char* data;                         // Payload, allocated with the entry
+} drsServeEntry_t, *pDrsServeEntry_t;
+
+typedef struct s_drsServeArchive {
+    const char*  name;
+    const char*  path;
+    drs_t        drs;                            // Index only, payloads come from drs.fd
+    int*         tableBase;                      // Slot of each table's first file
+    pDrsServeEntry_t* slots;                     // Cached payload per file, NULL if not cached
+    int          entries;
+} drsServeArchive_t, *pDrsServeArchive_t;
+
+/**
+ * Reply bytes the socket has not taken yet. Either held right after the
+ * chunk, or a range of a descriptor streamed with sendfile(): payloads
+ * are never copied or pinned in the cache while a client is slow to read.
+ **/
+typedef struct s_drsServeChunk {
+    struct s_drsServeChunk* next;
+    int          sourceFd;                       // Descriptor to stream from, -1 when the bytes follow
+    int          ownsSource;                     // Close sourceFd once sent
+    int          passFd;                         // Descriptor attached to the first byte, -1 for none
+    size_t       offset;                         // Next byte, in sourceFd or the bytes that follow
+    size_t       size;                           // Bytes left
+} drsServeChunk_t, *pDrsServeChunk_t;
+
+typedef struct s_drsServeClient {
+    int          fd;                             // Non-blocking
+    char         line[DRS_SERVE_LINE_LENGTH];
+    size_t       used;
+    pDrsServeChunk_t pending;                    // Replies in request order, NULL when all sent
+    pDrsServeChunk_t last;
+} drsServeClient_t, *pDrsServeClient_t;
+
+typedef struct s_drsServe {
+    pDrsServeArchive_t archives;
+    size_t       count;
+    pDrsServeEntry_t head;                       // Most recently used
+    pDrsServeEntry_t tail;                       // Next to evict
+    size_t       cached;
+    size_t       cacheSize;
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long evictions;
+} drsServe_t, *pDrsServe_t;
+
+#ifdef OS_IS_LINUX
+
+static volatile sig_atomic_t drsServeStop = 0;
+
+static void drs_serve_signal(int number) {
+    (void)number;
+    drsServeStop = 1;
+}
+
+/*********************
+*  Payload cache    *
+**********************/
+
+static void drs_serve_unlink(pDrsServe_t serve, pDrsServeEntry_t entry) {
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    } else {
+        serve->head = entry->next;
+    }
+
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    } else {
+        serve->tail = entry->prev;
+    }
+}
+
+static void drs_serve_push(pDrsServe_t serve, pDrsServeEntry_t entry) {
+    entry->prev = NULL;
+    entry->next = serve->head;
+
+    if (serve->head) {
+        serve->head->prev = entry;
+    } else {
+        serve->tail = entry;
+    }
+
+    serve->head = entry;
+}
+
+static void drs_serve_evict(pDrsServe_t serve, size_t room) {
+    pDrsServeEntry_t entry = NULL;
+
+    while (serve->tail && serve->cached + room > serve->cacheSize) {
+        entry = serve->tail;
+        drs_serve_unlink(serve, entry);
+        *entry->slot = NULL;
+        serve->cached -= entry->size;
+        ++serve->evictions;
+        free(entry);
+    }
+}
+
+/* Cached payload of a file, *entry stays NULL when it is larger than the whole cache */
+static int drs_serve_cached(pDrsServe_t serve, pDrsServeArchive_t archive, int table, int file,
+    pDrsServeEntry_t* entry) {
+    pDrsServeEntry_t *slot = &archive->slots[archive->tableBase[table] + file];
+    size_t size = archive->drs.tables[table].files[file].size;
+
+    if ((*entry = *slot)) {
+        ++serve->hits;
+        drs_serve_unlink(serve, *entry);
+        drs_serve_push(serve, *entry);
+        return 0;
+    }
+
+    ++serve->misses;
+
+    if (size > serve->cacheSize) {
+        return 0;
+    }
+
+    drs_serve_evict(serve, size);
+
+    if (!(*entry = malloc(sizeof(drsServeEntry_t) + (size ? size : 1)))) {
+        return 4;
+    }
+
+    (*entry)->data = (unsigned char*)(*entry + 1);
+    (*entry)->size = size;
+
+    if (drs_read_entry(&archive->drs, table, file, (*entry)->data)) {
+        free(*entry);
+        *entry = NULL;
+        return 6;
+    }
+
+    (*entry)->slot = slot;
+    *slot = *entry;
+    serve->cached += size;
+    drs_serve_push(serve, *entry);
+    return 0;
+}
+
+/*********************
+*  Replies          *
+**********************/
+
+static int drs_serve_queue(pDrsServeClient_t client, const void* data, size_t size, int passFd) {
+    pDrsServeChunk_t chunk = NULL;
+
+    if (!(chunk = malloc(sizeof(drsServeChunk_t) + (size ? size : 1)))) {
+        return 4;
+    }
+
+    if (size) {
+        memcpy(chunk + 1, data, size);
+    }
+
+    chunk->next = NULL;
+    chunk->sourceFd = -1;
+    chunk->ownsSource = 0;
+    chunk->passFd = passFd;
+    chunk->offset = 0;
+    chunk->size = size;
+
+    if (client->last) {
+        client->last->next = chunk;
+    } else {
+        client->pending = chunk;
+    }
+
+    client->last = chunk;
+    return 0;
+}
+
+/* Stream size bytes of sourceFd from offset once everything queued before is out */
+static int drs_serve_queue_range(pDrsServeClient_t client, int sourceFd, size_t offset, size_t size, int owns) {
+    if (!size) {
+        if (owns) {
+            close(sourceFd);
+        }
+
+        return 0;
+    }
+
+    if (drs_serve_queue(client, NULL, 0, -1)) {
+        if (owns) {
+            close(sourceFd);
+        }
+
+        return 4;
+    }
+
+    client->last->sourceFd = sourceFd;
+    client->last->ownsSource = owns;
+    client->last->offset = offset;
+    client->last->size = size;
+    return 0;
+}
+
+static void drs_serve_pop(pDrsServeClient_t client) {
+    pDrsServeChunk_t chunk = client->pending;
+
+    if (chunk->ownsSource) {
+        close(chunk->sourceFd);
+    }
+
+    if (!(client->pending = chunk->next)) {
+        client->last = NULL;
+    }
+
+    free(chunk);
+}
+
+/* One chunk to the socket, the descriptor to pass rides on its first byte */
+static ssize_t drs_serve_send_chunk(int fd, pDrsServeChunk_t chunk) {
+    union {
+        struct cmsghdr header;
+        char         buffer[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct cmsghdr *cmsg = NULL;
+    struct msghdr message;
+    struct iovec part;
+    off_t offset;
+    ssize_t sent;
+#ifndef __linux__
+    unsigned char stream[DRS_SERVE_STREAM_BUFFER];
+#endif
+
+    if (chunk->sourceFd != -1) {
+        offset = (off_t)chunk->offset;
+#ifdef __linux__
+        return sendfile(fd, chunk->sourceFd, &offset, chunk->size);
+#else
+        /* Bytes read but not taken by the socket are read again on POLLOUT */
+        if ((sent = pread(chunk->sourceFd, stream, chunk->size < sizeof(stream) ? chunk->size : sizeof(stream), offset)) <= 0) {
+            return sent;
+        }
+
+        return send(fd, stream, (size_t)sent, MSG_NOSIGNAL);
+#endif
+    }
+
+    part.iov_base = (unsigned char*)(chunk + 1) + chunk->offset;
+    part.iov_len = chunk->size;
+
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &part;
+    message.msg_iovlen = 1;
+
+    if (chunk->passFd != -1) {
+        memset(&control, 0, sizeof(control));
+        message.msg_control = control.buffer;
+        message.msg_controllen = sizeof(control.buffer);
+
+        cmsg = CMSG_FIRSTHDR(&message);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &chunk->passFd, sizeof(int));
+    }
+
+    if ((sent = sendmsg(fd, &message, MSG_NOSIGNAL)) > 0) {
+        chunk->passFd = -1;
+    }
+
+    return sent;
+}
+
+/* Send what the socket takes without blocking, the rest waits for POLLOUT */
+static int drs_serve_flush(pDrsServeClient_t client) {
+    ssize_t sent;
+
+    while (client->pending) {
+        if ((sent = drs_serve_send_chunk(client->fd, client->pending)) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : 7;
+        }
+
+        /* The source shrank under us, the reply can never be completed */
+        if (!sent) {
+            return 7;
+        }
+
+        client->pending->offset += (size_t)sent;
+        client->pending->size -= (size_t)sent;
+
+        if (!client->pending->size) {
+            drs_serve_pop(client);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Header and cached payload in one call where the socket takes it. Whatever
+ * does not fit is queued, the payload remainder as a range of the archive
+ * holding the same bytes, so the cache entry is free to go.
+ **/
+static int drs_serve_send(pDrsServeClient_t client, const char* header, size_t headerSize,
+    const unsigned char* data, size_t size, int sourceFd, size_t sourceOffset) {
+    struct iovec parts[2];
+    struct msghdr message;
+    ssize_t sent = 0;
+
+    if (!client->pending) {
+        parts[0].iov_base = (void*)header;
+        parts[0].iov_len = headerSize;
+        parts[1].iov_base = (void*)data;
+        parts[1].iov_len = size;
+
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = parts;
+        message.msg_iovlen = size ? 2 : 1;
+
+        while ((sent = sendmsg(client->fd, &message, MSG_NOSIGNAL)) == -1 && errno == EINTR) {
+        }
+
+        if (sent == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                return 7;
+            }
+
+            sent = 0;
+        }
+    }
+
+    if ((size_t)sent < headerSize) {
+        if (drs_serve_queue(client, header + sent, headerSize - (size_t)sent, -1)) {
+            return 4;
+        }
+
+        sent = 0;
+    } else {
+        sent -= (ssize_t)headerSize;
+    }
+
+    return drs_serve_queue_range(client, sourceFd, sourceOffset + (size_t)sent, size - (size_t)sent, 0);
+}
+
+static int drs_serve_reply(pDrsServeClient_t client, const char* text) {
+    return drs_serve_queue(client, text, strlen(text), -1);
+}
+
+/* The archive descriptor rides along, the client reads the payload itself */
+static int drs_serve_send_fd(pDrsServeClient_t client, const char* text, int passFd) {
+    return drs_serve_queue(client, text, strlen(text), passFd);
+}
+
+/*********************
+*  Requests         *
+**********************/
+
+static pDrsServeArchive_t drs_serve_archive(pDrsServe_t serve, const char* name) {
+    size_t i;
+
+    for (i = 0; i < serve->count; ++i) {
+        if (!strcmp(serve->archives[i].name, name)) {
+            return &serve->archives[i];
+        }
+    }
+
+    return NULL;
+}
+
+static int drs_serve_get(pDrsServe_t serve, pDrsServeClient_t client, const char* name, const char* entryName,
+    int passFd) {
+    char header[64];
+    char extension[DRS_TABLE_HDR_EXT_LENGTH+1];
+    pDrsServeArchive_t archive = NULL;
+    pDrsServeEntry_t entry = NULL;
+    drsTable_t *table = NULL;
+    drsFile_t *file = NULL;
+    int id;
+    int rc;
+
+    if (!name || !entryName) {
+        return drs_serve_reply(client, "ERR expected <archive> <id>.<ext>\n");
+    }
+
+    if (!(archive = drs_serve_archive(serve, name))) {
+        return drs_serve_reply(client, "ERR no such archive\n");
+    }
+
+    if (drs_parse_file_name(entryName, &id, extension) ||
+        !(file = drs_find(&archive->drs, id, extension, &table))) {
+        return drs_serve_reply(client, "ERR no such entry\n");
+    }
+
+    if (passFd) {
+        sprintf(header, "FD %zu %zu\n", file->offset, file->size);
+        return drs_serve_send_fd(client, header, archive->drs.fd);
+    }
+
+    if ((rc = drs_serve_cached(serve, archive, (int)(table - archive->drs.tables), (int)(file - table->files), &entry))) {
+        return drs_serve_reply(client, "ERR read failed\n");
+    }
+
+    sprintf(header, "OK %zu\n", file->size);
+
+    if (entry) {
+        return drs_serve_send(client, header, strlen(header), entry->data, entry->size,
+            archive->drs.fd, file->offset);
+    }
+
+    /* Too large to cache: straight from the archive to the socket */
+    if ((rc = drs_serve_reply(client, header))) {
+        return rc;
+    }
+
+    return drs_serve_queue_range(client, archive->drs.fd, file->offset, file->size, 0);
+}
+
+/* Anonymous file for replies built before they are sent */
+static int drs_serve_scratch(void) {
+#ifdef __linux__
+    return memfd_create("drs-list", MFD_CLOEXEC);
+#else
+    char path[] = "/tmp/drs-list-XXXXXX";
+    int fd;
+
+    if ((fd = mkstemp(path)) == -1) {
+        return -1;
+    }
+
+    unlink(path);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    return fd;
+#endif
+}
+
+static int drs_serve_list(pDrsServe_t serve, pDrsServeClient_t client, const char* name) {
+    char line[DRS_SERVE_LINE_LENGTH + 64];
+    pDrsServeArchive_t archive = NULL;
+    off_t size;
+    size_t i;
+    int listFd;
+    int rc;
+
+    if (name && !(archive = drs_serve_archive(serve, name))) {
+        return drs_serve_reply(client, "ERR no such archive\n");
+    }
+
+    if ((rc = drs_serve_reply(client, "OK\n"))) {
+        return rc;
+    }
+
+    if (archive) {
+        /* The listing goes to memory first, the socket takes it at its own pace */
+        if ((listFd = drs_serve_scratch()) == -1) {
+            return 4;
+        }
+
+        if ((rc = drs_list_entries(&archive->drs, DRS_LIST_TSV, listFd)) ||
+            (size = lseek(listFd, 0, SEEK_END)) == -1) {
+            close(listFd);
+            return rc ? rc : 7;
+        }
+
+        rc = drs_serve_queue_range(client, listFd, 0, (size_t)size, 1);
+    } else {
+        for (i = 0; i < serve->count && !rc; ++i) {
+            snprintf(line, sizeof(line), "%s\t%d\t%s\n", serve->archives[i].name,
+                serve->archives[i].entries, serve->archives[i].path);
+            rc = drs_serve_reply(client, line);
+        }
+    }
+
+    return rc ? rc : drs_serve_reply(client, "\n");
+}
+
+static int drs_serve_request(pDrsServe_t serve, pDrsServeClient_t client, char* line) {
+    char reply[128];
+    char *words[3];
+    int count = 0;
+
+    /* Up to three words separated by spaces, anything past them is ignored */
+    while (*line && count < 3) {
+        while (*line == ' ' || *line == '\t' || *line == '\r') {
+            *line++ = '\0';
+        }
+
+        if (*line) {
+            words[count++] = line;
+        }
+
+        while (*line && *line != ' ' && *line != '\t' && *line != '\r') {
+            ++line;
+        }
+    }
+
+    *line = '\0';
+
+    if (!count) {
+        return 0;
+    }
+
+    if (!strcmp(words[0], "GET") || !strcmp(words[0], "GETFD")) {
+        return drs_serve_get(serve, client, count > 1 ? words[1] : NULL, count > 2 ? words[2] : NULL,
+            words[0][3] == 'F');
+    }
+
+    if (!strcmp(words[0], "LIST")) {
+        return drs_serve_list(serve, client, count > 1 ? words[1] : NULL);
+    }
+
+    if (!strcmp(words[0], "STATS")) {
+        sprintf(reply, "OK %llu %llu %llu %zu\n", serve->hits, serve->misses, serve->evictions, serve->cached);
+        return drs_serve_reply(client, reply);
+    }
+
+    return drs_serve_reply(client, "ERR unknown request\n");
+}
+
+/* Queue answers to every complete line, non-zero when the client should be dropped */
+static int drs_serve_read(pDrsServe_t serve, pDrsServeClient_t client) {
+    ssize_t got;
+    char *newline = NULL;
+    char *line = NULL;
+    size_t rest;
+
+    while ((got = recv(client->fd, &client->line[client->used], DRS_SERVE_LINE_LENGTH - client->used, 0)) == -1 &&
+        errno == EINTR) {
+    }
+
+    if (got == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return 0;
+    }
+
+    if (got <= 0) {
+        return 1;
+    }
+
+    client->used += (size_t)got;
+    line = client->line;
+
+    while ((newline = memchr(line, '\n', client->used - (size_t)(line - client->line)))) {
+        *newline = '\0';
+
+        if (drs_serve_request(serve, client, line)) {
+            return 1;
+        }
+
+        line = newline + 1;
+    }
+
+    rest = client->used - (size_t)(line - client->line);
+
+    if (rest == DRS_SERVE_LINE_LENGTH) {
+        if (!drs_serve_reply(client, "ERR request too long\n")) {
+            drs_serve_flush(client);
+        }
+
+        return 1;
+    }
+
+    memmove(client->line, line, rest);
+    client->used = rest;
+    return 0;
+}
+
+/* Read requests while nothing is queued, then hand the socket whatever it takes */
+static int drs_serve_service(pDrsServe_t serve, pDrsServeClient_t client, short events) {
+    if (!client->pending && (events & (POLLIN | POLLHUP | POLLERR)) && drs_serve_read(serve, client)) {
+        return 1;
+    }
+
+    return drs_serve_flush(client) ? 1 : 0;
+}
+
+static void drs_serve_drop(pDrsServeClient_t client) {
+    while (client->pending) {
+        drs_serve_pop(client);
+    }
+
+    close(client->fd);
+}
+
+/*********************
+*  Server           *
+**********************/
+
+static int drs_serve_open(pDrsServe_t serve, const drsBatch_t* batch) {
+    pDrsServeArchive_t archive = NULL;
+    size_t i;
+    int table;
+    int rc;
+
+    if (!(serve->archives = calloc(batch->count ? batch->count : 1, sizeof(drsServeArchive_t)))) {
+        return 4;
+    }
+
+    for (i = 0; i < batch->count; ++i) {
+        archive = &serve->archives[serve->count];
+        archive->name = batch->archives[i].name;
+        archive->path = batch->archives[i].path;
+
+        if ((rc = drs_open_index(archive->path, &archive->drs))) {
+            fprintf(stderr, "Failed to open %s\n", archive->path);
+            return rc;
+        }
+
+        ++serve->count;
+
+        if (!(archive->tableBase = malloc((archive->drs.header.tableCount + 1) * sizeof(int)))) {
+            return 4;
+        }
+
+        for (table = 0; table < archive->drs.header.tableCount; ++table) {
+            archive->tableBase[table] = archive->entries;
+            archive->entries += archive->drs.tables[table].header.fileCount;
+        }
+
+        if (!(archive->slots = calloc(archive->entries ? archive->entries : 1, sizeof(pDrsServeEntry_t)))) {
+            return 4;
+        }
+
+        printf("Serving %s: %d entries from %s\n", archive->name, archive->entries, archive->path);
+    }
+
+    return 0;
+}
+
+static void drs_serve_close(pDrsServe_t serve) {
+    pDrsServeEntry_t entry = NULL;
+    size_t i;
+
+    while ((entry = serve->head)) {
+        serve->head = entry->next;
+        free(entry);
+    }
+
+    for (i = 0; i < serve->count; ++i) {
+        free(serve->archives[i].tableBase);
+        free(serve->archives[i].slots);
+        drs_free(&serve->archives[i].drs);
+    }
+
+    free(serve->archives);
+}
+
+static int drs_serve_socket(void) {
+#ifdef __linux__
+    return socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+#else
+    int fd;
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) != -1) {
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+
+    return fd;
+#endif
+}
+
+/* Client sockets never block, see drs_serve_flush() */
+static int drs_serve_accept(int listenFd) {
+#ifdef __linux__
+    return accept4(listenFd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+#else
+    int fd;
+
+    if ((fd = accept(listenFd, NULL, NULL)) == -1) {
+        return -1;
+    }
+
+    if (fcntl(fd, F_SETFD, FD_CLOEXEC) || fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK)) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+#endif
+}
+
+/* A path with nobody answering on it is left over from a server that died */
+static int drs_serve_listen(const char* socketPath) {
+    struct sockaddr_un address;
+    int fd;
+
+    if (strlen(socketPath) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path %s is too long\n", socketPath);
+        return -1;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socketPath);
+
+    if ((fd = drs_serve_socket()) == -1) {
+        return -1;
+    }
+
+    if (!connect(fd, (struct sockaddr*)&address, sizeof(address))) {
+        fprintf(stderr, "Another server is answering on %s\n", socketPath);
+        close(fd);
+        return -1;
+    }
+
+    close(fd);
+    unlink(socketPath);
+
+    if ((fd = drs_serve_socket()) == -1) {
+        return -1;
+    }
+
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) || listen(fd, DRS_SERVE_BACKLOG)) {
+        fprintf(stderr, "Failed to listen on %s\n", socketPath);
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static int drs_serve_loop(pDrsServe_t serve, int listenFd) {
+    struct pollfd *polls = NULL;
+    pDrsServeClient_t clients = NULL;
+    void *pRealloc = NULL;
+    size_t clientCount = 0;
+    size_t capacity = 16;
+    size_t i;
+    int fd;
+    int rc = 0;
+
+    /* polls[0] is the listening socket, polls[i+1] belongs to clients[i] */
+    if (!(polls = malloc((capacity + 1) * sizeof(struct pollfd))) ||
+        !(clients = malloc(capacity * sizeof(drsServeClient_t)))) {
+        free(polls);
+        return 4;
+    }
+
+    polls[0].fd = listenFd;
+    polls[0].events = POLLIN;
+
+    while (!rc && !drsServeStop) {
+        if (poll(polls, clientCount + 1, -1) == -1) {
+            rc = errno == EINTR ? 0 : 6;
+            continue;
+        }
+
+        /* Back to front, a dropped client swaps in the last one */
+        for (i = clientCount; i-- > 0; ) {
+            if (polls[i+1].revents && drs_serve_service(serve, &clients[i], polls[i+1].revents)) {
+                drs_serve_drop(&clients[i]);
+                clients[i] = clients[--clientCount];
+                polls[i+1] = polls[clientCount+1];
+                continue;
+            }
+
+            /* A client with replies queued is not read from until they are out */
+            polls[i+1].events = clients[i].pending ? POLLOUT : POLLIN;
+        }
+
+        if (!(polls[0].revents & POLLIN) ||
+            (fd = drs_serve_accept(listenFd)) == -1) {
+            continue;
+        }
+
+        if (clientCount == capacity) {
+            capacity *= 2;
+
+            if (!(pRealloc = realloc(polls, (capacity + 1) * sizeof(struct pollfd)))) {
+                close(fd);
+                rc = 4;
+                break;
+            }
+
+            polls = pRealloc;
+
+            if (!(pRealloc = realloc(clients, capacity * sizeof(drsServeClient_t)))) {
+                close(fd);
+                rc = 4;
+                break;
+            }
+
+            clients = pRealloc;
+        }
+
+        clients[clientCount].fd = fd;
+        clients[clientCount].used = 0;
+        clients[clientCount].pending = NULL;
+        clients[clientCount].last = NULL;
+        polls[clientCount+1].fd = fd;
+        polls[clientCount+1].events = POLLIN;
+        polls[clientCount+1].revents = 0;
+        ++clientCount;
+    }
+
+    for (i = 0; i < clientCount; ++i) {
+        drs_serve_drop(&clients[i]);
+    }
+
+    free(clients);
+    free(polls);
+    return rc;
+}
+
+#endif
+
+/**
+ * Serve every archive of the batch until SIGINT or SIGTERM. Requests are
+ * answered one at a time from a single thread: a cached GET is a lookup
+ * and one sendmsg(). Client sockets never block, a reply the socket does
+ * not take at once waits in the client's queue for POLLOUT. Needs Unix
+ * domain sockets, descriptors are passed with SCM_RIGHTS.
+ **/
+int drs_serve(const drsBatch_t* archives, const drsServeOptions_t* options) {
+#ifdef OS_IS_LINUX
+    struct sigaction action;
+    drsServe_t serve;
+    int listenFd;
+    int rc;
+
+    if (!archives || !archives->count || !options || !options->socketPath) {
+        return 1;
+    }
+
+    memset(&serve, 0, sizeof(serve));
+    serve.cacheSize = options->cacheSize;
+
+    if ((rc = drs_serve_open(&serve, archives))) {
+        drs_serve_close(&serve);
+        return rc;
+    }
+
+    if ((listenFd = drs_serve_listen(options->socketPath)) == -1) {
+        drs_serve_close(&serve);
+        return 6;
+    }
+
+    /* Clients hanging up mid-reply must not take the server down */
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = SIG_IGN;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPIPE, &action, NULL);
+    action.sa_handler = drs_serve_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    printf("Listening on %s, %zu MiB payload cache\n", options->socketPath, serve.cacheSize >> 20);
+    fflush(stdout);
+
+    rc = drs_serve_loop(&serve, listenFd);
+
+    close(listenFd);
+    unlink(options->socketPath);
+    drs_serve_close(&serve);
+    return rc;
+#else
+    (void)archives;
+    (void)options;
+    fprintf(stderr, "--serve needs Unix domain sockets and is not available on Windows\n");
+    return 1;
+#endif
+}
@@ -0,0 +1,40 @@
+#ifndef DRS_SERVE_H
+#define DRS_SERVE_H
+
+#include <stddef.h>
+
+#include "DRSBatch.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Long-running server for the archives of a batch list. Headers are parsed
+ * once, payloads are read on demand and kept in a size-bounded LRU cache.
+ * One request per line over a Unix domain socket:
+ *
+ * GET <archive> <id>.<ext>     OK <size>\n<payload>
+ * GETFD <archive> <id>.<ext>   FD <offset> <size>\n, archive descriptor attached
+ * LIST [<archive>]             OK\n<name>\t<entries>\t<path>\n ... \n, or the
+ *                              archive's TSV listing, ended by an empty line
+ * STATS                        OK <hits> <misses> <evictions> <cached bytes>\n
+ *
+ * <archive> is the name the batch gave the archive. Failures answer
+ * ERR <reason>\n and keep the connection open.
+ **/
+
+#define DRS_SERVE_DEFAULT_CACHE (256 * 1024 * 1024)
+
+typedef struct s_drsServeOptions {
+    const char*  socketPath;
+    size_t       cacheSize;                      // Payload bytes kept in memory
+} drsServeOptions_t, *pDrsServeOptions_t;
+
+int drs_serve(const drsBatch_t* archives, const drsServeOptions_t* options);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,354 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "FileManager.h"
+#include "ThreadPool.h"
+#include "Hash.h"
+#include "DRSFormat.h"
+
+/**
+ * archive.drs.idx layout, little endian:
+ *
+ * [magic 8][archive size 8][archive mtime 8][header hash 8][header size 4][entry count 4]
+ * [entry count x (extension 4, id 4, offset 8, size 8, hash 8)]
+ **/
+#define DRS_SIDECAR_MAGIC      "DRSIDX02"
+#define DRS_SIDECAR_SUFFIX     ".idx"
+#define DRS_SIDECAR_HDR_SIZE   40
+#define DRS_SIDECAR_ENTRY_SIZE 32
+
+typedef struct s_drsHashContext {
+    drs_t*       drs;
+    drsIndexEntry_t* entries;                    // Entries in header order
+    hash64_t*    hashes;
+    int*         failed;
+} drsHashContext_t, *pDrsHashContext_t;
+
+static char* drs_sidecar_path(const char* archivePath) {
+    char *path = malloc(strlen(archivePath) + sizeof(DRS_SIDECAR_SUFFIX));
+
+    if (path) {
+        sprintf(path, "%s%s", archivePath, DRS_SIDECAR_SUFFIX);
+    }
+
+    return path;
+}
+
+static void drs_hash_worker(size_t item, void* userData) {
+    pDrsHashContext_t context = userData;
+    drsFile_t *file = &context->drs->tables[context->entries[item].table].files[context->entries[item].file];
+    unsigned char *buffer = NULL;
+    hashState_t state;
+    size_t done = 0;
+    size_t chunk;
+
+    if (file->data || !file->size) {
+        context->hashes[item] = hash_xxh64(file->data, file->size, 0);
+        return;
+    }
+
+    /* Index-only: stream the payload through a bounded buffer */
+    chunk = file->size < FM_COPY_BUFFER_SIZE ? file->size : FM_COPY_BUFFER_SIZE;
+    if (!(buffer = malloc(chunk))) {
+        context->failed[item] = 1;
+        return;
+    }
+
+    hash_init(&state, 0);
+    while (done < file->size) {
+        if (chunk > file->size - done) {
+            chunk = file->size - done;
+        }
+
+        if (file_read_at(context->drs->fd, buffer, chunk, file->offset + done)) {
+            context->failed[item] = 1;
+            break;
+        }
+
+        hash_update(&state, buffer, chunk);
+        done += chunk;
+    }
+
+    context->hashes[item] = hash_final(&state);
+    free(buffer);
+}
+
+/* Hash every payload in header order, spread over the worker pool */
+static int drs_hash_entries(drs_t* drs, drsIndexEntry_t** entries, hash64_t** hashes, int* count, int jobs) {
+    int i;
+    int ii;
+    drsHashContext_t context;
+
+    *count = 0;
+    for (i = 0; i < drs->header.tableCount; ++i) {
+        *count += drs->tables[i].header.fileCount;
+    }
+
+    context.drs = drs;
+    context.entries = malloc((*count ? *count : 1) * sizeof(drsIndexEntry_t));
+    context.hashes = malloc((*count ? *count : 1) * sizeof(hash64_t));
+    context.failed = calloc(*count ? *count : 1, sizeof(int));
+
+    if (!context.entries || !context.hashes || !context.failed) {
+        free(context.entries);
+        free(context.hashes);
+        free(context.failed);
+        return 4;
+    }
+
+    *count = 0;
+    for (i = 0; i < drs->header.tableCount; ++i) {
+        for (ii = 0; ii < drs->tables[i].header.fileCount; ++ii) {
+            context.entries[*count].id = drs->tables[i].files[ii].id;
+            context.entries[*count].table = i;
+            context.entries[*count].file = ii;
+            ++*count;
+        }
+    }
+
+    threadpool_run(*count, jobs, drs_hash_worker, &context);
+
+    for (i = 0; i < *count; ++i) {
+        if (context.failed[i]) {
+            free(context.entries);
+            free(context.hashes);
+            free(context.failed);
+            return 3;
+        }
+    }
+
+    free(context.failed);
+    *entries = context.entries;
+    *hashes = context.hashes;
+    return 0;
+}
+
+static int drs_hash_header_region(const char* archivePath, size_t headerSize, hash64_t* hash) {
+    unsigned char *buffer = NULL;
+    size_t size;
+    int fd;
+    int rc = 0;
+
+    if ((fd = file_open_readonly(archivePath, &size)) == -1) {
+        return 2;
+    }
+
+    if (headerSize > size || !(buffer = malloc(headerSize ? headerSize : 1))) {
+        file_close_descriptor(fd);
+        return 3;
+    }
+
+    if (file_read_at(fd, buffer, headerSize, 0)) {
+        rc = 3;
+    } else {
+        *hash = hash_xxh64(buffer, headerSize, 0);
+    }
+
+    free(buffer);
+    file_close_descriptor(fd);
+    return rc;
+}
+
+int drs_sidecar_write(drs_t* drs, const char* archivePath, int jobs) {
+    int i;
+    int count;
+    int rc;
+    size_t archiveSize;
+    size_t headerSize;
+    long long modified;
+    hash64_t headerHash;
+    drsIndexEntry_t *entries = NULL;
+    hash64_t *hashes = NULL;
+    unsigned char *buffer = NULL;
+    unsigned char *entry = NULL;
+    char *path = NULL;
+    drsFile_t *file = NULL;
+
+    if (!drs || !drs->tables || !archivePath) {
+        return 1;
+    }
+
+    if (file_info(archivePath, &archiveSize, &modified)) {
+        return 2;
+    }
+
+    /* The sidecar keeps the header region size in 4 bytes */
+    if ((headerSize = drs_header_size(drs)) > INT_MAX) {
+        return 5;
+    }
+
+    if ((rc = drs_hash_header_region(archivePath, headerSize, &headerHash)) ||
+        (rc = drs_hash_entries(drs, &entries, &hashes, &count, jobs))) {
+        return rc;
+    }
+
+    if (!(buffer = malloc(DRS_SIDECAR_HDR_SIZE + (size_t)count * DRS_SIDECAR_ENTRY_SIZE)) ||
+        !(path = drs_sidecar_path(archivePath))) {
+        free(buffer);
+        free(entries);
+        free(hashes);
+        return 4;
+    }
+
+    memcpy(buffer, DRS_SIDECAR_MAGIC, 8);
+    drs_codec_put64(&buffer[8], archiveSize);
+    drs_codec_put64(&buffer[16], (unsigned long long)modified);
+    drs_codec_put64(&buffer[24], headerHash);
+    drs_codec_put32(&buffer[32], (int)headerSize);
+    drs_codec_put32(&buffer[36], count);
+
+    for (i = 0; i < count; ++i) {
+        entry = &buffer[DRS_SIDECAR_HDR_SIZE + (size_t)i * DRS_SIDECAR_ENTRY_SIZE];
+        file = &drs->tables[entries[i].table].files[entries[i].file];
+
+        memcpy(entry, drs->tables[entries[i].table].header.extension, 4);
+        drs_codec_put32(&entry[4], file->id);
+        drs_codec_put64(&entry[8], file->offset);
+        drs_codec_put64(&entry[16], file->size);
+        drs_codec_put64(&entry[24], hashes[i]);
+    }
+
+    if (file_put_contents(path, buffer, DRS_SIDECAR_HDR_SIZE + (size_t)count * DRS_SIDECAR_ENTRY_SIZE)) {
+        fprintf(stderr, "Failed to create index file %s\n", path);
+        rc = 5;
+    }
+
+    free(path);
+    free(buffer);
+    free(entries);
+    free(hashes);
+    return rc;
+}
+
+static int drs_verify_entry(drs_t* drs, const unsigned char* expected, const drsIndexEntry_t* entry,
+        hash64_t hash) {
+    int id;
+    unsigned long long offset;
+    unsigned long long size;
+    hash64_t expectedHash;
+    char extension[DRS_TABLE_HDR_EXT_LENGTH+1];
+    drsFile_t *file = &drs->tables[entry->table].files[entry->file];
+
+    memcpy(extension, expected, 4);
+    extension[DRS_TABLE_HDR_EXT_LENGTH] = '\0';
+    id = drs_codec_get32(&expected[4]);
+    offset = drs_codec_get64(&expected[8]);
+    size = drs_codec_get64(&expected[16]);
+    expectedHash = drs_codec_get64(&expected[24]);
+
+    if (id != file->id || strcmp(extension, drs->tables[entry->table].header.extension)) {
+        fprintf(stderr, "MISMATCH %d.%s: expected %d.%s at this position\n", file->id,
+            drs->tables[entry->table].header.extension, id, extension);
+        return 1;
+    }
+
+    if (size != file->size || hash != expectedHash) {
+        fprintf(stderr, "MISMATCH %d.%s: content differs (%zu bytes, expected %llu)\n", id, extension,
+            file->size, size);
+        return 1;
+    }
+
+    if (offset != file->offset) {
+        fprintf(stderr, "MISMATCH %d.%s: moved from 0x%llX to 0x%zX\n", id, extension, offset, file->offset);
+        return 1;
+    }
+
+    return 0;
+}
+
+int drs_verify(const char* archivePath, int full, int jobs, drsVerifyReport_t* report) {
+    drs_t drs;
+    int i;
+    int count;
+    int storedCount;
+    int headerSize;
+    int rc;
+    size_t sidecarSize = 0;
+    size_t archiveSize;
+    unsigned long long storedSize;
+    long long modified;
+    long long storedModified;
+    hash64_t headerHash;
+    hash64_t storedHeaderHash;
+    unsigned char *sidecar = NULL;
+    char *path = NULL;
+    drsIndexEntry_t *entries = NULL;
+    hash64_t *hashes = NULL;
+
+    if (!archivePath || !report) {
+        return 1;
+    }
+
+    memset(report, 0, sizeof(drsVerifyReport_t));
+
+    if (!(path = drs_sidecar_path(archivePath))) {
+        return 4;
+    }
+
+    if (file_get_contents(path, &sidecar, &sidecarSize) || sidecarSize < DRS_SIDECAR_HDR_SIZE ||
+        memcmp(sidecar, DRS_SIDECAR_MAGIC, 8)) {
+        fprintf(stderr, "No usable index file %s\n", path);
+        free(sidecar);
+        free(path);
+        return 6;
+    }
+
+    free(path);
+
+    storedSize = drs_codec_get64(&sidecar[8]);
+    storedModified = (long long)drs_codec_get64(&sidecar[16]);
+    storedHeaderHash = drs_codec_get64(&sidecar[24]);
+    headerSize = drs_codec_get32(&sidecar[32]);
+    storedCount = drs_codec_get32(&sidecar[36]);
+
+    if (storedCount < 0 || headerSize < 0 ||
+        sidecarSize != DRS_SIDECAR_HDR_SIZE + (size_t)storedCount * DRS_SIDECAR_ENTRY_SIZE) {
+        fprintf(stderr, "Corrupt index file for %s\n", archivePath);
+        free(sidecar);
+        return 6;
+    }
+
+    if (file_info(archivePath, &archiveSize, &modified)) {
+        free(sidecar);
+        return 2;
+    }
+
+    /* Quick path: nothing but the header region is read */
+    if (!full && archiveSize == storedSize && modified == storedModified &&
+        !drs_hash_header_region(archivePath, headerSize, &headerHash) && headerHash == storedHeaderHash) {
+        report->quick = 1;
+        report->entries = storedCount;
+        free(sidecar);
+        return 0;
+    }
+
+    if ((rc = drs_open_index(archivePath, &drs))) {
+        free(sidecar);
+        return rc == 1 ? 2 : rc;
+    }
+
+    if ((rc = drs_hash_entries(&drs, &entries, &hashes, &count, jobs))) {
+        drs_free(&drs);
+        free(sidecar);
+        return rc;
+    }
+
+    report->entries = count;
+
+    if (count != storedCount) {
+        fprintf(stderr, "MISMATCH %s: %d entries, expected %d\n", archivePath, count, storedCount);
+        ++report->mismatches;
+    }
+
+    for (i = 0; i < count && i < storedCount; ++i) {
+        report->mismatches += drs_verify_entry(&drs,
+            &sidecar[DRS_SIDECAR_HDR_SIZE + (size_t)i * DRS_SIDECAR_ENTRY_SIZE], &entries[i], hashes[i]);
+    }
+
+    free(entries);
+    free(hashes);
+    free(sidecar);
+    drs_free(&drs);
+    return 0;
+}
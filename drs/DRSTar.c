@@ -0,0 +1,466 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "FileManager.h"
+#include "Stats.h"
+#include "DRSFormat.h"
+
+#define DRS_TAR_BLOCK         512
+#define DRS_TAR_BUFFER_SIZE   (256 * 1024)
+/* Payloads from this size on skip the buffer: spliced from the archive or its mapping */
+#define DRS_TAR_DIRECT_SIZE   (64 * 1024)
+#define DRS_TAR_NAME_LENGTH   100
+
+/**
+ * ustar streams of <id>.<ext> members, one per entry in header order.
+ * Repeated ID+extension pairs keep their own member, so an import of the
+ * export has every entry back.
+ **/
+
+typedef struct s_drsTarWriter {
+    int          fd;
+    unsigned char* buffer;
+    size_t       used;
+    int          rc;                             // First error, sticky
+} drsTarWriter_t, *pDrsTarWriter_t;
+
+typedef struct s_drsTarReader {
+    int          fd;
+    unsigned char* buffer;
+    size_t       start;
+    size_t       end;
+    int          rc;                             // First error, sticky
+} drsTarReader_t, *pDrsTarReader_t;
+
+typedef struct s_drsTarEntry {
+    int          id;
+    char         extension[DRS_TABLE_HDR_EXT_LENGTH+1];
+    size_t       offset;                         // Payload offset in the arena
+    size_t       size;
+    size_t       sequence;                       // Stream order, breaks ties when sorting
+} drsTarEntry_t, *pDrsTarEntry_t;
+
+static void drs_tar_flush(pDrsTarWriter_t writer) {
+    if (!writer->rc && writer->used && file_write_all(writer->fd, writer->buffer, writer->used)) {
+        writer->rc = 7;
+    }
+
+    writer->used = 0;
+}
+
+static unsigned char* drs_tar_reserve(pDrsTarWriter_t writer, size_t size) {
+    if (writer->used + size > DRS_TAR_BUFFER_SIZE) {
+        drs_tar_flush(writer);
+    }
+
+    return &writer->buffer[writer->used];
+}
+
+static void drs_tar_octal(unsigned char* field, size_t length, size_t value) {
+    size_t i = length - 1;
+
+    field[i] = '\0';
+
+    while (i--) {
+        field[i] = (unsigned char)('0' + (value & 7));
+        value >>= 3;
+    }
+}
+
+static void drs_tar_header(unsigned char* block, const char* name, size_t size) {
+    unsigned int checksum = 0;
+    int i;
+
+    memset(block, 0, DRS_TAR_BLOCK);
+    strcpy((char*)block, name);
+    drs_tar_octal(&block[100], 8, 0644);
+    drs_tar_octal(&block[108], 8, 0);
+    drs_tar_octal(&block[116], 8, 0);
+    drs_tar_octal(&block[124], 12, size);
+    drs_tar_octal(&block[136], 12, 0);
+    block[156] = '0';
+    memcpy(&block[257], "ustar", 6);
+    memcpy(&block[263], "00", 2);
+
+    /* The checksum field counts as spaces while summing */
+    memset(&block[148], ' ', 8);
+    for (i = 0; i < DRS_TAR_BLOCK; ++i) {
+        checksum += block[i];
+    }
+
+    drs_tar_octal(&block[148], 7, checksum);
+}
+
+/**
+ * Headers, small payloads and padding are gathered in one buffer. Larger
+ * payloads leave the archive without passing through it: vmsplice() from
+ * a mapping, or sendfile() and friends from an index-only descriptor.
+ **/
+int drs_export_tar(drs_t* drs, int fd, const drsFilter_t* filter) {
+    drsTarWriter_t writer;
+    drsFile_t *file = NULL;
+    char name[DRS_TAR_NAME_LENGTH];
+    size_t padding;
+    int i;
+    int ii;
+
+    if (!drs || (drs->header.tableCount && !drs->tables) || fd < 0) {
+        return 1;
+    }
+
+    writer.fd = fd;
+    writer.used = 0;
+    writer.rc = 0;
+
+    if (!(writer.buffer = malloc(DRS_TAR_BUFFER_SIZE))) {
+        return 4;
+    }
+
+    STATS_ALLOC(DRS_TAR_BUFFER_SIZE);
+    STATS_BEGIN(STATS_PHASE_EXTRACT);
+
+    for (i = 0; i < drs->header.tableCount && !writer.rc; ++i) {
+        for (ii = 0; ii < drs->tables[i].header.fileCount && !writer.rc; ++ii) {
+            if (!drs_filter_match(filter, drs, i, ii)) {
+                continue;
+            }
+
+            file = &drs->tables[i].files[ii];
+            sprintf(name, "%d.%s", file->id, drs->tables[i].header.extension);
+            drs_tar_header(drs_tar_reserve(&writer, DRS_TAR_BLOCK), name, file->size);
+            writer.used += DRS_TAR_BLOCK;
+
+            if (file->size >= DRS_TAR_DIRECT_SIZE) {
+                drs_tar_flush(&writer);
+
+                if (file->data) {
+                    writer.rc = writer.rc ? writer.rc : (file_write_pages(fd, file->data, file->size) ? 7 : 0);
+                } else if (drs->storage == DRS_STORAGE_INDEX) {
+                    writer.rc = writer.rc ? writer.rc : (file_copy_range(drs->fd, file->offset, fd, file->size) ? 7 : 0);
+                } else {
+                    writer.rc = 2;
+                }
+            } else if (file->data) {
+                memcpy(drs_tar_reserve(&writer, file->size), file->data, file->size);
+                writer.used += file->size;
+            } else if (drs->storage == DRS_STORAGE_INDEX) {
+                if (file_read_at(drs->fd, drs_tar_reserve(&writer, file->size), file->size, file->offset)) {
+                    writer.rc = 3;
+                }
+
+                writer.used += file->size;
+            } else if (file->size) {
+                writer.rc = 2;
+            }
+
+            padding = (DRS_TAR_BLOCK - file->size % DRS_TAR_BLOCK) % DRS_TAR_BLOCK;
+            memset(drs_tar_reserve(&writer, padding), 0, padding);
+            writer.used += padding;
+        }
+    }
+
+    /* Two zero blocks end the archive */
+    memset(drs_tar_reserve(&writer, 2 * DRS_TAR_BLOCK), 0, 2 * DRS_TAR_BLOCK);
+    writer.used += 2 * DRS_TAR_BLOCK;
+    drs_tar_flush(&writer);
+
+    STATS_END(STATS_PHASE_EXTRACT);
+
+    free(writer.buffer);
+    return writer.rc;
+}
+
+/* Exactly size bytes, straight into dst once the buffer is drained */
+static int drs_tar_read(pDrsTarReader_t reader, unsigned char* dst, size_t size) {
+    size_t chunk;
+    size_t got;
+
+    while (size && !reader->rc) {
+        if (reader->start == reader->end) {
+            if (dst && size >= DRS_TAR_BUFFER_SIZE) {
+                if (file_read_stream(reader->fd, dst, size, &got) || got != size) {
+                    reader->rc = 3;
+                }
+
+                return reader->rc;
+            }
+
+            reader->start = 0;
+            if (file_read_stream(reader->fd, reader->buffer, DRS_TAR_BUFFER_SIZE, &reader->end) || !reader->end) {
+                reader->rc = 3;
+                break;
+            }
+        }
+
+        chunk = reader->end - reader->start < size ? reader->end - reader->start : size;
+
+        if (dst) {
+            memcpy(dst, &reader->buffer[reader->start], chunk);
+            dst += chunk;
+        }
+
+        reader->start += chunk;
+        size -= chunk;
+    }
+
+    return reader->rc;
+}
+
+/* Octal, or base-256 big-endian when the high bit of the first byte is set */
+static int drs_tar_number(const unsigned char* field, size_t length, size_t* value) {
+    size_t i = 0;
+
+    *value = 0;
+
+    if (field[0] & 0x80) {
+        for (i = 0; i < length; ++i) {
+            if (*value > ((size_t)-1 >> 8)) {
+                return 1;
+            }
+
+            *value = (*value << 8) | (i ? field[i] : (field[i] & 0x7F));
+        }
+
+        return 0;
+    }
+
+    while (i < length && field[i] == ' ') {
+        ++i;
+    }
+
+    for (; i < length && field[i] >= '0' && field[i] <= '7'; ++i) {
+        *value = (*value << 3) | (size_t)(field[i] - '0');
+    }
+
+    return i < length && field[i] && field[i] != ' ';
+}
+
+static int drs_tar_checksum(const unsigned char* block) {
+    size_t expected;
+    unsigned int checksum = 0;
+    int i;
+
+    if (drs_tar_number(&block[148], 8, &expected)) {
+        return 1;
+    }
+
+    for (i = 0; i < DRS_TAR_BLOCK; ++i) {
+        checksum += (i >= 148 && i < 156) ? ' ' : block[i];
+    }
+
+    return checksum != expected;
+}
+
+static int drs_tar_compare(const void* a, const void* b) {
+    const drsTarEntry_t *lhs = a;
+    const drsTarEntry_t *rhs = b;
+    int rc;
+
+    if ((rc = strcmp(lhs->extension, rhs->extension))) {
+        return rc;
+    }
+
+    if (lhs->id != rhs->id) {
+        return lhs->id < rhs->id ? -1 : 1;
+    }
+
+    return (lhs->sequence > rhs->sequence) - (lhs->sequence < rhs->sequence);
+}
+
+static int drs_tar_grow(unsigned char** arena, size_t* capacity, size_t needed) {
+    unsigned char *pRealloc = NULL;
+    size_t size = *capacity ? *capacity : DRS_TAR_BUFFER_SIZE;
+
+    if (needed <= *capacity) {
+        return 0;
+    }
+
+    while (size < needed) {
+        size *= 2;
+    }
+
+    if (!(pRealloc = realloc(*arena, size))) {
+        return 1;
+    }
+
+    STATS_ALLOC(size - *capacity);
+    *arena = pRealloc;
+    *capacity = size;
+    return 0;
+}
+
+/* Tables by extension and entries by ID, the same layout as a directory build */
+static int drs_tar_build(drs_t* drs, pDrsTarEntry_t entries, size_t count, unsigned char* arena) {
+    size_t i;
+    int table = -1;
+    int file = 0;
+
+    qsort(entries, count, sizeof(drsTarEntry_t), drs_tar_compare);
+
+    for (i = 0; i < count; ++i) {
+        if (!i || strcmp(entries[i].extension, entries[i - 1].extension)) {
+            ++drs->header.tableCount;
+        }
+    }
+
+    if (drs->header.tableCount && !(drs->tables = calloc(drs->header.tableCount, sizeof(drsTable_t)))) {
+        return 4;
+    }
+
+    for (i = 0; i < count; ++i) {
+        if (!i || strcmp(entries[i].extension, entries[i - 1].extension)) {
+            ++table;
+            strcpy(drs->tables[table].header.extension, entries[i].extension);
+            drs->tables[table].header.fileType = drs_file_type(entries[i].extension);
+        }
+
+        ++drs->tables[table].header.fileCount;
+    }
+
+    for (table = 0, i = 0; table < drs->header.tableCount; ++table) {
+        if (!(drs->tables[table].files = calloc(drs->tables[table].header.fileCount, sizeof(drsFile_t)))) {
+            return 4;
+        }
+
+        for (file = 0; file < drs->tables[table].header.fileCount; ++file, ++i) {
+            drs->tables[table].files[file].id = entries[i].id;
+            drs->tables[table].files[file].size = entries[i].size;
+            drs->tables[table].files[file].data = &arena[entries[i].offset];
+        }
+    }
+
+    return drs_layout(drs) ? 5 : 0;
+}
+
+/**
+ * One pass over the stream: payloads land in a single growing block, the
+ * archive is laid out and written once the end of the stream is seen.
+ * Members that are not regular <id>.<ext> files are skipped.
+ **/
+int drs_create_from_tar(int fd, const char* output, drsCreateStats_t* stats) {
+    drsTarReader_t reader;
+    unsigned char block[DRS_TAR_BLOCK];
+    char name[DRS_TAR_NAME_LENGTH+1];
+    const char *base = NULL;
+    unsigned char *arena = NULL;
+    size_t arenaSize = 0;
+    size_t arenaCapacity = 0;
+    pDrsTarEntry_t entries = NULL;
+    pDrsTarEntry_t pRealloc = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    size_t size;
+    size_t padding;
+    pDrsTarEntry_t entry = NULL;
+    drs_t drs;
+    int rc = 0;
+
+    if (fd < 0 || !output) {
+        return 1;
+    }
+
+    reader.fd = fd;
+    reader.start = 0;
+    reader.end = 0;
+    reader.rc = 0;
+
+    if (!(reader.buffer = malloc(DRS_TAR_BUFFER_SIZE))) {
+        return 4;
+    }
+
+    STATS_ALLOC(DRS_TAR_BUFFER_SIZE);
+    STATS_BEGIN(STATS_PHASE_READ);
+
+    while (!rc) {
+        if (drs_tar_read(&reader, block, DRS_TAR_BLOCK)) {
+            fprintf(stderr, "Unexpected end of tar stream\n");
+            rc = 6;
+            break;
+        }
+
+        /* A zero block ends the archive; anything after it is left unread */
+        if (!block[0] && !memcmp(block, &block[1], DRS_TAR_BLOCK - 1)) {
+            break;
+        }
+
+        if (drs_tar_checksum(block) || drs_tar_number(&block[124], 12, &size)) {
+            fprintf(stderr, "Corrupt tar header\n");
+            rc = 10;
+            break;
+        }
+
+        padding = (DRS_TAR_BLOCK - size % DRS_TAR_BLOCK) % DRS_TAR_BLOCK;
+        memcpy(name, block, DRS_TAR_NAME_LENGTH);
+        name[DRS_TAR_NAME_LENGTH] = '\0';
+        base = strrchr(name, '/');
+        base = base ? base + 1 : name;
+
+        if (block[156] != '0' && block[156] != '\0') {
+            /* Directories, links and pax or GNU extension headers */
+            rc = drs_tar_read(&reader, NULL, size + padding) ? 6 : 0;
+            continue;
+        }
+
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+
+            if (!(pRealloc = realloc(entries, capacity * sizeof(drsTarEntry_t)))) {
+                rc = 4;
+                break;
+            }
+
+            entries = pRealloc;
+        }
+
+        entry = &entries[count];
+
+        if (drs_parse_file_name(base, &entry->id, entry->extension)) {
+            fprintf(stderr, "Skipping %s, expected <id>.<ext>\n", name);
+            rc = drs_tar_read(&reader, NULL, size + padding) ? 6 : 0;
+            continue;
+        }
+
+        if (size > INT_MAX || drs_tar_grow(&arena, &arenaCapacity, arenaSize + size)) {
+            fprintf(stderr, "%s does not fit in a DRS file\n", name);
+            rc = size > INT_MAX ? 5 : 4;
+            break;
+        }
+
+        entry->offset = arenaSize;
+        entry->size = size;
+        entry->sequence = count++;
+
+        if (drs_tar_read(&reader, &arena[arenaSize], size) || drs_tar_read(&reader, NULL, padding)) {
+            fprintf(stderr, "Unexpected end of tar stream\n");
+            rc = 6;
+            break;
+        }
+
+        arenaSize += size;
+    }
+
+    STATS_END(STATS_PHASE_READ);
+    free(reader.buffer);
+
+    drs_init_empty(&drs);
+    drs_set_copyright(&drs, DRS_DEFAULT_COPYRIGHT);
+    strcpy(drs.header.version, DRS_DEFAULT_VERSION);
+    strcpy(drs.header.type, DRS_DEFAULT_TYPE);
+
+    /* The arena owns every payload, drs_free() releases it once */
+    drs.payloads = arena;
+
+    if (!rc && !(rc = drs_tar_build(&drs, entries, count, arena))) {
+        rc = drs_create_archive(&drs, output);
+    }
+
+    if (!rc && stats) {
+        stats->size = drs.fileSize;
+        stats->deduplicated = 0;
+    }
+
+    drs_free(&drs);
+    free(entries);
+    return rc;
+}
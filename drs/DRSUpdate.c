@@ -0,0 +1,512 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "FileManager.h"
+#include "DRSFormat.h"
+
+#define DRS_UPDATE_KEEP    -1
+#define DRS_UPDATE_REMOVED -2
+#define DRS_UPDATE_UNPLACED ((size_t)-1)         // Offset of an entry added by this update
+
+typedef struct s_drsUpdateRange {
+    size_t       start;
+    size_t       end;
+    size_t       reach;                          // Furthest end of this and every earlier range
+} drsUpdateRange_t, *pDrsUpdateRange_t;
+
+/* One payload to write, planned before the archive is touched */
+typedef struct s_drsUpdateMove {
+    drsFile_t*   file;                           // Entry in the result, already at its new offset
+    int          source;                         // Change index, or DRS_UPDATE_KEEP to relocate
+    size_t       from;                           // Current offset of a relocated payload
+    int          inPlace;                        // Overwrites bytes the current header points at
+} drsUpdateMove_t, *pDrsUpdateMove_t;
+
+typedef struct s_drsUpdate {
+    drs_t        archive;                        // Current archive, index only
+    drs_t        result;                         // Header region being built
+    int**        sources;                        // Per file: change index or DRS_UPDATE_*
+    size_t*      sizes;                          // Payload size of every change
+    int*         fds;                            // Open source of every change read from a file, -1 otherwise
+    size_t       changeCount;
+    pDrsUpdateMove_t moves;
+    size_t       moveCount;
+    int          tableCapacity;
+    drsUpdateRange_t* ranges;                    // Payload ranges of the current archive, by start
+    size_t       rangeCount;
+} drsUpdate_t, *pDrsUpdate_t;
+
+static void drs_update_free(pDrsUpdate_t update) {
+    int i;
+
+    if (update->sources) {
+        for (i = 0; i < update->tableCapacity; ++i) {
+            free(update->sources[i]);
+        }
+
+        free(update->sources);
+        update->sources = NULL;
+    }
+
+    free(update->sizes);
+    update->sizes = NULL;
+
+    if (update->fds) {
+        for (i = 0; i < (int)update->changeCount; ++i) {
+            if (update->fds[i] != -1) {
+                file_close_descriptor(update->fds[i]);
+            }
+        }
+
+        free(update->fds);
+        update->fds = NULL;
+    }
+
+    free(update->moves);
+    update->moves = NULL;
+    free(update->ranges);
+    update->ranges = NULL;
+
+    /* Tables past tableCount were reserved for additions, drs_free would miss them */
+    if (update->result.tables) {
+        for (i = 0; i < update->tableCapacity; ++i) {
+            free(update->result.tables[i].files);
+        }
+
+        free(update->result.tables);
+        update->result.tables = NULL;
+    }
+
+    drs_free(&update->result);
+    drs_free(&update->archive);
+}
+
+static int drs_update_find(pDrsUpdate_t update, const drsChange_t* change, int* table, int* file) {
+    int i;
+    int ii;
+
+    for (i = 0; i < update->result.header.tableCount; ++i) {
+        if (strcmp(update->result.tables[i].header.extension, change->extension)) {
+            continue;
+        }
+
+        *table = i;
+
+        for (ii = 0; ii < update->result.tables[i].header.fileCount; ++ii) {
+            if (update->result.tables[i].files[ii].id == change->id &&
+                update->sources[i][ii] != DRS_UPDATE_REMOVED) {
+                *file = ii;
+                return 0;
+            }
+        }
+
+        *file = -1;
+        return 1;
+    }
+
+    *table = -1;
+    *file = -1;
+    return 1;
+}
+
+static int drs_update_compare_range(const void* a, const void* b) {
+    const drsUpdateRange_t *lhs = a;
+    const drsUpdateRange_t *rhs = b;
+
+    if (lhs->start != rhs->start) {
+        return lhs->start < rhs->start ? -1 : 1;
+    }
+
+    return (lhs->end > rhs->end) - (lhs->end < rhs->end);
+}
+
+/* Every non-empty payload range of the current archive, sorted for drs_update_shared() */
+static int drs_update_ranges(pDrsUpdate_t update) {
+    int i;
+    int ii;
+    size_t count = 0;
+    drsFile_t *file = NULL;
+
+    for (i = 0; i < update->archive.header.tableCount; ++i) {
+        count += update->archive.tables[i].header.fileCount;
+    }
+
+    if (!(update->ranges = malloc((count ? count : 1) * sizeof(drsUpdateRange_t)))) {
+        return 4;
+    }
+
+    for (i = 0; i < update->archive.header.tableCount; ++i) {
+        for (ii = 0; ii < update->archive.tables[i].header.fileCount; ++ii) {
+            file = &update->archive.tables[i].files[ii];
+
+            if (file->size) {
+                update->ranges[update->rangeCount].start = file->offset;
+                update->ranges[update->rangeCount].end = file->offset + file->size;
+                ++update->rangeCount;
+            }
+        }
+    }
+
+    if (update->rangeCount) {
+        qsort(update->ranges, update->rangeCount, sizeof(drsUpdateRange_t), drs_update_compare_range);
+    }
+
+    for (count = 0; count < update->rangeCount; ++count) {
+        update->ranges[count].reach = update->ranges[count].end;
+
+        if (count && update->ranges[count - 1].reach > update->ranges[count].reach) {
+            update->ranges[count].reach = update->ranges[count - 1].reach;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Whether any header besides the entry's own points into [offset, offset+size).
+ * Deduplicated and repacked archives share payloads between entries, those
+ * must never be patched in place.
+ **/
+static int drs_update_shared(pDrsUpdate_t update, size_t offset, size_t size) {
+    size_t low = 0;
+    size_t high = update->rangeCount;
+    size_t middle;
+    size_t i;
+    int overlaps = 0;
+
+    if (!size) {
+        return 0;
+    }
+
+    /* First range starting at or after offset */
+    while (low < high) {
+        middle = low + (high - low) / 2;
+
+        if (update->ranges[middle].start < offset) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    if (low && update->ranges[low - 1].reach > offset) {
+        return 1;
+    }
+
+    /* The entry's own range is one of these */
+    for (i = low; i < update->rangeCount && update->ranges[i].start < offset + size; ++i) {
+        if (++overlaps > 1) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Copy the current tables with room for every change to be an addition */
+static int drs_update_prepare(pDrsUpdate_t update, size_t count) {
+    int i;
+    int capacity;
+    drsTable_t *table = NULL;
+
+    if (drs_update_ranges(update)) {
+        return 4;
+    }
+
+    drs_init_empty(&update->result);
+    memcpy(&update->result.header, &update->archive.header, sizeof(drsHeader_t));
+
+    update->tableCapacity = update->archive.header.tableCount + (int)count;
+
+    if (!(update->result.tables = calloc(update->tableCapacity, sizeof(drsTable_t))) ||
+        !(update->sources = calloc(update->tableCapacity, sizeof(int*))) ||
+        !(update->sizes = calloc(count ? count : 1, sizeof(size_t))) ||
+        !(update->fds = malloc((count ? count : 1) * sizeof(int)))) {
+        return 4;
+    }
+
+    update->changeCount = count;
+    memset(update->fds, 0xFF, (count ? count : 1) * sizeof(int));
+
+    for (i = 0; i < update->tableCapacity; ++i) {
+        table = &update->result.tables[i];
+        capacity = (int)count;
+
+        if (i < update->archive.header.tableCount) {
+            table->header = update->archive.tables[i].header;
+            capacity += table->header.fileCount;
+        }
+
+        if (!(table->files = calloc(capacity ? capacity : 1, sizeof(drsFile_t))) ||
+            !(update->sources[i] = malloc((capacity ? capacity : 1) * sizeof(int)))) {
+            return 4;
+        }
+
+        if (i < update->archive.header.tableCount) {
+            memcpy(table->files, update->archive.tables[i].files, table->header.fileCount * sizeof(drsFile_t));
+        }
+
+        memset(update->sources[i], 0xFF, (capacity ? capacity : 1) * sizeof(int));
+    }
+
+    return 0;
+}
+
+static int drs_update_apply(pDrsUpdate_t update, const drsChange_t* changes, size_t count) {
+    size_t i;
+    int table;
+    int file;
+    drsTable_t *drsTable = NULL;
+
+    for (i = 0; i < count; ++i) {
+        if (changes[i].type == DRS_CHANGE_PUT) {
+            /* Sources stay open until written: nothing fails to open once writing starts */
+            if (changes[i].filePath) {
+                if ((update->fds[i] = file_open_readonly(changes[i].filePath, &update->sizes[i])) == -1) {
+                    fprintf(stderr, "Failed to open %s\n", changes[i].filePath);
+                    return 6;
+                }
+            } else {
+                update->sizes[i] = changes[i].size;
+            }
+
+            if (update->sizes[i] > drs_offset_limit(&update->result)) {
+                return 5;
+            }
+        }
+
+        if (!drs_update_find(update, &changes[i], &table, &file)) {
+            update->sources[table][file] = changes[i].type == DRS_CHANGE_PUT ? (int)i : DRS_UPDATE_REMOVED;
+            continue;
+        }
+
+        if (changes[i].type == DRS_CHANGE_REMOVE) {
+            fprintf(stderr, "File %d.%s is not in the archive, nothing to remove\n",
+                changes[i].id, changes[i].extension);
+            continue;
+        }
+
+        /* New extension, new table at the end */
+        if (table == -1) {
+            table = update->result.header.tableCount++;
+            drsTable = &update->result.tables[table];
+            memset(drsTable->header.extension, 0, sizeof(drsTable->header.extension));
+            strncpy(drsTable->header.extension, changes[i].extension, DRS_TABLE_HDR_EXT_LENGTH);
+            drsTable->header.fileType = drs_file_type(drsTable->header.extension);
+            drsTable->header.fileCount = 0;
+        }
+
+        drsTable = &update->result.tables[table];
+        file = drsTable->header.fileCount++;
+        drsTable->files[file].id = changes[i].id;
+        drsTable->files[file].offset = DRS_UPDATE_UNPLACED;
+        drsTable->files[file].size = 0;
+        update->sources[table][file] = (int)i;
+    }
+
+    /* Drop removed entries */
+    for (table = 0; table < update->result.header.tableCount; ++table) {
+        drsTable = &update->result.tables[table];
+
+        for (file = 0, i = 0; file < drsTable->header.fileCount; ++file) {
+            if (update->sources[table][file] != DRS_UPDATE_REMOVED) {
+                drsTable->files[i] = drsTable->files[file];
+                update->sources[table][i] = update->sources[table][file];
+                ++i;
+            }
+        }
+
+        drsTable->header.fileCount = (int)i;
+    }
+
+    return 0;
+}
+
+/* Payloads read from files must still be the size they were planned with */
+static int drs_update_check_sources(pDrsUpdate_t update, const drsChange_t* changes) {
+    size_t i;
+    size_t size;
+
+    for (i = 0; i < update->changeCount; ++i) {
+        if (update->fds[i] != -1 && (file_descriptor_size(update->fds[i], &size) || size != update->sizes[i])) {
+            fprintf(stderr, "File %s changed size during the update\n", changes[i].filePath);
+            return 8;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Place every payload without writing anything. Untouched entries stay
+ * where they are unless the grown header region now covers them. Changed
+ * entries are patched in place when they fit and no other entry shares
+ * their bytes, everything else is appended at the end.
+ **/
+static int drs_update_plan(pDrsUpdate_t update) {
+    int i;
+    int ii;
+    int source;
+    size_t size;
+    size_t position;
+    size_t appendAt = update->archive.fileSize;
+    size_t headerEnd = update->result.header.offset;
+    size_t limit = drs_offset_limit(&update->result);
+    size_t entries = 0;
+    drsFile_t *file = NULL;
+    pDrsUpdateMove_t move = NULL;
+
+    for (i = 0; i < update->result.header.tableCount; ++i) {
+        entries += update->result.tables[i].header.fileCount;
+    }
+
+    if (!(update->moves = malloc((entries ? entries : 1) * sizeof(drsUpdateMove_t)))) {
+        return 4;
+    }
+
+    for (i = 0; i < update->result.header.tableCount; ++i) {
+        for (ii = 0; ii < update->result.tables[i].header.fileCount; ++ii) {
+            file = &update->result.tables[i].files[ii];
+            source = update->sources[i][ii];
+            size = source == DRS_UPDATE_KEEP ? file->size : update->sizes[source];
+
+            if (source == DRS_UPDATE_KEEP && file->offset >= headerEnd) {
+                continue;
+            }
+
+            move = &update->moves[update->moveCount++];
+            move->file = file;
+            move->source = source;
+            move->from = file->offset;
+            move->inPlace = source != DRS_UPDATE_KEEP && file->offset != DRS_UPDATE_UNPLACED &&
+                file->offset >= headerEnd && size <= file->size &&
+                !drs_update_shared(update, file->offset, file->size);
+
+            if (move->inPlace) {
+                position = file->offset;
+            } else {
+                position = appendAt;
+                appendAt += size;
+            }
+
+            if (position > limit || size > limit - position) {
+                return 5;
+            }
+
+            file->offset = position;
+            file->size = size;
+        }
+    }
+
+    update->result.fileSize = appendAt;
+    return 0;
+}
+
+static int drs_update_write(pDrsUpdate_t update, const drsChange_t* changes, int fd, pDrsUpdateMove_t move) {
+    if (file_seek(fd, move->file->offset)) {
+        return 7;
+    }
+
+    /* Relocated out of the way of the header region */
+    if (move->source == DRS_UPDATE_KEEP) {
+        return file_copy_range(update->archive.fd, move->from, fd, move->file->size) ? 7 : 0;
+    }
+
+    if (update->fds[move->source] == -1) {
+        return file_write_all(fd, changes[move->source].data, move->file->size) ? 7 : 0;
+    }
+
+    return file_copy_range(update->fds[move->source], 0, fd, move->file->size) ? 7 : 0;
+}
+
+/**
+ * Appends first: until the header region is rewritten nothing points at
+ * them, so a failure there leaves the archive as it was. In-place patches
+ * overwrite live bytes and only start once everything else is out.
+ **/
+static int drs_update_payloads(pDrsUpdate_t update, const drsChange_t* changes, int fd) {
+    size_t i;
+    int pass;
+    int rc;
+
+    for (pass = 0; pass < 2; ++pass) {
+        if (pass && (rc = drs_update_check_sources(update, changes))) {
+            return rc;
+        }
+
+        for (i = 0; i < update->moveCount; ++i) {
+            /* A short copy is most likely a source that shrank, report it as such */
+            if (update->moves[i].inPlace == pass && (rc = drs_update_write(update, changes, fd, &update->moves[i]))) {
+                return drs_update_check_sources(update, changes) ? 8 : rc;
+            }
+        }
+    }
+
+    return 0;
+}
+
+int drs_update_archive(const char* archive, const drsChange_t* changes, size_t count) {
+    drsUpdate_t update;
+    unsigned char *headers = NULL;
+    size_t headerSize;
+    int fd;
+    int rc;
+
+    if (!archive || (!changes && count)) {
+        return 1;
+    }
+
+    memset(&update, 0, sizeof(update));
+    drs_init_empty(&update.result);
+
+    if ((rc = drs_open_index(archive, &update.archive))) {
+        drs_init_empty(&update.archive);
+        return rc == 1 ? 2 : rc;
+    }
+
+    if ((rc = drs_update_prepare(&update, count)) ||
+        (rc = drs_update_apply(&update, changes, count))) {
+        drs_update_free(&update);
+        return rc;
+    }
+
+    if (drs_layout_headers(&update.result)) {
+        drs_update_free(&update);
+        return 5;
+    }
+
+    if ((rc = drs_update_plan(&update))) {
+        drs_update_free(&update);
+        return rc;
+    }
+
+    headerSize = update.result.header.offset;
+
+    if (!(headers = malloc(headerSize))) {
+        drs_update_free(&update);
+        return 4;
+    }
+
+    if ((fd = file_open_readwrite(archive, NULL)) == -1) {
+        free(headers);
+        drs_update_free(&update);
+        return 6;
+    }
+
+    /* The header region last: a failed append leaves the old index pointing at the old payloads */
+    if (!(rc = drs_update_payloads(&update, changes, fd))) {
+        drs_encode_headers(&update.result, headers);
+
+        if (file_write_at(fd, headers, headerSize, 0)) {
+            rc = 7;
+        }
+    }
+
+    if (file_close_descriptor(fd) && !rc) {
+        rc = 7;
+    }
+
+    free(headers);
+    drs_update_free(&update);
+    return rc;
+}
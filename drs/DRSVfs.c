@@ -0,0 +1,279 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "DRSVfs.h"
+
+#define DRS_VFS_MIN_SLOTS 64
+
+/* Extensions are at most three bytes; bit 24 keeps a packed key non-zero */
+static unsigned int drs_vfs_pack(const char* extension) {
+    unsigned int packed = 1u << 24;
+    int i;
+
+    for (i = 0; i < DRS_TABLE_HDR_EXT_LENGTH && extension[i]; ++i) {
+        packed |= (unsigned int)(unsigned char)extension[i] << (8 * i);
+    }
+
+    return packed;
+}
+
+static void drs_vfs_unpack(unsigned int packed, char* extension) {
+    int i;
+
+    for (i = 0; i < DRS_TABLE_HDR_EXT_LENGTH; ++i) {
+        extension[i] = (char)((packed >> (8 * i)) & 0xFF);
+    }
+
+    extension[DRS_TABLE_HDR_EXT_LENGTH] = '\0';
+}
+
+static size_t drs_vfs_hash(int id, unsigned int extension) {
+    unsigned long long key = ((unsigned long long)(unsigned int)id << 32) | extension;
+
+    key *= 0x9E3779B97F4A7C15ULL;
+    return (size_t)(key ^ (key >> 29));
+}
+
+/* Higher priority wins, then the later mount */
+static int drs_vfs_wins(drsVfs_t* vfs, int challenger, int holder) {
+    if (vfs->mounts[challenger].priority != vfs->mounts[holder].priority) {
+        return vfs->mounts[challenger].priority > vfs->mounts[holder].priority;
+    }
+
+    return vfs->mounts[challenger].sequence > vfs->mounts[holder].sequence;
+}
+
+/**
+ * Slot holding the key, or NULL. With insert set, a missing key returns the
+ * slot it should go to instead, reusing the first tombstone on the way.
+ **/
+static pDrsVfsSlot_t drs_vfs_probe(drsVfs_t* vfs, int id, unsigned int extension, int insert) {
+    size_t mask = vfs->slotCapacity - 1;
+    size_t i = drs_vfs_hash(id, extension) & mask;
+    pDrsVfsSlot_t tombstone = NULL;
+    pDrsVfsSlot_t slot = NULL;
+
+    for (;; i = (i + 1) & mask) {
+        slot = &vfs->slots[i];
+
+        if (!slot->extension) {
+            return insert ? (tombstone ? tombstone : slot) : NULL;
+        }
+
+        if (slot->mount == -1) {
+            if (!tombstone) {
+                tombstone = slot;
+            }
+        } else if (slot->id == id && slot->extension == extension) {
+            return slot;
+        }
+    }
+}
+
+/* Keep the table under 70% full, tombstones included, before adding entries */
+static int drs_vfs_reserve(drsVfs_t* vfs, size_t extra) {
+    size_t i;
+    size_t capacity = DRS_VFS_MIN_SLOTS;
+    pDrsVfsSlot_t old = vfs->slots;
+    size_t oldCapacity = vfs->slotCapacity;
+    pDrsVfsSlot_t slot = NULL;
+
+    if ((vfs->used + vfs->deleted + extra) * 10 <= vfs->slotCapacity * 7) {
+        return 0;
+    }
+
+    while ((vfs->used + extra) * 10 > capacity * 5) {
+        capacity *= 2;
+    }
+
+    if (!(vfs->slots = calloc(capacity, sizeof(drsVfsSlot_t)))) {
+        vfs->slots = old;
+        return 1;
+    }
+
+    vfs->slotCapacity = capacity;
+    vfs->deleted = 0;
+
+    for (i = 0; i < oldCapacity; ++i) {
+        if (old[i].extension && old[i].mount != -1) {
+            slot = drs_vfs_probe(vfs, old[i].id, old[i].extension, 1);
+            *slot = old[i];
+        }
+    }
+
+    free(old);
+    return 0;
+}
+
+void drs_vfs_init(drsVfs_t* vfs) {
+    if (vfs) {
+        memset(vfs, 0, sizeof(drsVfs_t));
+    }
+}
+
+int drs_vfs_mount(drsVfs_t* vfs, drs_t* drs, int priority, int* handle) {
+    int i;
+    int ii;
+    int mount;
+    int count = 0;
+    unsigned int extension;
+    pDrsVfsMount_t pRealloc = NULL;
+    pDrsVfsSlot_t slot = NULL;
+
+    if (!vfs || !drs || (drs->header.tableCount && !drs->tables)) {
+        return 1;
+    }
+
+    for (i = 0; i < drs->header.tableCount; ++i) {
+        count += drs->tables[i].header.fileCount;
+    }
+
+    /* Unmounts re-resolve through the archive's own index */
+    if (count && !drs->index.entries && drs_index_build(drs)) {
+        return 2;
+    }
+
+    /* Reuse the first handle freed by an unmount */
+    mount = 0;
+    while (mount < vfs->mountCount && vfs->mounts[mount].drs) {
+        ++mount;
+    }
+
+    if (mount == vfs->mountCapacity) {
+        vfs->mountCapacity = vfs->mountCapacity ? vfs->mountCapacity * 2 : 8;
+
+        if (!(pRealloc = realloc(vfs->mounts, vfs->mountCapacity * sizeof(drsVfsMount_t)))) {
+            vfs->mountCapacity = mount;
+            return 2;
+        }
+
+        vfs->mounts = pRealloc;
+    }
+
+    if (drs_vfs_reserve(vfs, count)) {
+        return 2;
+    }
+
+    vfs->mounts[mount].drs = drs;
+    vfs->mounts[mount].priority = priority;
+    vfs->mounts[mount].sequence = ++vfs->sequence;
+
+    if (mount == vfs->mountCount) {
+        ++vfs->mountCount;
+    }
+
+    /* Header order, so a repeated ID+extension keeps its first entry like drs_find() */
+    for (i = 0; i < drs->header.tableCount; ++i) {
+        extension = drs_vfs_pack(drs->tables[i].header.extension);
+
+        for (ii = 0; ii < drs->tables[i].header.fileCount; ++ii) {
+            slot = drs_vfs_probe(vfs, drs->tables[i].files[ii].id, extension, 1);
+
+            if (slot->extension && slot->mount != -1) {
+                if (slot->mount == mount || !drs_vfs_wins(vfs, mount, slot->mount)) {
+                    continue;
+                }
+            } else {
+                vfs->deleted -= slot->extension ? 1 : 0;
+                ++vfs->used;
+            }
+
+            slot->id = drs->tables[i].files[ii].id;
+            slot->extension = extension;
+            slot->mount = mount;
+            slot->table = &drs->tables[i];
+            slot->file = &drs->tables[i].files[ii];
+        }
+    }
+
+    if (handle) {
+        *handle = mount;
+    }
+
+    return 0;
+}
+
+/**
+ * Only keys the archive was winning are touched: each falls back to the
+ * best remaining archive holding it, or is deleted if none does.
+ **/
+int drs_vfs_unmount(drsVfs_t* vfs, int handle) {
+    size_t i;
+    int mount;
+    int best;
+    char extension[DRS_TABLE_HDR_EXT_LENGTH+1];
+    pDrsFile_t file = NULL;
+    pDrsTable_t table = NULL;
+    pDrsVfsSlot_t slot = NULL;
+
+    if (!vfs || handle < 0 || handle >= vfs->mountCount || !vfs->mounts[handle].drs) {
+        return 1;
+    }
+
+    vfs->mounts[handle].drs = NULL;
+
+    for (i = 0; i < vfs->slotCapacity; ++i) {
+        slot = &vfs->slots[i];
+
+        if (!slot->extension || slot->mount != handle) {
+            continue;
+        }
+
+        drs_vfs_unpack(slot->extension, extension);
+        best = -1;
+
+        for (mount = 0; mount < vfs->mountCount; ++mount) {
+            if (!vfs->mounts[mount].drs || (best != -1 && !drs_vfs_wins(vfs, mount, best))) {
+                continue;
+            }
+
+            if ((file = drs_find(vfs->mounts[mount].drs, slot->id, extension, &table)) != NULL) {
+                best = mount;
+                slot->table = table;
+                slot->file = file;
+            }
+        }
+
+        slot->mount = best;
+
+        if (best == -1) {
+            slot->table = NULL;
+            slot->file = NULL;
+            --vfs->used;
+            ++vfs->deleted;
+        }
+    }
+
+    return 0;
+}
+
+pDrsFile_t drs_vfs_find(drsVfs_t* vfs, int id, const char* extension, drs_t** drs, pDrsTable_t* table) {
+    pDrsVfsSlot_t slot = NULL;
+
+    if (!vfs || !vfs->slots || !extension) {
+        return NULL;
+    }
+
+    if (!(slot = drs_vfs_probe(vfs, id, drs_vfs_pack(extension), 0))) {
+        return NULL;
+    }
+
+    if (drs) {
+        *drs = vfs->mounts[slot->mount].drs;
+    }
+
+    if (table) {
+        *table = slot->table;
+    }
+
+    return slot->file;
+}
+
+/* Archives are borrowed; closing them stays with the caller */
+void drs_vfs_free(drsVfs_t* vfs) {
+    if (vfs) {
+        free(vfs->slots);
+        free(vfs->mounts);
+        memset(vfs, 0, sizeof(drsVfs_t));
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef DRS_VFS_H
+#define DRS_VFS_H
+
+#include "DRSFormat.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Overlay of several archives, resolved the way the game does it: an entry
+ * in a higher priority archive shadows the same ID and extension in lower
+ * ones, and on equal priority the archive mounted last wins. One merged
+ * hash index answers lookups without visiting each archive.
+ **/
+
+typedef struct s_drsVfsMount {
+    drs_t*       drs;                            // Borrowed, NULL when the slot is free
+    int          priority;
+    unsigned int sequence;                       // Mount order, breaks priority ties
+} drsVfsMount_t, *pDrsVfsMount_t;
+
+typedef struct s_drsVfsSlot {
+    int          id;
+    unsigned int extension;                      // Packed extension, 0 for an empty slot
+    int          mount;                          // Winning mount, -1 for a deleted slot
+    pDrsTable_t  table;
+    pDrsFile_t   file;
+} drsVfsSlot_t, *pDrsVfsSlot_t;
+
+typedef struct s_drsVfs {
+    pDrsVfsMount_t mounts;
+    int          mountCount;                     // Slots in use or freed, handles index this
+    int          mountCapacity;
+    unsigned int sequence;
+    pDrsVfsSlot_t slots;                         // Open addressing, power of two capacity
+    size_t       slotCapacity;
+    size_t       used;                           // Live entries
+    size_t       deleted;                        // Tombstones left by unmounts
+} drsVfs_t, *pDrsVfs_t;
+
+void drs_vfs_init(drsVfs_t* vfs);
+int drs_vfs_mount(drsVfs_t* vfs, drs_t* drs, int priority, int* handle);
+int drs_vfs_unmount(drsVfs_t* vfs, int handle);
+pDrsFile_t drs_vfs_find(drsVfs_t* vfs, int id, const char* extension, drs_t** drs, pDrsTable_t* table);
+void drs_vfs_free(drsVfs_t* vfs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,407 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "FileManager.h"
+#include "DRSFormat.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+#define DRS_WATCH_DEBOUNCE_MS  100               // Quiet time that ends a burst
+#define DRS_WATCH_MAX_DELAY_MS 1000              // Longest a change waits during a steady stream
+#define DRS_WATCH_EVENT_BUFFER (64 * 1024)
+#define DRS_WATCH_MASK (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF)
+
+/**
+ * Keeps an archive in step with a directory in the layout extraction
+ * writes. The archive is built once, then every burst of changes becomes
+ * one drs_update_archive() call: only the touched payloads and the header
+ * region are written. Grown payloads move to the end of the archive and
+ * leave their old bytes behind, --repack reclaims the space.
+ **/
+
+typedef struct s_drsWatch {
+    const char*  dir;
+    const char*  output;
+    const drsWatchOptions_t* options;
+    drs_t        drs;                            // Output archive, index only
+    char**       pending;                        // Names touched since the last update
+    size_t       pendingCount;
+    size_t       pendingCapacity;
+    int          rebuild;                        // Events were lost, or a name needs a full build
+} drsWatch_t, *pDrsWatch_t;
+
+#ifdef __linux__
+
+static volatile sig_atomic_t drsWatchStop = 0;
+
+static void drs_watch_signal(int number) {
+    (void)number;
+    drsWatchStop = 1;
+}
+
+static long long drs_watch_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int drs_watch_compare_names(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static void drs_watch_clear(pDrsWatch_t watch) {
+    size_t i;
+
+    for (i = 0; i < watch->pendingCount; ++i) {
+        free(watch->pending[i]);
+    }
+
+    watch->pendingCount = 0;
+    watch->rebuild = 0;
+}
+
+static int drs_watch_add(pDrsWatch_t watch, const char* name) {
+    char **pRealloc = NULL;
+    char extension[DRS_TABLE_HDR_EXT_LENGTH+1];
+    int id;
+
+    /* Editor backups, swap files and the like */
+    if (drs_parse_file_name(name, &id, extension)) {
+        return 0;
+    }
+
+    /* <id>_NNN.<ext> is a repeated ID, updates only ever reach the first one */
+    if (strchr(name, '_')) {
+        watch->rebuild = 1;
+        return 0;
+    }
+
+    if (watch->pendingCount == watch->pendingCapacity) {
+        if (!(pRealloc = realloc(watch->pending, (watch->pendingCapacity ? watch->pendingCapacity * 2 : 64) * sizeof(char*)))) {
+            return 4;
+        }
+
+        watch->pending = pRealloc;
+        watch->pendingCapacity = watch->pendingCapacity ? watch->pendingCapacity * 2 : 64;
+    }
+
+    if (!(watch->pending[watch->pendingCount] = malloc(strlen(name) + 1))) {
+        return 4;
+    }
+
+    strcpy(watch->pending[watch->pendingCount++], name);
+    return 0;
+}
+
+/* Same size and bytes as the archive entry: a save without edits */
+static int drs_watch_unchanged(pDrsWatch_t watch, const drsChange_t* change, size_t size) {
+    drsTable_t *table = NULL;
+    drsFile_t *file = NULL;
+    unsigned char *stored = NULL;
+    unsigned char *current = NULL;
+    size_t currentSize = 0;
+    int same = 0;
+
+    if (!(file = drs_find(&watch->drs, change->id, change->extension, &table)) || file->size != size) {
+        return 0;
+    }
+
+    if ((stored = malloc(size ? size : 1)) &&
+        !drs_read_entry(&watch->drs, (int)(table - watch->drs.tables), (int)(file - table->files), stored) &&
+        !file_get_contents(change->filePath, &current, &currentSize)) {
+        same = currentSize == size && !memcmp(stored, current, size);
+    }
+
+    free(stored);
+    free(current);
+    return same;
+}
+
+static int drs_watch_build(pDrsWatch_t watch) {
+    drsCreateOptions_t createOptions;
+    drsCreateStats_t createStats;
+    long long start = drs_watch_now();
+    int rc;
+
+    drs_free(&watch->drs);
+    drs_init_empty(&watch->drs);
+
+    /* Never deduplicated: updates patch payloads in place */
+    createOptions.dedup = 0;
+    createOptions.extended = 0;
+    createOptions.jobs = watch->options ? watch->options->jobs : 1;
+
+    if ((rc = drs_create_from_directory(watch->dir, watch->output, &createOptions, &createStats)) ||
+        (rc = drs_open_index(watch->output, &watch->drs))) {
+        drs_init_empty(&watch->drs);
+        return rc;
+    }
+
+    printf("Built %s from %s in %lld ms\n", watch->output, watch->dir, drs_watch_now() - start);
+    fflush(stdout);
+    return 0;
+}
+
+static int drs_watch_update(pDrsWatch_t watch) {
+    drsChange_t *changes = NULL;
+    char **paths = NULL;
+    size_t count = 0;
+    size_t unique = 0;
+    size_t size;
+    size_t i;
+    long long start = drs_watch_now();
+    int rc = 0;
+
+    qsort(watch->pending, watch->pendingCount, sizeof(char*), drs_watch_compare_names);
+
+    if (!(changes = calloc(watch->pendingCount, sizeof(drsChange_t))) ||
+        !(paths = calloc(watch->pendingCount, sizeof(char*)))) {
+        free(changes);
+        return 4;
+    }
+
+    for (i = 0; i < watch->pendingCount && !rc; ++i) {
+        if (i && !strcmp(watch->pending[i], watch->pending[i-1])) {
+            continue;
+        }
+
+        ++unique;
+        memset(&changes[count], 0, sizeof(drsChange_t));
+        drs_parse_file_name(watch->pending[i], &changes[count].id, changes[count].extension);
+
+        if (!(paths[count] = malloc(strlen(watch->dir) + strlen(watch->pending[i]) + 2))) {
+            rc = 4;
+            break;
+        }
+
+        sprintf(paths[count], "%s%c%s", watch->dir, FS_DIR_CHAR, watch->pending[i]);
+
+        if (!file_info(paths[count], &size, NULL)) {
+            changes[count].type = DRS_CHANGE_PUT;
+            changes[count].filePath = paths[count];
+
+            if (drs_watch_unchanged(watch, &changes[count], size)) {
+                free(paths[count]);
+                paths[count] = NULL;
+                continue;
+            }
+        } else if (drs_find(&watch->drs, changes[count].id, changes[count].extension, NULL)) {
+            changes[count].type = DRS_CHANGE_REMOVE;
+        } else {
+            free(paths[count]);
+            paths[count] = NULL;
+            continue;
+        }
+
+        ++count;
+    }
+
+    /* The update reopens the archive for writing */
+    if (!rc && count) {
+        drs_free(&watch->drs);
+        drs_init_empty(&watch->drs);
+
+        if (!(rc = drs_update_archive(watch->output, changes, count))) {
+            rc = drs_open_index(watch->output, &watch->drs);
+        }
+
+        if (!rc) {
+            printf("Updated %zu of %zu changed files in %lld ms\n", count, unique, drs_watch_now() - start);
+            fflush(stdout);
+        }
+    }
+
+    for (i = 0; i <= count && i < watch->pendingCount; ++i) {
+        free(paths[i]);
+    }
+
+    free(paths);
+    free(changes);
+    return rc;
+}
+
+static int drs_watch_flush(pDrsWatch_t watch) {
+    int rc;
+
+    if (watch->rebuild) {
+        rc = drs_watch_build(watch);
+    } else {
+        rc = drs_watch_update(watch);
+    }
+
+    if (!rc && watch->options && watch->options->sidecar) {
+        rc = drs_sidecar_write(&watch->drs, watch->output, watch->options->jobs);
+    }
+
+    drs_watch_clear(watch);
+
+    /* A file deleted or still being written, the next build sees it settled */
+    if (rc == 6 || rc == 8) {
+        fprintf(stderr, "Failed to update %s (%d), rebuilding it\n", watch->output, rc);
+        watch->rebuild = 1;
+        rc = 0;
+    }
+
+    return rc;
+}
+
+/* Drain the inotify queue into the pending names, 1 when the directory went away */
+static int drs_watch_read(pDrsWatch_t watch, int fd, char* buffer) {
+    const struct inotify_event *event = NULL;
+    ssize_t got;
+    ssize_t at;
+    int rc;
+
+    while ((got = read(fd, buffer, DRS_WATCH_EVENT_BUFFER)) > 0) {
+        for (at = 0; at < got; at += sizeof(struct inotify_event) + event->len) {
+            event = (const struct inotify_event*)&buffer[at];
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                watch->rebuild = 1;
+            } else if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                fprintf(stderr, "%s was removed, stopping\n", watch->dir);
+                return 1;
+            } else if (event->len && !(event->mask & IN_ISDIR) && (rc = drs_watch_add(watch, event->name))) {
+                return rc;
+            }
+        }
+    }
+
+    return (got == -1 && errno != EAGAIN && errno != EINTR) ? 6 : 0;
+}
+
+static int drs_watch_loop(pDrsWatch_t watch) {
+    struct pollfd descriptor;
+    char *buffer = NULL;
+    long long firstEvent = 0;
+    long long now;
+    int timeout;
+    int fd;
+    int rc = 0;
+
+    if ((fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1 ||
+        inotify_add_watch(fd, watch->dir, DRS_WATCH_MASK) == -1) {
+        fprintf(stderr, "Failed to watch %s\n", watch->dir);
+
+        if (fd != -1) {
+            close(fd);
+        }
+
+        return 6;
+    }
+
+    if (!(buffer = malloc(DRS_WATCH_EVENT_BUFFER))) {
+        close(fd);
+        return 4;
+    }
+
+    /* Subscribed before the first build, so nothing saved during it is missed */
+    if (!(rc = drs_watch_build(watch))) {
+        printf("Watching %s, Ctrl+C to stop\n", watch->dir);
+        fflush(stdout);
+    }
+
+    descriptor.fd = fd;
+    descriptor.events = POLLIN;
+
+    while (!rc && !drsWatchStop) {
+        timeout = -1;
+
+        if (watch->pendingCount || watch->rebuild) {
+            now = drs_watch_now();
+            timeout = (int)(firstEvent + DRS_WATCH_MAX_DELAY_MS - now);
+            timeout = timeout < 0 ? 0 : timeout < DRS_WATCH_DEBOUNCE_MS ? timeout : DRS_WATCH_DEBOUNCE_MS;
+        }
+
+        switch (poll(&descriptor, 1, timeout)) {
+        case -1:
+            rc = errno == EINTR ? 0 : 6;
+            break;
+        case 0:
+            rc = drs_watch_flush(watch);
+            firstEvent = drs_watch_now();
+            break;
+        default:
+            if (!watch->pendingCount && !watch->rebuild) {
+                firstEvent = drs_watch_now();
+            }
+
+            rc = drs_watch_read(watch, fd, buffer);
+
+            if (!rc && (watch->pendingCount || watch->rebuild) &&
+                drs_watch_now() - firstEvent >= DRS_WATCH_MAX_DELAY_MS) {
+                rc = drs_watch_flush(watch);
+                firstEvent = drs_watch_now();
+            }
+        }
+    }
+
+    /* Whatever arrived before the stop still lands in the archive */
+    if (!rc && (watch->pendingCount || watch->rebuild)) {
+        rc = drs_watch_flush(watch);
+    }
+
+    /* No later change to retry on, a failure here is the result */
+    if (!rc && watch->rebuild) {
+        rc = drs_watch_build(watch);
+    }
+
+    free(buffer);
+    close(fd);
+    return rc;
+}
+
+#endif
+
+/**
+ * Build output from dir, then follow changes to dir until SIGINT or
+ * SIGTERM. Names that are not <id>.<ext> are ignored. A file deleted or
+ * still growing while it is read fails the update, the archive is then
+ * rebuilt instead of ending the watch. Linux only, there is no inotify
+ * elsewhere.
+ **/
+int drs_watch(const char* dir, const char* output, const drsWatchOptions_t* options) {
+#ifdef __linux__
+    struct sigaction action;
+    drsWatch_t watch;
+    int rc;
+
+    if (!dir || !output || !directory_exists(dir)) {
+        return 1;
+    }
+
+    memset(&watch, 0, sizeof(watch));
+    watch.dir = dir;
+    watch.output = output;
+    watch.options = options;
+    drs_init_empty(&watch.drs);
+
+    /* No SA_RESTART, so poll() wakes up to see the stop flag */
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = drs_watch_signal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    rc = drs_watch_loop(&watch);
+
+    drs_watch_clear(&watch);
+    free(watch.pending);
+    drs_free(&watch.drs);
+    return rc;
+#else
+    (void)dir;
+    (void)output;
+    (void)options;
+    fprintf(stderr, "--watch needs inotify and is only available on Linux\n");
+    return 1;
+#endif
+}
@@ -1,254 +1,854 @@
-#include <stdlib.h>
-#include <sys/types.h>
-#include <sys/stat.h>
-
-#include "FileManager.h"
-
-#ifdef OS_IS_WINDOWS
-#include <windows.h>
-#include <io.h>
-#include <direct.h>
-#include <tchar.h>
-#include <strsafe.h>
-#define FD_ACCESS(p, d) _access(p, d)
-#define MK_DIR(d) _mkdir(d)
-#pragma comment(lib, "User32.lib")
-#else
-#include <unistd.h>
-#include <dirent.h>
-#define FD_ACCESS(p, d) access(p, d)
-#define MK_DIR(d) mkdir(d, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH)
-#endif
-
-FILE* file_open(const char* filePath, const char* flags) {
-    FILE *fd = fopen(filePath, flags);
-    return fd;
-}
-
-int file_close(FILE* fd) {
-    if (fd) {
-        fclose(fd);
-        fd = NULL;
-        return 0;
-    }
-
-    return 1;
-}
-
-int file_get_contents(const char* filePath, unsigned char** buffer, size_t* size) {
-    FILE *fd;
-    long fsize;
-
-    *size = 0;
-
-    if (!filePath || *buffer) {
-        return 1;
-    }
-
-    if ((fd = file_open(filePath, "rb")) == NULL) {
-        return 2;
-    }
-
-    fseek(fd, 0, SEEK_END);
-    fsize = ftell(fd);
-    fseek(fd, 0, SEEK_SET);
-
-    if (fsize == -1) {
-        fclose(fd);
-        return 3;
-    }
-
-    *buffer = malloc(fsize + 1);
-
-    if (!*buffer) {
-        fclose(fd);
-        return 4;
-    }
-
-    if (fread(*buffer, fsize, 1, fd) != 1) {
-        free(*buffer);
-        *buffer = NULL;
-        fclose(fd);
-        return 5;
-    }
-
-    if (file_close(fd)) {
-        free(*buffer);
-        *buffer = NULL;
-
-        return 6;
-    }
-
-    *size = (size_t)fsize;
-    return 0;
-}
-
-int file_put_contents(const char* filePath, unsigned char* buffer, size_t size) {
-    FILE *fd;
-    size_t rc = 0;
-
-    if (!filePath || !buffer || !size) {
-        return 1;
-    }
-
-    if ((fd = file_open(filePath, "wb")) == NULL) {
-        return 2;
-    }
-
-    if ((rc = fwrite(buffer, 1, size, fd)) == size) {
-        rc = 0;
-    } else {
-        rc = 3;
-    }
-
-    if (file_close(fd)) {
-        return 4;
-    }
-
-    return (int)rc;
-}
-
-/* getline() is not an ANSI C function, hence unreferenced on ARM and some compilers. */
-size_t
-fm_getline(char** dst, size_t *bytes, FILE *fd) {
-    char *pRealloc = NULL;
-    char currentChar = '\0';
-    size_t charsRead = 0;
-    int memAlloced = 0;
-
-    if (!fd) {
-        return 0;
-    }
-
-    if (*dst && *bytes<2) {
-        return 0;
-    }
-    else if (!*dst) {
-        *bytes = 64;
-        *dst = malloc(*bytes * sizeof(char));
-        memAlloced = 1;
-
-        if (!*dst) {
-            *bytes = 0;
-            return 0;
-        }
-    }
-
-    while ((currentChar = getc(fd)) && !feof(fd) && (currentChar != '\n')) {
-        (*dst)[charsRead++] = currentChar;
-
-        if (charsRead == *bytes) {
-            if (!memAlloced) {
-                charsRead -= 1;
-                break;
-            }
-
-            *bytes += 64;
-            pRealloc = realloc(*dst, *bytes * sizeof(char));
-
-            if (pRealloc) {
-                *dst = pRealloc;
-            }
-            else {
-                if (*dst) {
-                    free(*dst);
-                }
-
-                *bytes = 0;
-                return 0;
-            }
-        }
-    }
-
-    (*dst)[charsRead] = '\0';
-    *bytes = charsRead;
-
-    return (*bytes * sizeof(char));
-}
-
-int file_exists(const char* filePath) {
-    if (FD_ACCESS(filePath, 0) != -1) {
-        return 1;
-    }
-
-    return 0;
-}
-
-int directory_exists(const char* filePath) {
-    struct stat status;
-
-    if (FD_ACCESS(filePath, 0) == 0) {
-        stat(filePath, &status);
-        return (status.st_mode & S_IFDIR) != 0;
-    }
-
-    return 0;
-}
-
-int create_directory(const char* directoryName) {
-    if (!directoryName) {
-        return -1;
-    }
-
-    return MK_DIR(directoryName);
-}
-
-int directory_scan(const char* dirName, const char* contents, size_t* size) {
-#ifdef OS_IS_WINDOWS
-    TCHAR szDir[MAX_PATH];
-    size_t argLength;
-    WIN32_FIND_DATA findData;
-    HANDLE fileHandle = INVALID_HANDLE_VALUE;
-    LARGE_INTEGER filesize;
-#else
-    DIR *dp;
-    struct dirent *ep;
-#endif
-
-    if (!dirName || !contents || !size) {
-        fprintf(stderr, "%s: invalid parameters\n", __FUNCTION__);
-        return 1;
-    }
-
-    if (!directory_exists(dirName)) {
-        fprintf(stderr, "%s: not a directory: %s\n", __FUNCTION__, dirName);
-        return 1;
-    }
-
-#ifdef OS_IS_WINDOWS
-    StringCchLength(dirName, MAX_PATH, &argLength);
-
-    if (argLength > (MAX_PATH - 3)) {
-        fprintf(stderr, "%s: too long directory name: %llu (max %u)\n",
-            __FUNCTION__, (unsigned long long)argLength, MAX_PATH);
-        return 1;
-    }
-
-    StringCchCopy(szDir, MAX_PATH, dirName);
-    StringCchCat(szDir, MAX_PATH, TEXT("\\*"));
-
-    if ((fileHandle = FindFirstFile(szDir, &findData)) != INVALID_HANDLE_VALUE) {
-        do {
-            if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
-                printf(" <DIR> %s\n", findData.cFileName);
-            } else {
-                filesize.LowPart = findData.nFileSizeLow;
-                filesize.HighPart = findData.nFileSizeHigh;
-                printf(" %s   %lld bytes\n", findData.cFileName, filesize.QuadPart);
-            }
-        } while (FindNextFile(fileHandle, &findData));
-#else
-    if ((dp = opendir(dirName))) {
-        while (ep = readdir(dp)) {
-            printf("%s\n", ep->d_name);
-        }
-
-        (void)closedir(dp);
-#endif
-    } else {
-        fprintf(stderr, "%s: couldn't open directory %s\n", __FUNCTION__, dirName);
-        return 1;
-    }
-
-    return 0;
-}
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "FileManager.h"
+#include "Stats.h"
+
+#ifdef OS_IS_WINDOWS
+#include <windows.h>
+#include <io.h>
+#include <direct.h>
+#include <tchar.h>
+#include <strsafe.h>
+#include <fcntl.h>
+#define FD_ACCESS(p, d) _access(p, d)
+#define MK_DIR(d) _mkdir(d)
+#pragma comment(lib, "User32.lib")
+#else
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#endif
+#define FD_ACCESS(p, d) access(p, d)
+#define MK_DIR(d) mkdir(d, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH)
+#endif
+
+FILE* file_open(const char* filePath, const char* flags) {
+    FILE *fd = fopen(filePath, flags);
+    return fd;
+}
+
+int file_close(FILE* fd) {
+    if (fd) {
+        fclose(fd);
+        fd = NULL;
+        return 0;
+    }
+
+    return 1;
+}
+
+int file_get_contents(const char* filePath, unsigned char** buffer, size_t* size) {
+    FILE *fd;
+    long fsize;
+
+    *size = 0;
+
+    if (!filePath || *buffer) {
+        return 1;
+    }
+
+    if ((fd = file_open(filePath, "rb")) == NULL) {
+        return 2;
+    }
+
+    STATS_ADD(STATS_SYSCALL_OPEN, 1);
+
+    fseek(fd, 0, SEEK_END);
+    fsize = ftell(fd);
+    fseek(fd, 0, SEEK_SET);
+
+    if (fsize == -1) {
+        fclose(fd);
+        return 3;
+    }
+
+    *buffer = malloc(fsize + 1);
+
+    if (!*buffer) {
+        fclose(fd);
+        return 4;
+    }
+
+    STATS_ALLOC(fsize + 1);
+
+    if (fread(*buffer, fsize, 1, fd) != 1) {
+        free(*buffer);
+        *buffer = NULL;
+        fclose(fd);
+        return 5;
+    }
+
+    STATS_ADD(STATS_SYSCALL_READ, 1);
+    STATS_ADD(STATS_BYTES_READ, fsize);
+
+    if (file_close(fd)) {
+        free(*buffer);
+        *buffer = NULL;
+
+        return 6;
+    }
+
+    *size = (size_t)fsize;
+    return 0;
+}
+
+int file_put_contents(const char* filePath, unsigned char* buffer, size_t size) {
+    FILE *fd;
+    size_t rc = 0;
+
+    if (!filePath || (!buffer && size)) {
+        return 1;
+    }
+
+    if ((fd = file_open(filePath, "wb")) == NULL) {
+        return 2;
+    }
+
+    STATS_ADD(STATS_SYSCALL_OPEN, 1);
+
+    if (!size || (rc = fwrite(buffer, 1, size, fd)) == size) {
+        STATS_ADD(STATS_SYSCALL_WRITE, size ? 1 : 0);
+        STATS_ADD(STATS_BYTES_WRITTEN, size);
+        rc = 0;
+    } else {
+        rc = 3;
+    }
+
+    if (file_close(fd)) {
+        return 4;
+    }
+
+    return (int)rc;
+}
+
+int file_map(const char* filePath, unsigned char** buffer, size_t* size) {
+#ifdef OS_IS_WINDOWS
+    HANDLE fileHandle;
+    HANDLE mapHandle;
+    LARGE_INTEGER fsize;
+#else
+    int fd;
+    struct stat status;
+#endif
+    void *view;
+
+    *size = 0;
+
+    if (!filePath || *buffer) {
+        return 1;
+    }
+
+#ifdef OS_IS_WINDOWS
+    fileHandle = CreateFileA(filePath, GENERIC_READ, FILE_SHARE_READ, NULL,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+        return 2;
+    }
+
+    if (!GetFileSizeEx(fileHandle, &fsize) || fsize.QuadPart == 0) {
+        CloseHandle(fileHandle);
+        return 3;
+    }
+
+    if ((mapHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL)) == NULL) {
+        CloseHandle(fileHandle);
+        return 4;
+    }
+
+    /* The view keeps the mapping alive, the handles can go right away */
+    view = MapViewOfFile(mapHandle, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapHandle);
+    CloseHandle(fileHandle);
+
+    if (!view) {
+        return 5;
+    }
+
+    *size = (size_t)fsize.QuadPart;
+#else
+    if ((fd = open(filePath, O_RDONLY)) == -1) {
+        return 2;
+    }
+
+    if (fstat(fd, &status) == -1 || status.st_size == 0) {
+        close(fd);
+        return 3;
+    }
+
+    /* The mapping holds its own reference to the file */
+    view = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (view == MAP_FAILED) {
+        return 5;
+    }
+
+    *size = (size_t)status.st_size;
+#endif
+
+    STATS_ADD(STATS_SYSCALL_OPEN, 1);
+    STATS_ADD(STATS_SYSCALL_MAP, 1);
+    *buffer = view;
+    return 0;
+}
+
+int file_unmap(unsigned char* buffer, size_t size) {
+    if (!buffer) {
+        return 1;
+    }
+
+#ifdef OS_IS_WINDOWS
+    (void)size;
+    return UnmapViewOfFile(buffer) ? 0 : 2;
+#else
+    return munmap(buffer, size) ? 2 : 0;
+#endif
+}
+
+int file_open_readonly(const char* filePath, size_t* size) {
+#ifdef OS_IS_WINDOWS
+    struct _stati64 status;
+    int fd = _open(filePath, _O_RDONLY | _O_BINARY);
+
+    if (fd != -1 && _fstati64(fd, &status) == -1) {
+#else
+    struct stat status;
+    int fd = open(filePath, O_RDONLY);
+
+    if (fd != -1 && fstat(fd, &status) == -1) {
+#endif
+        file_close_descriptor(fd);
+        return -1;
+    }
+
+    if (fd != -1 && size) {
+        *size = (size_t)status.st_size;
+    }
+
+    STATS_ADD(STATS_SYSCALL_OPEN, 1);
+    return fd;
+}
+
+/* Current size of an open file, it may have changed since it was opened */
+int file_descriptor_size(int fd, size_t* size) {
+#ifdef OS_IS_WINDOWS
+    struct _stati64 status;
+
+    if (_fstati64(fd, &status) == -1) {
+#else
+    struct stat status;
+
+    if (fstat(fd, &status) == -1) {
+#endif
+        return 1;
+    }
+
+    *size = (size_t)status.st_size;
+    return 0;
+}
+
+int file_read_at(int fd, unsigned char* buffer, size_t size, size_t offset) {
+#ifdef OS_IS_WINDOWS
+    OVERLAPPED overlapped;
+    DWORD bytesRead;
+    HANDLE fileHandle = (HANDLE)_get_osfhandle(fd);
+
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+        return 1;
+    }
+
+    /* Positional read; leaves the shared file pointer alone */
+    while (size) {
+        memset(&overlapped, 0, sizeof(overlapped));
+        overlapped.Offset = (DWORD)((unsigned long long)offset & 0xFFFFFFFF);
+        overlapped.OffsetHigh = (DWORD)((unsigned long long)offset >> 32);
+
+        if (!ReadFile(fileHandle, buffer, size > 0x40000000 ? 0x40000000 : (DWORD)size,
+                &bytesRead, &overlapped) || !bytesRead) {
+            return 2;
+        }
+#else
+    ssize_t bytesRead;
+
+    while (size) {
+        if ((bytesRead = pread(fd, buffer, size, (off_t)offset)) <= 0) {
+            if (bytesRead == -1 && errno == EINTR) {
+                continue;
+            }
+
+            return 2;
+        }
+#endif
+
+        STATS_ADD(STATS_SYSCALL_READ, 1);
+        STATS_ADD(STATS_BYTES_READ, bytesRead);
+        buffer += bytesRead;
+        offset += bytesRead;
+        size -= bytesRead;
+    }
+
+    return 0;
+}
+
+int file_close_descriptor(int fd) {
+    if (fd == -1) {
+        return 1;
+    }
+
+#ifdef OS_IS_WINDOWS
+    return _close(fd) ? 2 : 0;
+#else
+    return close(fd) ? 2 : 0;
+#endif
+}
+
+int file_open_readwrite(const char* filePath, size_t* size) {
+#ifdef OS_IS_WINDOWS
+    struct _stati64 status;
+    int fd = _open(filePath, _O_RDWR | _O_BINARY);
+
+    if (fd != -1 && _fstati64(fd, &status) == -1) {
+#else
+    struct stat status;
+    int fd = open(filePath, O_RDWR);
+
+    if (fd != -1 && fstat(fd, &status) == -1) {
+#endif
+        file_close_descriptor(fd);
+        return -1;
+    }
+
+    if (fd != -1 && size) {
+        *size = (size_t)status.st_size;
+    }
+
+    STATS_ADD(STATS_SYSCALL_OPEN, 1);
+    return fd;
+}
+
+int file_write_at(int fd, const unsigned char* buffer, size_t size, size_t offset) {
+#ifdef OS_IS_WINDOWS
+    OVERLAPPED overlapped;
+    DWORD bytesWritten;
+    HANDLE fileHandle = (HANDLE)_get_osfhandle(fd);
+
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+        return 1;
+    }
+
+    while (size) {
+        memset(&overlapped, 0, sizeof(overlapped));
+        overlapped.Offset = (DWORD)((unsigned long long)offset & 0xFFFFFFFF);
+        overlapped.OffsetHigh = (DWORD)((unsigned long long)offset >> 32);
+
+        if (!WriteFile(fileHandle, buffer, size > 0x40000000 ? 0x40000000 : (DWORD)size,
+                &bytesWritten, &overlapped) || !bytesWritten) {
+            return 2;
+        }
+#else
+    ssize_t bytesWritten;
+
+    while (size) {
+        if ((bytesWritten = pwrite(fd, buffer, size, (off_t)offset)) <= 0) {
+            if (bytesWritten == -1 && errno == EINTR) {
+                continue;
+            }
+
+            return 2;
+        }
+#endif
+
+        STATS_ADD(STATS_SYSCALL_WRITE, 1);
+        STATS_ADD(STATS_BYTES_WRITTEN, bytesWritten);
+        buffer += bytesWritten;
+        offset += bytesWritten;
+        size -= bytesWritten;
+    }
+
+    return 0;
+}
+
+int file_seek(int fd, size_t offset) {
+#ifdef OS_IS_WINDOWS
+    return _lseeki64(fd, (__int64)offset, SEEK_SET) == -1 ? 1 : 0;
+#else
+    return lseek(fd, (off_t)offset, SEEK_SET) == (off_t)-1 ? 1 : 0;
+#endif
+}
+
+int file_create(const char* filePath) {
+#ifdef OS_IS_WINDOWS
+    int fd = _open(filePath, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    int fd = open(filePath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+
+    if (fd != -1) {
+        STATS_ADD(STATS_SYSCALL_OPEN, 1);
+    }
+
+    return fd;
+}
+
+/**
+ * Creates name inside the directory and fails if it is already there, so
+ * one call both claims the name and opens it. Relative to the descriptor
+ * from directory_open() when there is one, to dirName otherwise.
+ * Returns the descriptor, -2 if the name is taken, -1 on other errors.
+ **/
+int file_create_exclusive(int dirFd, const char* dirName, const char* name) {
+    char *path = NULL;
+    int fd;
+
+    if (dirFd != -1) {
+#ifdef OS_IS_LINUX
+        fd = openat(dirFd, name, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+#else
+        fd = -1;
+#endif
+    } else if ((path = malloc(strlen(dirName) + strlen(name) + 2)) != NULL) {
+        sprintf(path, "%s%c%s", dirName, FS_DIR_CHAR, name);
+#ifdef OS_IS_WINDOWS
+        fd = _open(path, _O_WRONLY | _O_CREAT | _O_EXCL | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+        fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+#endif
+        free(path);
+    } else {
+        return -1;
+    }
+
+    if (fd != -1) {
+        STATS_ADD(STATS_SYSCALL_OPEN, 1);
+        return fd;
+    }
+
+    return errno == EEXIST ? -2 : -1;
+}
+
+int file_write_all(int fd, const unsigned char* buffer, size_t size) {
+#ifdef OS_IS_WINDOWS
+    int written;
+#else
+    ssize_t written;
+#endif
+
+    while (size) {
+#ifdef OS_IS_WINDOWS
+        if ((written = _write(fd, buffer, size > 0x40000000 ? 0x40000000 : (unsigned int)size)) <= 0) {
+            return 1;
+        }
+#else
+        if ((written = write(fd, buffer, size)) <= 0) {
+            if (written == -1 && errno == EINTR) {
+                continue;
+            }
+
+            return 1;
+        }
+#endif
+
+        STATS_ADD(STATS_SYSCALL_WRITE, 1);
+        STATS_ADD(STATS_BYTES_WRITTEN, written);
+        buffer += written;
+        size -= written;
+    }
+
+    return 0;
+}
+
+/**
+ * For read-only mappings: on Linux the pages go to a pipe by reference with
+ * vmsplice(), so the mapping must stay unchanged until the reader is done.
+ * Anything that is not a pipe gets plain writes.
+ **/
+int file_write_pages(int fd, const unsigned char* buffer, size_t size) {
+#ifdef __linux__
+    struct iovec iov;
+    ssize_t written;
+
+    while (size) {
+        iov.iov_base = (void*)buffer;
+        iov.iov_len = size;
+
+        if ((written = vmsplice(fd, &iov, 1, 0)) <= 0) {
+            if (written == -1 && errno == EINTR) {
+                continue;
+            }
+
+            break;
+        }
+
+        STATS_ADD(STATS_SYSCALL_WRITE, 1);
+        STATS_ADD(STATS_BYTES_WRITTEN, written);
+        buffer += written;
+        size -= written;
+    }
+#endif
+
+    return size ? file_write_all(fd, buffer, size) : 0;
+}
+
+/* Sequential read for pipes and terminals; *got < size only at end of input */
+int file_read_stream(int fd, unsigned char* buffer, size_t size, size_t* got) {
+#ifdef OS_IS_WINDOWS
+    int bytesRead;
+#else
+    ssize_t bytesRead;
+#endif
+
+    *got = 0;
+
+    while (size) {
+#ifdef OS_IS_WINDOWS
+        if ((bytesRead = _read(fd, buffer, size > 0x40000000 ? 0x40000000 : (unsigned int)size)) < 0) {
+            return 1;
+        }
+#else
+        if ((bytesRead = read(fd, buffer, size)) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return 1;
+        }
+#endif
+
+        if (!bytesRead) {
+            break;
+        }
+
+        STATS_ADD(STATS_SYSCALL_READ, 1);
+        STATS_ADD(STATS_BYTES_READ, bytesRead);
+        buffer += bytesRead;
+        size -= bytesRead;
+        *got += bytesRead;
+    }
+
+    return 0;
+}
+
+/* Plain read/write loop for when the kernel cannot copy for us */
+static int file_copy_range_buffered(int inFd, size_t inOffset, int outFd, size_t size) {
+    unsigned char *buffer = NULL;
+    size_t chunk;
+
+    if (!(buffer = malloc(FM_COPY_BUFFER_SIZE))) {
+        return 2;
+    }
+
+    STATS_ALLOC(FM_COPY_BUFFER_SIZE);
+
+    while (size) {
+        chunk = size < FM_COPY_BUFFER_SIZE ? size : FM_COPY_BUFFER_SIZE;
+
+        if (file_read_at(inFd, buffer, chunk, inOffset) || file_write_all(outFd, buffer, chunk)) {
+            free(buffer);
+            return 3;
+        }
+
+        inOffset += chunk;
+        size -= chunk;
+    }
+
+    free(buffer);
+    return 0;
+}
+
+int file_copy_range(int inFd, size_t inOffset, int outFd, size_t size) {
+#ifdef __linux__
+    loff_t offIn = (loff_t)inOffset;
+    off_t sendOffset;
+    ssize_t copied;
+
+    /* Same filesystem: no data through user space, reflinks where supported */
+    while (size) {
+        if ((copied = copy_file_range(inFd, &offIn, outFd, NULL, size, 0)) <= 0) {
+            if (copied == -1 && errno == EINTR) {
+                continue;
+            }
+
+            break;
+        }
+
+        STATS_ADD(STATS_SYSCALL_COPY, 1);
+        STATS_ADD(STATS_BYTES_WRITTEN, copied);
+        size -= copied;
+    }
+
+    /* Cross-filesystem or old kernel: still zero-copy via the page cache */
+    sendOffset = (off_t)offIn;
+    while (size) {
+        if ((copied = sendfile(outFd, inFd, &sendOffset, size)) <= 0) {
+            if (copied == -1 && errno == EINTR) {
+                continue;
+            }
+
+            break;
+        }
+
+        STATS_ADD(STATS_SYSCALL_COPY, 1);
+        STATS_ADD(STATS_BYTES_WRITTEN, copied);
+        size -= copied;
+    }
+
+    inOffset = (size_t)sendOffset;
+#endif
+
+    if (!size) {
+        return 0;
+    }
+
+    return file_copy_range_buffered(inFd, inOffset, outFd, size);
+}
+
+/* getline() is not an ANSI C function, hence unreferenced on ARM and some compilers. */
+size_t
+fm_getline(char** dst, size_t *bytes, FILE *fd) {
+    char *pRealloc = NULL;
+    char currentChar = '\0';
+    size_t charsRead = 0;
+    int memAlloced = 0;
+
+    if (!fd) {
+        return 0;
+    }
+
+    if (*dst && *bytes<2) {
+        return 0;
+    }
+    else if (!*dst) {
+        *bytes = 64;
+        *dst = malloc(*bytes * sizeof(char));
+        memAlloced = 1;
+
+        if (!*dst) {
+            *bytes = 0;
+            return 0;
+        }
+    }
+
+    while ((currentChar = getc(fd)) && !feof(fd) && (currentChar != '\n')) {
+        (*dst)[charsRead++] = currentChar;
+
+        if (charsRead == *bytes) {
+            if (!memAlloced) {
+                charsRead -= 1;
+                break;
+            }
+
+            *bytes += 64;
+            pRealloc = realloc(*dst, *bytes * sizeof(char));
+
+            if (pRealloc) {
+                *dst = pRealloc;
+            }
+            else {
+                if (*dst) {
+                    free(*dst);
+                }
+
+                *bytes = 0;
+                return 0;
+            }
+        }
+    }
+
+    (*dst)[charsRead] = '\0';
+    *bytes = charsRead;
+
+    return (*bytes * sizeof(char));
+}
+
+int file_info(const char* filePath, size_t* size, long long* modified) {
+#ifdef OS_IS_WINDOWS
+    struct _stati64 status;
+
+    if (!filePath || _stati64(filePath, &status)) {
+#else
+    struct stat status;
+
+    if (!filePath || stat(filePath, &status)) {
+#endif
+        return 1;
+    }
+
+    if (size) {
+        *size = (size_t)status.st_size;
+    }
+
+    if (modified) {
+#ifdef __linux__
+        *modified = (long long)status.st_mtim.tv_sec * 1000000000LL + status.st_mtim.tv_nsec;
+#else
+        *modified = (long long)status.st_mtime;
+#endif
+    }
+
+    return 0;
+}
+
+/* Whether both paths name the same existing file, through links and relative paths */
+int file_same(const char* lhs, const char* rhs) {
+#ifdef OS_IS_WINDOWS
+    char lhsPath[_MAX_PATH];
+    char rhsPath[_MAX_PATH];
+
+    return lhs && rhs && _fullpath(lhsPath, lhs, _MAX_PATH) && _fullpath(rhsPath, rhs, _MAX_PATH) &&
+        !_stricmp(lhsPath, rhsPath);
+#else
+    struct stat lhsStatus;
+    struct stat rhsStatus;
+
+    return lhs && rhs && !stat(lhs, &lhsStatus) && !stat(rhs, &rhsStatus) &&
+        lhsStatus.st_dev == rhsStatus.st_dev && lhsStatus.st_ino == rhsStatus.st_ino;
+#endif
+}
+
+int file_exists(const char* filePath) {
+    if (FD_ACCESS(filePath, 0) != -1) {
+        return 1;
+    }
+
+    return 0;
+}
+
+int directory_exists(const char* filePath) {
+    struct stat status;
+
+    if (FD_ACCESS(filePath, 0) == 0) {
+        stat(filePath, &status);
+        return (status.st_mode & S_IFDIR) != 0;
+    }
+
+    return 0;
+}
+
+/* Descriptor for file_create_exclusive(), -1 where there is no openat() */
+int directory_open(const char* dirName) {
+#ifdef OS_IS_LINUX
+    int fd = open(dirName, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (fd != -1) {
+        STATS_ADD(STATS_SYSCALL_OPEN, 1);
+    }
+
+    return fd;
+#else
+    (void)dirName;
+    return -1;
+#endif
+}
+
+int directory_close(int dirFd) {
+    return dirFd == -1 ? 0 : file_close_descriptor(dirFd);
+}
+
+int create_directory(const char* directoryName) {
+    if (!directoryName) {
+        return -1;
+    }
+
+    return MK_DIR(directoryName);
+}
+
+int directory_scan(const char* dirName, directory_scan_fn callback, void* userData) {
+#ifdef OS_IS_WINDOWS
+    TCHAR szDir[MAX_PATH];
+    size_t argLength;
+    WIN32_FIND_DATA findData;
+    HANDLE fileHandle = INVALID_HANDLE_VALUE;
+    LARGE_INTEGER filesize;
+#else
+    DIR *dp;
+    struct dirent *ep;
+    struct stat status;
+    char *path = NULL;
+    size_t dirNameLen;
+#endif
+    int rc = 0;
+
+    if (!dirName || !callback) {
+        fprintf(stderr, "%s: invalid parameters\n", __FUNCTION__);
+        return 1;
+    }
+
+    if (!directory_exists(dirName)) {
+        fprintf(stderr, "%s: not a directory: %s\n", __FUNCTION__, dirName);
+        return 1;
+    }
+
+#ifdef OS_IS_WINDOWS
+    StringCchLength(dirName, MAX_PATH, &argLength);
+
+    if (argLength > (MAX_PATH - 3)) {
+        fprintf(stderr, "%s: too long directory name: %llu (max %u)\n",
+            __FUNCTION__, (unsigned long long)argLength, MAX_PATH);
+        return 1;
+    }
+
+    StringCchCopy(szDir, MAX_PATH, dirName);
+    StringCchCat(szDir, MAX_PATH, TEXT("\\*"));
+
+    if ((fileHandle = FindFirstFile(szDir, &findData)) != INVALID_HANDLE_VALUE) {
+        do {
+            if (!strcmp(findData.cFileName, ".") || !strcmp(findData.cFileName, "..")) {
+                continue;
+            }
+
+            filesize.LowPart = findData.nFileSizeLow;
+            filesize.HighPart = findData.nFileSizeHigh;
+            rc = callback(findData.cFileName, (size_t)filesize.QuadPart,
+                (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0, userData);
+        } while (!rc && FindNextFile(fileHandle, &findData));
+
+        FindClose(fileHandle);
+#else
+    dirNameLen = strlen(dirName);
+
+    if (!(path = malloc(dirNameLen + 258))) {
+        return 1;
+    }
+
+    if ((dp = opendir(dirName))) {
+        while (!rc && (ep = readdir(dp))) {
+            if (!strcmp(ep->d_name, ".") || !strcmp(ep->d_name, "..")) {
+                continue;
+            }
+
+            /* d_name is at most 255 characters */
+            sprintf(path, "%s%c%s", dirName, FS_DIR_CHAR, ep->d_name);
+
+            if (stat(path, &status)) {
+                continue;
+            }
+
+            rc = callback(ep->d_name, (size_t)status.st_size, S_ISDIR(status.st_mode), userData);
+        }
+
+        (void)closedir(dp);
+        free(path);
+#endif
+    } else {
+#ifndef OS_IS_WINDOWS
+        free(path);
+#endif
+        fprintf(stderr, "%s: couldn't open directory %s\n", __FUNCTION__, dirName);
+        return 1;
+    }
+
+    return rc;
+}
@@ -1,29 +1,62 @@
-#ifndef FILE_MANAGER_H
-#define FILE_MANAGER_H
-
-#if defined(_WIN32) || defined(_WIN64)
-#define FS_DIR_CHAR '\\'
-#ifndef OS_IS_WINDOWS
-#define OS_IS_WINDOWS
-#endif
-#else
-#define FS_DIR_CHAR '/'
-#ifndef OS_IS_LINUX
-#define OS_IS_LINUX
-#endif
-#endif
-
-#include <stdio.h>
-
-FILE* file_open(const char* filePath, const char* flags);
-size_t fm_getline(char** dst, size_t *bytes, FILE *fd);
-int file_close(FILE* fd);
-int file_get_contents(const char* filePath, unsigned char** buffer, size_t* size);
-int file_put_contents(const char* filePath, unsigned char* buffer, size_t size);
-
-int file_exists(const char* filePath);
-int directory_exists(const char* filePath);
-int directory_scan(const char* dirName, const char* contents, size_t* size);
-int create_directory(const char* directoryName);
-
-#endif
+#ifndef FILE_MANAGER_H
+#define FILE_MANAGER_H
+
+#if defined(_WIN32) || defined(_WIN64)
+#define FS_DIR_CHAR '\\'
+#ifndef OS_IS_WINDOWS
+#define OS_IS_WINDOWS
+#endif
+#else
+#define FS_DIR_CHAR '/'
+#ifndef OS_IS_LINUX
+#define OS_IS_LINUX
+#endif
+#endif
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FM_COPY_BUFFER_SIZE (256 * 1024)
+
+FILE* file_open(const char* filePath, const char* flags);
+size_t fm_getline(char** dst, size_t *bytes, FILE *fd);
+int file_close(FILE* fd);
+int file_get_contents(const char* filePath, unsigned char** buffer, size_t* size);
+int file_put_contents(const char* filePath, unsigned char* buffer, size_t size);
+int file_map(const char* filePath, unsigned char** buffer, size_t* size);
+int file_unmap(unsigned char* buffer, size_t size);
+
+int file_open_readonly(const char* filePath, size_t* size);
+int file_descriptor_size(int fd, size_t* size);
+int file_read_at(int fd, unsigned char* buffer, size_t size, size_t offset);
+int file_close_descriptor(int fd);
+int file_open_readwrite(const char* filePath, size_t* size);
+int file_write_at(int fd, const unsigned char* buffer, size_t size, size_t offset);
+int file_seek(int fd, size_t offset);
+int file_create(const char* filePath);
+int file_create_exclusive(int dirFd, const char* dirName, const char* name);
+int file_write_all(int fd, const unsigned char* buffer, size_t size);
+int file_write_pages(int fd, const unsigned char* buffer, size_t size);
+int file_read_stream(int fd, unsigned char* buffer, size_t size, size_t* got);
+int file_copy_range(int inFd, size_t inOffset, int outFd, size_t size);
+
+int file_info(const char* filePath, size_t* size, long long* modified);
+int file_exists(const char* filePath);
+int file_same(const char* lhs, const char* rhs);
+int directory_exists(const char* filePath);
+/* Called for every entry but . and .., a non-zero return stops the scan */
+typedef int (*directory_scan_fn)(const char* name, size_t size, int isDirectory, void* userData);
+
+int directory_scan(const char* dirName, directory_scan_fn callback, void* userData);
+int directory_open(const char* dirName);
+int directory_close(int dirFd);
+int create_directory(const char* directoryName);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
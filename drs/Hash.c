@@ -0,0 +1,134 @@
+#include <string.h>
+
+#include "Hash.h"
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+#define HASH_ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+static hash64_t hash_read64(const unsigned char* p) {
+    return (hash64_t)p[0] | ((hash64_t)p[1] << 8) | ((hash64_t)p[2] << 16) |
+        ((hash64_t)p[3] << 24) | ((hash64_t)p[4] << 32) | ((hash64_t)p[5] << 40) |
+        ((hash64_t)p[6] << 48) | ((hash64_t)p[7] << 56);
+}
+
+static hash64_t hash_read32(const unsigned char* p) {
+    return (hash64_t)p[0] | ((hash64_t)p[1] << 8) | ((hash64_t)p[2] << 16) | ((hash64_t)p[3] << 24);
+}
+
+static hash64_t hash_round(hash64_t acc, hash64_t input) {
+    acc += input * PRIME64_2;
+    acc = HASH_ROTL64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static hash64_t hash_merge_round(hash64_t acc, hash64_t val) {
+    acc ^= hash_round(0, val);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+void hash_init(hashState_t* state, hash64_t seed) {
+    memset(state, 0, sizeof(hashState_t));
+    state->seed = seed;
+    state->v[0] = seed + PRIME64_1 + PRIME64_2;
+    state->v[1] = seed + PRIME64_2;
+    state->v[2] = seed;
+    state->v[3] = seed - PRIME64_1;
+}
+
+void hash_update(hashState_t* state, const void* data, size_t size) {
+    const unsigned char *p = data;
+    const unsigned char *end = p + size;
+    size_t fill;
+
+    state->totalLength += size;
+
+    /* Top up a partial stripe first */
+    if (state->bufferSize) {
+        fill = 32 - state->bufferSize;
+
+        if (size < fill) {
+            memcpy(&state->buffer[state->bufferSize], p, size);
+            state->bufferSize += size;
+            return;
+        }
+
+        memcpy(&state->buffer[state->bufferSize], p, fill);
+        state->v[0] = hash_round(state->v[0], hash_read64(&state->buffer[0]));
+        state->v[1] = hash_round(state->v[1], hash_read64(&state->buffer[8]));
+        state->v[2] = hash_round(state->v[2], hash_read64(&state->buffer[16]));
+        state->v[3] = hash_round(state->v[3], hash_read64(&state->buffer[24]));
+        state->bufferSize = 0;
+        p += fill;
+    }
+
+    while (end - p >= 32) {
+        state->v[0] = hash_round(state->v[0], hash_read64(p));
+        state->v[1] = hash_round(state->v[1], hash_read64(p + 8));
+        state->v[2] = hash_round(state->v[2], hash_read64(p + 16));
+        state->v[3] = hash_round(state->v[3], hash_read64(p + 24));
+        p += 32;
+    }
+
+    if (p < end) {
+        memcpy(state->buffer, p, end - p);
+        state->bufferSize = end - p;
+    }
+}
+
+hash64_t hash_final(const hashState_t* state) {
+    const unsigned char *p = state->buffer;
+    const unsigned char *end = p + state->bufferSize;
+    hash64_t h;
+
+    if (state->totalLength >= 32) {
+        h = HASH_ROTL64(state->v[0], 1) + HASH_ROTL64(state->v[1], 7) +
+            HASH_ROTL64(state->v[2], 12) + HASH_ROTL64(state->v[3], 18);
+        h = hash_merge_round(h, state->v[0]);
+        h = hash_merge_round(h, state->v[1]);
+        h = hash_merge_round(h, state->v[2]);
+        h = hash_merge_round(h, state->v[3]);
+    } else {
+        h = state->seed + PRIME64_5;
+    }
+
+    h += state->totalLength;
+
+    while (end - p >= 8) {
+        h ^= hash_round(0, hash_read64(p));
+        h = HASH_ROTL64(h, 27) * PRIME64_1 + PRIME64_4;
+        p += 8;
+    }
+
+    if (end - p >= 4) {
+        h ^= hash_read32(p) * PRIME64_1;
+        h = HASH_ROTL64(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+
+    while (p < end) {
+        h ^= (*p) * PRIME64_5;
+        h = HASH_ROTL64(h, 11) * PRIME64_1;
+        ++p;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+hash64_t hash_xxh64(const void* data, size_t size, hash64_t seed) {
+    hashState_t state;
+
+    hash_init(&state, seed);
+    hash_update(&state, data, size);
+    return hash_final(&state);
+}
@@ -0,0 +1,31 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* XXH64, fast non-cryptographic hash for change detection */
+typedef unsigned long long hash64_t;
+
+typedef struct s_hashState {
+    hash64_t     v[4];
+    hash64_t     seed;
+    hash64_t     totalLength;
+    unsigned char buffer[32];
+    size_t       bufferSize;
+} hashState_t, *pHashState_t;
+
+void hash_init(hashState_t* state, hash64_t seed);
+void hash_update(hashState_t* state, const void* data, size_t size);
+hash64_t hash_final(const hashState_t* state);
+
+hash64_t hash_xxh64(const void* data, size_t size, hash64_t seed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
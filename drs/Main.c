@@ -1,94 +1,783 @@
-#include <stdio.h>
-#include <string.h>
-
-#include "FileManager.h"
-#include "DRSFormat.h"
-
-//#define DRS_FILE "Interfac.drs"
-#define DRS_FILE "sounds.drs"
-//#define DRS_FILE "generated.drs"
-
-#ifdef OS_IS_WINDOWS
-#define FILE_PATH "C:\\Program Files (x86)\\Microsoft Games\\Age of Empires\\data\\" DRS_FILE
-#else
-#define FILE_PATH "../" DRS_FILE
-#endif
-
-typedef struct config_s {
-    const char*  filePath;
-    unsigned int create;
-    unsigned int extract;
-} config_t, *pConfig_t;
-
-int parseParams(int argc, char* argv[], pConfig_t conf) {
-    size_t idx;
-
-    conf->filePath = FILE_PATH;
-    conf->create   = 0;
-    conf->extract  = 0;
-
-    for (idx = 0; idx < (size_t)argc; ++idx) {
-        if (!strcmp("-e", argv[idx]) || !strcmp("--extract", argv[idx])) {
-            conf->extract = 1;
-            continue;
-        }
-
-        if (!strcmp("-c", argv[idx]) || !strcmp("--create", argv[idx])) {
-            conf->create = 1;
-            continue;
-        }
-
-        if ((!strcmp("-f", argv[idx]) || !strcmp("--file", argv[idx])) && (idx+1 != argc)) {
-            conf->filePath = argv[++idx];
-            continue;
-        }
-    }
-
-    if (conf->create == conf->extract) {
-        fprintf(stderr, "Please specify either --create or --extract\n");
-        return 1;
-    }
-
-    if (!conf->filePath || conf->filePath[0] == '\0') {
-        fprintf(stderr, "Invalid file path specified\n");
-        return 1;
-    }
-
-    return 0;
-}
-
-void usage(void) {
-    printf("Not implemented\n");
-}
-
-int main(int argc, char* argv[]) {
-    drs_t drs;
-    config_t config;
-    size_t dirEntries;
-    char *contents = argv[0]; // temporary
-    int rc = 0;
-
-    if (parseParams(argc, argv, &config)) {
-        usage();
-        return 1;
-    }
-
-    if (config.extract) {
-        rc = drs_load(config.filePath, &drs);
-
-        if (rc) {
-            printf("RETURNED %d\n", rc);
-        } else {
-            drs_print_header(&drs, stdout);
-            drs_extract_archive(&drs, "drsFiles");
-            //drs_create_archive(&drs, "../generated.drs");
-            drs_free(&drs);
-        }
-    } else {
-        drs_init_empty(&drs);
-        rc = directory_scan(config.filePath, contents, &dirEntries);
-    }
-
-    return rc;
-}
-
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "FileManager.h"
+#include "Stats.h"
+#include "DRSFormat.h"
+#include "DRSBatch.h"
+#include "DRSServe.h"
+
+#ifdef OS_IS_WINDOWS
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+//#define DRS_FILE "Interfac.drs"
+#define DRS_FILE "sounds.drs"
+//#define DRS_FILE "generated.drs"
+
+#ifdef OS_IS_WINDOWS
+#define FILE_PATH "C:\\Program Files (x86)\\Microsoft Games\\Age of Empires\\data\\" DRS_FILE
+#else
+#define FILE_PATH "../" DRS_FILE
+#endif
+
+typedef struct config_s {
+    const char*  filePath;
+    const char*  output;
+    const char*  batchManifest;
+    const char*  batchGlob;
+    const char*  diffTarget;                     // Newer archive to diff filePath against
+    const char*  patchFile;                      // Patch to apply to filePath
+    const char*  serveSocket;                    // Unix socket to serve the archives on
+    size_t       cacheSize;                      // Payload cache of the server, in bytes
+    unsigned int create;
+    unsigned int extract;
+    unsigned int list;
+    int          listFormat;                     // drsListFormat_t, -1 for the text listing
+    unsigned int update;
+    unsigned int repack;
+    int          convert;                        // Target: 1 extended, 0 classic, -1 none
+    unsigned int extended;                       // Create the 64-bit variant
+    unsigned int verify;
+    unsigned int watch;
+    unsigned int fullVerify;
+    unsigned int sidecar;
+    unsigned int dedup;
+    unsigned int tarStdout;                      // Extract as a tar stream on stdout
+    unsigned int tarStdin;                       // Create from a tar stream on stdin
+    unsigned int stats;
+    statsFormat_t statsFormat;
+    drsRepackOptions_t repackOptions;
+    drsFilter_t  filter;                         // Entries to extract
+    drsChange_t* changes;
+    size_t       changeCount;
+    unsigned int mapped;
+    unsigned int kernelCopy;
+    int          jobs;
+} config_t, *pConfig_t;
+
+int parseChange(const char* option, const char* path, drsChange_t* change) {
+    const char *name = strrchr(path, FS_DIR_CHAR);
+
+    name = name ? name + 1 : path;
+    memset(change, 0, sizeof(drsChange_t));
+    change->type = strcmp(option, "--remove") ? DRS_CHANGE_PUT : DRS_CHANGE_REMOVE;
+    change->filePath = change->type == DRS_CHANGE_PUT ? path : NULL;
+
+    return drs_parse_file_name(name, &change->id, change->extension);
+}
+
+int parseParams(int argc, char* argv[], pConfig_t conf) {
+    size_t idx;
+
+    conf->filePath = FILE_PATH;
+    conf->output   = NULL;
+    conf->batchManifest = NULL;
+    conf->batchGlob = NULL;
+    conf->diffTarget = NULL;
+    conf->patchFile = NULL;
+    conf->serveSocket = NULL;
+    conf->cacheSize = DRS_SERVE_DEFAULT_CACHE;
+    conf->create   = 0;
+    conf->extract  = 0;
+    conf->list     = 0;
+    conf->listFormat = -1;
+    conf->update   = 0;
+    conf->repack   = 0;
+    conf->convert  = -1;
+    conf->extended = 0;
+    conf->verify   = 0;
+    conf->watch    = 0;
+    conf->fullVerify = 0;
+    conf->sidecar  = 0;
+    conf->dedup    = 0;
+    conf->tarStdout = 0;
+    conf->tarStdin = 0;
+    conf->stats    = 0;
+    conf->statsFormat = STATS_FORMAT_TABLE;
+    memset(&conf->repackOptions, 0, sizeof(drsRepackOptions_t));
+    drs_filter_init(&conf->filter);
+    conf->changeCount = 0;
+    conf->mapped   = 0;
+    conf->kernelCopy = 0;
+    conf->jobs     = 1;
+
+    for (idx = 0; idx < (size_t)argc; ++idx) {
+        if (!strcmp("-e", argv[idx]) || !strcmp("--extract", argv[idx])) {
+            conf->extract = 1;
+            continue;
+        }
+
+        if (!strcmp("-c", argv[idx]) || !strcmp("--create", argv[idx])) {
+            conf->create = 1;
+            continue;
+        }
+
+        if (!strcmp("-l", argv[idx]) || !strcmp("--list", argv[idx])) {
+            conf->list = 1;
+            continue;
+        }
+
+        if (!strcmp("-u", argv[idx]) || !strcmp("--update", argv[idx])) {
+            conf->update = 1;
+            continue;
+        }
+
+        if (!strcmp("-r", argv[idx]) || !strcmp("--repack", argv[idx])) {
+            conf->repack = 1;
+            continue;
+        }
+
+        /* --convert extended lifts the 2 GB limit, --convert classic goes back */
+        if (!strcmp("--convert", argv[idx]) && (idx+1 != argc)) {
+            ++idx;
+            if (!strcmp("classic", argv[idx])) {
+                conf->convert = 0;
+            } else if (!strcmp("extended", argv[idx])) {
+                conf->convert = 1;
+            } else {
+                fprintf(stderr, "Unknown variant %s, expected classic or extended\n", argv[idx]);
+                return 1;
+            }
+            continue;
+        }
+
+        if (!strcmp("--extended", argv[idx])) {
+            conf->extended = 1;
+            continue;
+        }
+
+        if (!strcmp("--diff", argv[idx]) && (idx+1 != argc)) {
+            conf->diffTarget = argv[++idx];
+            continue;
+        }
+
+        if (!strcmp("--patch", argv[idx]) && (idx+1 != argc)) {
+            conf->patchFile = argv[++idx];
+            continue;
+        }
+
+        if (!strcmp("--verify", argv[idx])) {
+            conf->verify = 1;
+            continue;
+        }
+
+        if (!strcmp("--serve", argv[idx]) && (idx+1 != argc)) {
+            conf->serveSocket = argv[++idx];
+            continue;
+        }
+
+        if (!strcmp("--cache", argv[idx]) && (idx+1 != argc)) {
+            conf->cacheSize = (size_t)strtoul(argv[++idx], NULL, 10) << 20;
+            continue;
+        }
+
+        if (!strcmp("-w", argv[idx]) || !strcmp("--watch", argv[idx])) {
+            conf->watch = 1;
+            continue;
+        }
+
+        if (!strcmp("--full", argv[idx])) {
+            conf->fullVerify = 1;
+            continue;
+        }
+
+        if (!strcmp("-s", argv[idx]) || !strcmp("--sidecar", argv[idx])) {
+            conf->sidecar = 1;
+            continue;
+        }
+
+        /* --stats prints a table, --stats=json a single JSON object, both on stderr */
+        if (!strcmp("--stats", argv[idx]) || !strcmp("--stats=table", argv[idx])) {
+            conf->stats = 1;
+            continue;
+        }
+
+        if (!strcmp("--stats=json", argv[idx])) {
+            conf->stats = 1;
+            conf->statsFormat = STATS_FORMAT_JSON;
+            continue;
+        }
+
+        /* Entry listings for tools, written in one pass from the headers */
+        if (!strncmp("--format=", argv[idx], 9)) {
+            if (!strcmp("tsv", &argv[idx][9])) {
+                conf->listFormat = DRS_LIST_TSV;
+            } else if (!strcmp("json", &argv[idx][9])) {
+                conf->listFormat = DRS_LIST_JSON;
+            } else if (!strcmp("binary", &argv[idx][9])) {
+                conf->listFormat = DRS_LIST_BINARY;
+            } else {
+                fprintf(stderr, "Unknown format %s, expected tsv, json or binary\n", &argv[idx][9]);
+                return 1;
+            }
+            continue;
+        }
+
+        /* Pipes between build stages, nothing touches the disk in between */
+        if (!strcmp("--to-stdout=tar", argv[idx])) {
+            conf->tarStdout = 1;
+            continue;
+        }
+
+        if (!strcmp("--from-stdin=tar", argv[idx])) {
+            conf->tarStdin = 1;
+            continue;
+        }
+
+        if (!strcmp("--dedup", argv[idx])) {
+            conf->dedup = 1;
+            continue;
+        }
+
+        if (!strcmp("--order", argv[idx]) && (idx+1 != argc)) {
+            ++idx;
+            if (!strcmp("header", argv[idx])) {
+                conf->repackOptions.order = DRS_REPACK_ORDER_HEADER;
+            } else if (!strcmp("id", argv[idx])) {
+                conf->repackOptions.order = DRS_REPACK_ORDER_ID;
+            } else if (!strcmp("trace", argv[idx])) {
+                conf->repackOptions.order = DRS_REPACK_ORDER_TRACE;
+            } else {
+                fprintf(stderr, "Unknown order %s, expected header, id or trace\n", argv[idx]);
+                return 1;
+            }
+            continue;
+        }
+
+        if (!strcmp("--trace", argv[idx]) && (idx+1 != argc)) {
+            conf->repackOptions.traceFile = argv[++idx];
+            continue;
+        }
+
+        if (!strcmp("--align", argv[idx]) && (idx+1 != argc)) {
+            conf->repackOptions.alignment = (size_t)strtoul(argv[++idx], NULL, 10);
+            continue;
+        }
+
+        /* --put <path>, the name <id>.<ext> says which entry it replaces */
+        if ((!strcmp("--put", argv[idx]) || !strcmp("--remove", argv[idx])) && (idx+1 != argc)) {
+            if (parseChange(argv[idx], argv[idx+1], &conf->changes[conf->changeCount])) {
+                fprintf(stderr, "Expected <id>.<ext>, got %s\n", argv[idx+1]);
+                return 1;
+            }
+
+            ++conf->changeCount;
+            ++idx;
+            continue;
+        }
+
+        /* --ext slp,wav --id 3000-3999,4005 --table 0, every option given must match */
+        if (!strcmp("--ext", argv[idx]) && (idx+1 != argc)) {
+            if (drs_filter_add_extensions(&conf->filter, argv[++idx])) {
+                fprintf(stderr, "Expected extensions like slp,wav, got %s\n", argv[idx]);
+                return 1;
+            }
+            continue;
+        }
+
+        if (!strcmp("--id", argv[idx]) && (idx+1 != argc)) {
+            if (drs_filter_add_ids(&conf->filter, argv[++idx])) {
+                fprintf(stderr, "Expected IDs like 3000-3999,4005, got %s\n", argv[idx]);
+                return 1;
+            }
+            continue;
+        }
+
+        if (!strcmp("--table", argv[idx]) && (idx+1 != argc)) {
+            if (drs_filter_add_tables(&conf->filter, argv[++idx])) {
+                fprintf(stderr, "Expected table numbers like 0,2, got %s\n", argv[idx]);
+                return 1;
+            }
+            continue;
+        }
+
+        if (!strcmp("-m", argv[idx]) || !strcmp("--mmap", argv[idx])) {
+            conf->mapped = 1;
+            continue;
+        }
+
+        if (!strcmp("-k", argv[idx]) || !strcmp("--kernel-copy", argv[idx])) {
+            conf->kernelCopy = 1;
+            continue;
+        }
+
+        if ((!strcmp("-j", argv[idx]) || !strcmp("--jobs", argv[idx])) && (idx+1 != argc)) {
+            conf->jobs = atoi(argv[++idx]);
+            continue;
+        }
+
+        if ((!strcmp("-o", argv[idx]) || !strcmp("--output", argv[idx])) && (idx+1 != argc)) {
+            conf->output = argv[++idx];
+            continue;
+        }
+
+        /* --batch <manifest> and --glob <pattern> take the place of --file */
+        if (!strcmp("--batch", argv[idx]) && (idx+1 != argc)) {
+            conf->batchManifest = argv[++idx];
+            continue;
+        }
+
+        if (!strcmp("--glob", argv[idx]) && (idx+1 != argc)) {
+            conf->batchGlob = argv[++idx];
+            continue;
+        }
+
+        if ((!strcmp("-f", argv[idx]) || !strcmp("--file", argv[idx])) && (idx+1 != argc)) {
+            conf->filePath = argv[++idx];
+            continue;
+        }
+    }
+
+    if (conf->create + conf->extract + conf->list + conf->update + conf->repack + (conf->convert >= 0) +
+        conf->verify + conf->watch + !!conf->diffTarget + !!conf->patchFile + !!conf->serveSocket != 1) {
+        fprintf(stderr, "Please specify either --create, --extract, --list, --update, --repack, --convert, --verify, --watch, --diff, --patch or --serve\n");
+        return 1;
+    }
+
+    if (conf->extended && (!conf->create || conf->tarStdin)) {
+        fprintf(stderr, "--extended goes with --create from a directory, use --convert for existing archives\n");
+        return 1;
+    }
+
+    if (!drs_filter_empty(&conf->filter) && !conf->extract) {
+        fprintf(stderr, "--ext, --id and --table only apply to --extract\n");
+        return 1;
+    }
+
+    if ((conf->tarStdout && !conf->extract) || (conf->tarStdin && (!conf->create || conf->dedup))) {
+        fprintf(stderr, "--to-stdout=tar goes with --extract, --from-stdin=tar with --create without --dedup\n");
+        return 1;
+    }
+
+    if (conf->listFormat >= 0 && !conf->list) {
+        fprintf(stderr, "--format only applies to --list\n");
+        return 1;
+    }
+
+    if ((conf->batchManifest || conf->batchGlob) && !conf->list && !conf->extract && !conf->verify && !conf->serveSocket) {
+        fprintf(stderr, "--batch and --glob work with --list, --extract, --verify or --serve\n");
+        return 1;
+    }
+
+    if (conf->repackOptions.order == DRS_REPACK_ORDER_TRACE && !conf->repackOptions.traceFile) {
+        fprintf(stderr, "--order trace needs a --trace file\n");
+        return 1;
+    }
+
+    if (!conf->filePath || conf->filePath[0] == '\0') {
+        fprintf(stderr, "Invalid file path specified\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Hash index next to an archive this run wrote */
+int writeSidecar(const char* archivePath, int jobs) {
+    drs_t drs;
+    int rc;
+
+    if ((rc = drs_open_index(archivePath, &drs))) {
+        return rc;
+    }
+
+    rc = drs_sidecar_write(&drs, archivePath, jobs);
+    drs_free(&drs);
+    return rc;
+}
+
+/* Patch from filePath to the --diff archive, both mapped for byte comparison */
+int diffArchives(pConfig_t conf) {
+    drs_t from;
+    drs_t to;
+    drsDiffStats_t diffStats;
+    int rc;
+
+    if ((rc = drs_open_mapped(conf->filePath, &from))) {
+        return rc;
+    }
+
+    if ((rc = drs_open_mapped(conf->diffTarget, &to))) {
+        drs_free(&from);
+        return rc;
+    }
+
+    if (!(rc = drs_diff(&from, &to, conf->output ? conf->output : "update.drsp", &diffStats))) {
+        printf("%20s  %d added, %d removed, %d changed, %d unchanged\n", "Entries:",
+            diffStats.added, diffStats.removed, diffStats.changed, diffStats.unchanged);
+        printf("%20s  %zu bytes (%zu bytes of new payloads, archive %zu bytes)\n", "Patch:",
+            diffStats.patchSize, diffStats.payloadBytes, to.fileSize);
+    }
+
+    drs_free(&to);
+    drs_free(&from);
+    return rc;
+}
+
+/**
+ * Rewrite filePath in the other variant. Payloads move behind the resized
+ * header region in header order, shared ones stay shared, and --align,
+ * --order and --dedup apply as for --repack.
+ **/
+int convertArchive(pConfig_t conf) {
+    drs_t drs;
+    drsRepackStats_t repackStats;
+    const char *output = conf->output ? conf->output : "converted.drs";
+    int rc;
+
+    /* Payloads come from a mapping of the input, rewriting it in place would zero them */
+    if (file_same(conf->filePath, output)) {
+        fprintf(stderr, "The output of --convert must not be the input archive\n");
+        return 1;
+    }
+
+    if ((rc = drs_open_mapped(conf->filePath, &drs))) {
+        return rc;
+    }
+
+    conf->repackOptions.dedup = conf->dedup;
+    drs_set_extended(&drs, conf->convert);
+
+    if ((rc = drs_repack(&drs, &conf->repackOptions, &repackStats))) {
+        fprintf(stderr, "%s does not fit in a %s archive\n", conf->filePath, conf->convert ? "extended" : "classic");
+    } else if (!(rc = drs_create_archive(&drs, output))) {
+        printf("%20s  %s %s (%zu -> %zu bytes)\n", "Converted:", output, drs.header.version,
+            repackStats.oldSize, repackStats.newSize);
+    }
+
+    if (!rc && conf->sidecar) {
+        rc = writeSidecar(output, conf->jobs);
+    }
+
+    drs_free(&drs);
+    return rc;
+}
+
+/* One operation over every archive of the manifest and/or glob */
+int runBatch(pConfig_t conf) {
+    drsBatch_t batch;
+    drsBatchOp_t op = conf->list ? DRS_BATCH_LIST : conf->extract ? DRS_BATCH_EXTRACT : DRS_BATCH_VERIFY;
+    int rc = 0;
+
+    drs_batch_init(&batch, op, conf->output ? conf->output : "drsFiles", conf->jobs);
+    batch.storage = conf->kernelCopy ? DRS_STORAGE_INDEX : conf->mapped ? DRS_STORAGE_MAPPED : DRS_STORAGE_OWNED;
+    batch.fullVerify = conf->fullVerify;
+    batch.listFormat = conf->listFormat;
+    batch.filter = drs_filter_empty(&conf->filter) ? NULL : &conf->filter;
+
+    if (conf->batchManifest) {
+        rc = drs_batch_add_manifest(&batch, conf->batchManifest);
+    }
+
+    if (!rc && conf->batchGlob) {
+        rc = drs_batch_add_glob(&batch, conf->batchGlob);
+    }
+
+    if (rc) {
+        printf("RETURNED %d\n", rc);
+    } else if ((rc = drs_batch_run(&batch)) < 0) {
+        printf("RETURNED %d\n", rc);
+        rc = 1;
+    } else {
+        drs_batch_print_summary(&batch, stdout);
+        rc = rc ? 1 : 0;
+    }
+
+    drs_batch_free(&batch);
+    return rc;
+}
+
+/* The -f archive, or every archive of the manifest and/or glob */
+int serveArchives(pConfig_t conf) {
+    drsBatch_t archives;
+    drsServeOptions_t serveOptions;
+    int rc = 0;
+
+    drs_batch_init(&archives, DRS_BATCH_LIST, NULL, 1);
+
+    if (!conf->batchManifest && !conf->batchGlob) {
+        rc = drs_batch_add(&archives, conf->filePath);
+    }
+
+    if (!rc && conf->batchManifest) {
+        rc = drs_batch_add_manifest(&archives, conf->batchManifest);
+    }
+
+    if (!rc && conf->batchGlob) {
+        rc = drs_batch_add_glob(&archives, conf->batchGlob);
+    }
+
+    if (!rc) {
+        serveOptions.socketPath = conf->serveSocket;
+        serveOptions.cacheSize = conf->cacheSize;
+        rc = drs_serve(&archives, &serveOptions);
+    }
+
+    drs_batch_free(&archives);
+    return rc;
+}
+
+/* Descriptors for raw output on stdout and raw input from stdin */
+int binaryStdout(void) {
+    fflush(stdout);
+#ifdef OS_IS_WINDOWS
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    return fileno(stdout);
+}
+
+int binaryStdin(void) {
+#ifdef OS_IS_WINDOWS
+    _setmode(_fileno(stdin), _O_BINARY);
+#endif
+    return fileno(stdin);
+}
+
+/* To --output when given, stdout otherwise */
+int listEntries(drs_t* drs, pConfig_t conf) {
+    int fd;
+    int rc;
+
+    if (!conf->output) {
+        return drs_list_entries(drs, (drsListFormat_t)conf->listFormat, binaryStdout());
+    }
+
+    if ((fd = file_create(conf->output)) == -1) {
+        fprintf(stderr, "Failed to create %s\n", conf->output);
+        return 6;
+    }
+
+    rc = drs_list_entries(drs, (drsListFormat_t)conf->listFormat, fd);
+
+    if (file_close_descriptor(fd) && !rc) {
+        rc = 7;
+    }
+
+    return rc;
+}
+
+void usage(void) {
+    printf("Not implemented\n");
+}
+
+int main(int argc, char* argv[]) {
+    drs_t drs;
+    config_t config;
+    drsExtractOptions_t extractOptions;
+    drsRepackStats_t repackStats;
+    drsCreateOptions_t createOptions;
+    drsCreateStats_t createStats;
+    drsVerifyReport_t verifyReport;
+    drsDiffStats_t diffStats;
+    drsWatchOptions_t watchOptions;
+    int rc = 0;
+
+    if (!(config.changes = calloc(argc, sizeof(drsChange_t)))) {
+        return 1;
+    }
+
+    if (parseParams(argc, argv, &config)) {
+        drs_filter_free(&config.filter);
+        free(config.changes);
+        usage();
+        return 1;
+    }
+
+    if (config.serveSocket) {
+        if ((rc = serveArchives(&config))) {
+            printf("RETURNED %d\n", rc);
+        }
+    } else if (config.batchManifest || config.batchGlob) {
+        rc = runBatch(&config);
+    } else if (config.list) {
+        /* Headers only, payloads stay on disk */
+        rc = drs_open_index(config.filePath, &drs);
+
+        if (rc) {
+            printf("RETURNED %d\n", rc);
+        } else if (config.listFormat >= 0) {
+            if ((rc = listEntries(&drs, &config))) {
+                fprintf(stderr, "RETURNED %d\n", rc);
+            }
+
+            drs_free(&drs);
+        } else {
+            drs_print_header(&drs, stdout);
+            drs_free(&drs);
+        }
+    } else if (config.diffTarget) {
+        if ((rc = diffArchives(&config))) {
+            printf("RETURNED %d\n", rc);
+        }
+    } else if (config.patchFile) {
+        rc = drs_patch(config.filePath, config.patchFile, &diffStats);
+
+        if (rc) {
+            printf("RETURNED %d\n", rc);
+        } else {
+            printf("%20s  %d added, %d removed, %d changed\n", "Patched:",
+                diffStats.added, diffStats.removed, diffStats.changed);
+
+            if (config.sidecar) {
+                rc = writeSidecar(config.filePath, config.jobs);
+            }
+        }
+    } else if (config.watch) {
+        /* filePath names the source directory, like --create */
+        watchOptions.jobs = config.jobs;
+        watchOptions.sidecar = config.sidecar;
+
+        if ((rc = drs_watch(config.filePath, config.output ? config.output : "generated.drs", &watchOptions))) {
+            printf("RETURNED %d\n", rc);
+        }
+    } else if (config.verify) {
+        rc = drs_verify(config.filePath, config.fullVerify, config.jobs, &verifyReport);
+
+        if (rc) {
+            printf("RETURNED %d\n", rc);
+        } else {
+            printf("%s: %d entries, %d mismatches%s\n", config.filePath, verifyReport.entries,
+                verifyReport.mismatches, verifyReport.quick ? " (unchanged since indexed)" : "");
+            rc = verifyReport.mismatches ? 1 : 0;
+        }
+    } else if (config.update) {
+        rc = drs_update_archive(config.filePath, config.changes, config.changeCount);
+
+        if (rc) {
+            printf("RETURNED %d\n", rc);
+        } else if (config.sidecar) {
+            rc = writeSidecar(config.filePath, config.jobs);
+        }
+    } else if (config.repack) {
+        /* Payloads come from a mapping of the input, rewriting it in place would zero them */
+        if (file_same(config.filePath, config.output ? config.output : "repacked.drs")) {
+            fprintf(stderr, "The output of --repack must not be the input archive\n");
+            rc = 1;
+        } else {
+            rc = drs_open_mapped(config.filePath, &drs);
+        }
+
+        if (rc) {
+            printf("RETURNED %d\n", rc);
+        } else {
+            config.repackOptions.dedup = config.dedup;
+
+            if (!(rc = drs_repack(&drs, &config.repackOptions, &repackStats))) {
+                rc = drs_create_archive(&drs, config.output ? config.output : "repacked.drs");
+            }
+
+            if (!rc && config.sidecar) {
+                rc = writeSidecar(config.output ? config.output : "repacked.drs", config.jobs);
+            }
+
+            if (rc) {
+                printf("RETURNED %d\n", rc);
+            } else {
+                printf("%20s  %lld bytes (%zu -> %zu, %zu alignment padding)\n", "Reclaimed:",
+                    (long long)repackStats.oldSize - (long long)repackStats.newSize,
+                    repackStats.oldSize, repackStats.newSize, repackStats.padding);
+                printf("%20s  %d -> %d\n", "Seeks:", repackStats.seeksBefore, repackStats.seeksAfter);
+
+                if (config.dedup) {
+                    printf("%20s  %zu bytes\n", "Deduplicated:", repackStats.deduplicated);
+                }
+            }
+
+            drs_free(&drs);
+        }
+    } else if (config.convert >= 0) {
+        if ((rc = convertArchive(&config))) {
+            printf("RETURNED %d\n", rc);
+        }
+    } else if (config.extract && config.tarStdout) {
+        /* Payloads leave by reference from the mapping, or from the descriptor with -k */
+        if (config.kernelCopy) {
+            rc = drs_open_index(config.filePath, &drs);
+        } else {
+            rc = drs_open_mapped(config.filePath, &drs);
+        }
+
+        if (!rc) {
+            rc = drs_export_tar(&drs, binaryStdout(), drs_filter_empty(&config.filter) ? NULL : &config.filter);
+            drs_free(&drs);
+        }
+
+        if (rc) {
+            fprintf(stderr, "RETURNED %d\n", rc);
+        }
+    } else if (config.extract) {
+        extractOptions.jobs = config.jobs;
+        extractOptions.filter = drs_filter_empty(&config.filter) ? NULL : &config.filter;
+        extractOptions.coalesce = 0;
+
+        if (config.kernelCopy) {
+            /* Payloads are copied file to file, never loaded */
+            rc = drs_open_index(config.filePath, &drs);
+        } else if (extractOptions.filter && !config.mapped) {
+            /* Only the selected payloads are read, neighbours in one go */
+            extractOptions.coalesce = 1;
+            rc = drs_open_index(config.filePath, &drs);
+        } else if (config.mapped) {
+            rc = drs_open_mapped(config.filePath, &drs);
+        } else {
+            rc = drs_load(config.filePath, &drs);
+        }
+
+        if (rc) {
+            printf("RETURNED %d\n", rc);
+        } else {
+            drs_print_header(&drs, stdout);
+            rc = drs_extract_archive_ex(&drs, config.output ? config.output : "drsFiles", &extractOptions);
+
+            if (!rc && config.sidecar) {
+                rc = drs_sidecar_write(&drs, config.filePath, config.jobs);
+            }
+            //drs_create_archive(&drs, "../generated.drs");
+            drs_free(&drs);
+
+            if (rc) {
+                fprintf(stderr, "RETURNED %d\n", rc);
+            }
+        }
+    } else if (config.tarStdin) {
+        rc = drs_create_from_tar(binaryStdin(), config.output ? config.output : "generated.drs", &createStats);
+
+        if (!rc && config.sidecar) {
+            rc = writeSidecar(config.output ? config.output : "generated.drs", config.jobs);
+        }
+
+        if (rc) {
+            printf("RETURNED %d\n", rc);
+        }
+    } else {
+        /* filePath names the source directory when creating */
+        createOptions.dedup = config.dedup;
+        createOptions.extended = config.extended;
+        createOptions.jobs = config.jobs;
+        rc = drs_create_from_directory(config.filePath, config.output ? config.output : "generated.drs",
+            &createOptions, &createStats);
+
+        if (!rc && config.sidecar) {
+            rc = writeSidecar(config.output ? config.output : "generated.drs", config.jobs);
+        }
+
+        if (rc) {
+            printf("RETURNED %d\n", rc);
+        } else if (config.dedup) {
+            printf("%20s  %zu bytes (%zu bytes written)\n", "Deduplicated:",
+                createStats.deduplicated, createStats.size);
+        }
+    }
+
+    if (config.stats) {
+        stats_print(stderr, config.statsFormat);
+    }
+
+    drs_filter_free(&config.filter);
+    free(config.changes);
+    return rc;
+}
+
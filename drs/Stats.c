@@ -0,0 +1,120 @@
+#include "FileManager.h"
+#include "Stats.h"
+
+#ifdef OS_IS_WINDOWS
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#ifdef DRS_STATS
+
+static const char* phaseNames[STATS_PHASE_COUNT] = {
+    "read", "parse", "index", "payload", "extract", "write"
+};
+
+static const char* counterNames[STATS_COUNTER_COUNT] = {
+    "bytes_read", "bytes_written", "open", "read", "write", "copy", "map", "allocations", "alloc_bytes"
+};
+
+#ifdef OS_IS_WINDOWS
+#define STATS_THREAD_LOCAL __declspec(thread)
+#define STATS_ATOMIC_ADD(target, value) InterlockedExchangeAdd64((volatile LONG64*)(target), (LONG64)(value))
+#define STATS_ATOMIC_LOAD(target) ((unsigned long long)InterlockedExchangeAdd64((volatile LONG64*)(target), 0))
+#else
+#define STATS_THREAD_LOCAL __thread
+#define STATS_ATOMIC_ADD(target, value) __atomic_fetch_add((target), (value), __ATOMIC_RELAXED)
+#define STATS_ATOMIC_LOAD(target) __atomic_load_n((target), __ATOMIC_RELAXED)
+#endif
+
+/* Shared totals; span starts are per thread so workers can time in parallel */
+static unsigned long long phaseNanos[STATS_PHASE_COUNT];
+static unsigned long long phaseCalls[STATS_PHASE_COUNT];
+static unsigned long long counters[STATS_COUNTER_COUNT];
+static STATS_THREAD_LOCAL unsigned long long phaseStart[STATS_PHASE_COUNT];
+
+static unsigned long long stats_now(void) {
+#ifdef OS_IS_WINDOWS
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (unsigned long long)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+#endif
+}
+
+void stats_begin(statsPhase_t phase) {
+    phaseStart[phase] = stats_now();
+}
+
+void stats_end(statsPhase_t phase) {
+    STATS_ATOMIC_ADD(&phaseNanos[phase], stats_now() - phaseStart[phase]);
+    STATS_ATOMIC_ADD(&phaseCalls[phase], 1ULL);
+}
+
+void stats_add(statsCounter_t counter, unsigned long long value) {
+    STATS_ATOMIC_ADD(&counters[counter], value);
+}
+
+int stats_available(void) {
+    return 1;
+}
+
+void stats_print(FILE* out, statsFormat_t format) {
+    int i;
+
+    if (format == STATS_FORMAT_JSON) {
+        fprintf(out, "{\"phases\": {");
+
+        for (i = 0; i < STATS_PHASE_COUNT; ++i) {
+            fprintf(out, "%s\"%s\": {\"calls\": %llu, \"seconds\": %.6f}", i ? ", " : "", phaseNames[i],
+                STATS_ATOMIC_LOAD(&phaseCalls[i]), (double)STATS_ATOMIC_LOAD(&phaseNanos[i]) / 1e9);
+        }
+
+        fprintf(out, "}, \"counters\": {");
+
+        for (i = 0; i < STATS_COUNTER_COUNT; ++i) {
+            fprintf(out, "%s\"%s\": %llu", i ? ", " : "", counterNames[i], STATS_ATOMIC_LOAD(&counters[i]));
+        }
+
+        fprintf(out, "}}\n");
+        return;
+    }
+
+    fprintf(out, "%20s  %8s  %12s\n", "Phase", "Calls", "Seconds");
+
+    for (i = 0; i < STATS_PHASE_COUNT; ++i) {
+        if (STATS_ATOMIC_LOAD(&phaseCalls[i])) {
+            fprintf(out, "%20s  %8llu  %12.6f\n", phaseNames[i], STATS_ATOMIC_LOAD(&phaseCalls[i]),
+                (double)STATS_ATOMIC_LOAD(&phaseNanos[i]) / 1e9);
+        }
+    }
+
+    fprintf(out, "\n%20s  %20s\n", "Counter", "Value");
+
+    for (i = 0; i < STATS_COUNTER_COUNT; ++i) {
+        fprintf(out, "%20s  %20llu\n", counterNames[i], STATS_ATOMIC_LOAD(&counters[i]));
+    }
+}
+
+#else
+
+int stats_available(void) {
+    return 0;
+}
+
+void stats_print(FILE* out, statsFormat_t format) {
+    if (format == STATS_FORMAT_JSON) {
+        fprintf(out, "{}\n");
+    } else {
+        fprintf(out, "Statistics were compiled out, rebuild with -DDRS_STATS\n");
+    }
+}
+
+#endif
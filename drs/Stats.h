@@ -0,0 +1,66 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Per-phase timing, I/O and allocation counters behind --stats. Built with
+ * DRS_STATS undefined, every STATS_* macro expands to nothing.
+ **/
+
+typedef enum e_statsPhase {
+    STATS_PHASE_READ = 0,                        // Whole-archive read or map
+    STATS_PHASE_PARSE,                           // Header parsing
+    STATS_PHASE_INDEX,                           // ID index build
+    STATS_PHASE_PAYLOAD,                         // Per-entry copies in drs_load
+    STATS_PHASE_EXTRACT,
+    STATS_PHASE_WRITE,                           // Archive creation
+    STATS_PHASE_COUNT
+} statsPhase_t;
+
+typedef enum e_statsCounter {
+    STATS_BYTES_READ = 0,
+    STATS_BYTES_WRITTEN,
+    STATS_SYSCALL_OPEN,
+    STATS_SYSCALL_READ,
+    STATS_SYSCALL_WRITE,
+    STATS_SYSCALL_COPY,                          // copy_file_range and sendfile
+    STATS_SYSCALL_MAP,
+    STATS_ALLOCATIONS,
+    STATS_ALLOC_BYTES,
+    STATS_COUNTER_COUNT
+} statsCounter_t;
+
+typedef enum e_statsFormat {
+    STATS_FORMAT_TABLE = 0,
+    STATS_FORMAT_JSON
+} statsFormat_t;
+
+#ifdef DRS_STATS
+void stats_begin(statsPhase_t phase);
+void stats_end(statsPhase_t phase);
+void stats_add(statsCounter_t counter, unsigned long long value);
+
+#define STATS_BEGIN(phase)        stats_begin(phase)
+#define STATS_END(phase)          stats_end(phase)
+#define STATS_ADD(counter, value) stats_add(counter, (unsigned long long)(value))
+#define STATS_ALLOC(size)         (stats_add(STATS_ALLOCATIONS, 1), stats_add(STATS_ALLOC_BYTES, (unsigned long long)(size)))
+#else
+#define STATS_BEGIN(phase)        ((void)0)
+#define STATS_END(phase)          ((void)0)
+#define STATS_ADD(counter, value) ((void)0)
+#define STATS_ALLOC(size)         ((void)0)
+#endif
+
+int stats_available(void);
+void stats_print(FILE* out, statsFormat_t format);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
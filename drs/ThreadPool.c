@@ -0,0 +1,164 @@
+#include <stdlib.h>
+
+#include "ThreadPool.h"
+
+#ifndef OS_IS_WINDOWS
+#include <unistd.h>
+#endif
+
+typedef struct s_tpShared {
+    tpMutex_t          lock;
+    size_t             next;                     // Next unclaimed work item
+    size_t             itemCount;
+    threadpool_work_fn work;
+    void*              userData;
+} tpShared_t, *pTpShared_t;
+
+void threadpool_mutex_init(tpMutex_t* mutex) {
+#ifdef OS_IS_WINDOWS
+    InitializeCriticalSection(mutex);
+#else
+    pthread_mutex_init(mutex, NULL);
+#endif
+}
+
+void threadpool_mutex_lock(tpMutex_t* mutex) {
+#ifdef OS_IS_WINDOWS
+    EnterCriticalSection(mutex);
+#else
+    pthread_mutex_lock(mutex);
+#endif
+}
+
+void threadpool_mutex_unlock(tpMutex_t* mutex) {
+#ifdef OS_IS_WINDOWS
+    LeaveCriticalSection(mutex);
+#else
+    pthread_mutex_unlock(mutex);
+#endif
+}
+
+void threadpool_mutex_destroy(tpMutex_t* mutex) {
+#ifdef OS_IS_WINDOWS
+    DeleteCriticalSection(mutex);
+#else
+    pthread_mutex_destroy(mutex);
+#endif
+}
+
+int threadpool_cpu_count(void) {
+#ifdef OS_IS_WINDOWS
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return count > 0 ? (int)count : 1;
+#endif
+}
+
+/* Workers claim items one at a time so slow items never hold up the rest */
+#ifdef OS_IS_WINDOWS
+static DWORD WINAPI threadpool_worker(LPVOID arg) {
+#else
+static void* threadpool_worker(void* arg) {
+#endif
+    pTpShared_t shared = arg;
+    size_t item;
+
+    for (;;) {
+        threadpool_mutex_lock(&shared->lock);
+        item = shared->next;
+        if (item < shared->itemCount) {
+            ++shared->next;
+        }
+        threadpool_mutex_unlock(&shared->lock);
+
+        if (item >= shared->itemCount) {
+            break;
+        }
+
+        shared->work(item, shared->userData);
+    }
+
+#ifdef OS_IS_WINDOWS
+    return 0;
+#else
+    return NULL;
+#endif
+}
+
+int threadpool_run(size_t itemCount, int jobs, threadpool_work_fn work, void* userData) {
+    tpShared_t shared;
+    int started = 0;
+    int i;
+#ifdef OS_IS_WINDOWS
+    HANDLE *threads = NULL;
+#else
+    pthread_t *threads = NULL;
+#endif
+
+    if (!work) {
+        return 1;
+    }
+
+    if (jobs <= 0) {
+        jobs = threadpool_cpu_count();
+    }
+
+    if ((size_t)jobs > itemCount) {
+        jobs = (int)itemCount;
+    }
+
+    /* Nothing to share, stay on the calling thread */
+    if (jobs <= 1) {
+        for (i = 0; (size_t)i < itemCount; ++i) {
+            work((size_t)i, userData);
+        }
+
+        return 0;
+    }
+
+    if (!(threads = malloc(jobs * sizeof(*threads)))) {
+        return 2;
+    }
+
+    threadpool_mutex_init(&shared.lock);
+    shared.next = 0;
+    shared.itemCount = itemCount;
+    shared.work = work;
+    shared.userData = userData;
+
+    for (i = 0; i < jobs; ++i) {
+#ifdef OS_IS_WINDOWS
+        if ((threads[i] = CreateThread(NULL, 0, threadpool_worker, &shared, 0, NULL)) == NULL) {
+            break;
+        }
+#else
+        if (pthread_create(&threads[i], NULL, threadpool_worker, &shared)) {
+            break;
+        }
+#endif
+        ++started;
+    }
+
+    /* Whatever could not be handed to a thread runs here */
+    if (!started) {
+        threadpool_worker(&shared);
+    }
+
+    for (i = 0; i < started; ++i) {
+#ifdef OS_IS_WINDOWS
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+#else
+        pthread_join(threads[i], NULL);
+#endif
+    }
+
+    threadpool_mutex_destroy(&shared.lock);
+    free(threads);
+    return 0;
+}
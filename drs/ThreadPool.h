@@ -0,0 +1,35 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stddef.h>
+
+#include "FileManager.h"
+
+#ifdef OS_IS_WINDOWS
+#include <windows.h>
+typedef CRITICAL_SECTION tpMutex_t;
+#else
+#include <pthread.h>
+typedef pthread_mutex_t tpMutex_t;
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Called once per work item, from any worker thread */
+typedef void (*threadpool_work_fn)(size_t item, void* userData);
+
+int threadpool_cpu_count(void);
+int threadpool_run(size_t itemCount, int jobs, threadpool_work_fn work, void* userData);
+
+void threadpool_mutex_init(tpMutex_t* mutex);
+void threadpool_mutex_lock(tpMutex_t* mutex);
+void threadpool_mutex_unlock(tpMutex_t* mutex);
+void threadpool_mutex_destroy(tpMutex_t* mutex);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif